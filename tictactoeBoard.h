@@ -0,0 +1,254 @@
+/***********************************************************/
+/* Board kernels shared by the TicTacToe server and client */
+/* for each supported geometry (rows, columns and number   */
+/* of marks in a row to win). A board is stored as one     */
+/* character per square, and checked as a bitboard per     */
+/* player (bit i set if the player holds square i). The    */
+/* line masks are constant expressions of the geometry, so */
+/* each kernel instantiated with BOARD_KERNELS() compiles  */
+/* to a fixed run of shifts and ANDs with no loops. Boards */
+/* are mapped through their rotations and reflections with */
+/* byte-sliced permutation tables built at startup. Whole  */
+/* batches of boards are classified 8 at a time with the   */
+/* same shifts and ANDs on vectors, using AVX2 when the    */
+/* CPU running it has it (plain C otherwise).              */
+/***********************************************************/
+
+#ifndef TICTACTOE_BOARD_H
+#define TICTACTOE_BOARD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The largest number of rows or columns of a supported geometry (the squares must fit in 32 bits). */
+#define BOARD_MAX_SIDE 5
+
+/* A mask of the n lowest bits. */
+#define BOARD_SPAN(n) ((n) >= 32 ? 0xFFFFFFFFu : ((1u << (n)) - 1))
+/* A mask repeated a number of times (up to BOARD_MAX_SIDE), each copy shifted by the stride. */
+#define BOARD_REPEAT(mask, times, stride) \
+    (((times) > 0 ? (mask) : 0) | ((times) > 1 ? (mask) << (stride) : 0) | ((times) > 2 ? (mask) << 2*(stride) : 0) \
+    | ((times) > 3 ? (mask) << 3*(stride) : 0) | ((times) > 4 ? (mask) << 4*(stride) : 0))
+
+/* The squares a line of k can start from going right, down, down-right and down-left. */
+#define BOARD_STARTS_RIGHT(rows, cols, k) BOARD_REPEAT(BOARD_SPAN((cols)-(k)+1), (rows), (cols))
+#define BOARD_STARTS_DOWN(rows, cols, k) BOARD_REPEAT(BOARD_SPAN(cols), (rows)-(k)+1, (cols))
+#define BOARD_STARTS_DIAGONAL(rows, cols, k) BOARD_REPEAT(BOARD_SPAN((cols)-(k)+1), (rows)-(k)+1, (cols))
+#define BOARD_STARTS_ANTIDIAGONAL(rows, cols, k) (BOARD_REPEAT(BOARD_SPAN((cols)-(k)+1), (rows)-(k)+1, (cols)) << ((k)-1))
+
+/* The bit for a square if it holds the mark (and exists on a board of the given number of squares). */
+#define BOARD_SQUARE(board, mark, square, squares) ((square) < (squares) ? (uint32_t)((board)[(square) < (squares) ? (square) : 0] == (mark)) << (square) : 0)
+/* The bitboard of the squares holding a mark, one term per square (up to BOARD_MAX_SIDE squared). */
+#define BOARD_BITS(board, mark, n) \
+    (BOARD_SQUARE(board, mark, 0, n) | BOARD_SQUARE(board, mark, 1, n) | BOARD_SQUARE(board, mark, 2, n) | BOARD_SQUARE(board, mark, 3, n) \
+    | BOARD_SQUARE(board, mark, 4, n) | BOARD_SQUARE(board, mark, 5, n) | BOARD_SQUARE(board, mark, 6, n) | BOARD_SQUARE(board, mark, 7, n) \
+    | BOARD_SQUARE(board, mark, 8, n) | BOARD_SQUARE(board, mark, 9, n) | BOARD_SQUARE(board, mark, 10, n) | BOARD_SQUARE(board, mark, 11, n) \
+    | BOARD_SQUARE(board, mark, 12, n) | BOARD_SQUARE(board, mark, 13, n) | BOARD_SQUARE(board, mark, 14, n) | BOARD_SQUARE(board, mark, 15, n) \
+    | BOARD_SQUARE(board, mark, 16, n) | BOARD_SQUARE(board, mark, 17, n) | BOARD_SQUARE(board, mark, 18, n) | BOARD_SQUARE(board, mark, 19, n) \
+    | BOARD_SQUARE(board, mark, 20, n) | BOARD_SQUARE(board, mark, 21, n) | BOARD_SQUARE(board, mark, 22, n) | BOARD_SQUARE(board, mark, 23, n) \
+    | BOARD_SQUARE(board, mark, 24, n))
+
+/* The states a board is classified as by the batch kernels. */
+#define BOARD_OPEN 0        // nobody has won and squares are left
+#define BOARD_P1_WIN 1      // Player 1 holds a line
+#define BOARD_P2_WIN 2      // Player 2 holds a line (and Player 1 doesn't)
+#define BOARD_DRAW 3        // nobody holds a line and every square is held
+/* The number of boards the batch kernels classify at once (32-bit lanes of a 256-bit vector). */
+#define BOARD_LANES 8
+
+/* A vector of bitboards, one per lane, and the lane masks comparing two of them gives. */
+typedef uint32_t board_vector __attribute__((vector_size(4 * BOARD_LANES)));
+typedef int32_t board_mask __attribute__((vector_size(4 * BOARD_LANES)));
+
+/* The number of 8-square chunks a bitboard is permuted in by the symmetry tables. */
+#define BOARD_CHUNKS(squares) (((squares) + 7) / 8)
+
+/* The squares starting a run of k held squares, each a step further than the last (up to 5 in a row).
+ * Squares past the k-th are shifted by 0, ANDing the bits with themselves, so vectors work too. */
+#define BOARD_RUN(bits, step, k) \
+    ((bits) & (bits) >> ((k) > 1 ? (step) : 0) & (bits) >> ((k) > 2 ? 2*(step) : 0) \
+    & (bits) >> ((k) > 3 ? 3*(step) : 0) & (bits) >> ((k) > 4 ? 4*(step) : 0))
+/* The squares starting a line of k held squares in any direction (bitboards or vectors of them). */
+#define BOARD_LINES(bits, rows, cols, k) \
+    ((BOARD_RUN(bits, 1, k) & BOARD_STARTS_RIGHT(rows, cols, k)) \
+    | (BOARD_RUN(bits, (cols), k) & BOARD_STARTS_DOWN(rows, cols, k)) \
+    | (BOARD_RUN(bits, (cols)+1, k) & BOARD_STARTS_DIAGONAL(rows, cols, k)) \
+    | (BOARD_RUN(bits, (cols)-1, k) & BOARD_STARTS_ANTIDIAGONAL(rows, cols, k)))
+
+/**
+ * @brief Defines a batch kernel classifying boards BOARD_LANES at a time on vectors, compiled for
+ * the given instruction set (the last batch is padded with empty boards).
+ *
+ * @param NAME The prefix of the kernels.
+ * @param ISA The suffix of the kernel.
+ * @param TARGET The target attribute of the kernel.
+ */
+#define BOARD_CLASSIFY_VECTOR(NAME, ISA, TARGET, ROWS, COLS, K) \
+__attribute__((target(TARGET))) static void NAME##_classify_##ISA(const uint32_t *p1, const uint32_t *p2, int count, uint8_t *states) { \
+    int i, j; \
+    for (i = 0; i < count; i += BOARD_LANES) { \
+        board_vector x = {0}, o = {0}; \
+        board_mask win1, win2, draw, state; \
+        int n = (count - i < BOARD_LANES) ? count - i : BOARD_LANES; \
+        memcpy(&x, p1 + i, n * sizeof(uint32_t)); \
+        memcpy(&o, p2 + i, n * sizeof(uint32_t)); \
+        /* Each mask is all ones in the lanes it holds for, and the first that holds wins */ \
+        win1 = BOARD_LINES(x, ROWS, COLS, K) != 0; \
+        win2 = (BOARD_LINES(o, ROWS, COLS, K) != 0) & ~win1; \
+        draw = ((x | o) == BOARD_SPAN((ROWS)*(COLS))) & ~win1 & ~win2; \
+        state = (win1 & BOARD_P1_WIN) | (win2 & BOARD_P2_WIN) | (draw & BOARD_DRAW); \
+        for (j = 0; j < n; j++) states[i+j] = state[j]; \
+    } \
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* The batch kernels for x86: AVX2 (8 lanes per instruction) or plain C. SSE4.2 (4 lanes) isn't
+ * offered, the split vectors it compiles to are slower than plain C. */
+#define BOARD_CLASSIFY_KERNELS(NAME, ROWS, COLS, K) \
+BOARD_CLASSIFY_VECTOR(NAME, avx2, "avx2", ROWS, COLS, K) \
+ \
+__attribute__((constructor)) static void NAME##_init_classify(void) { \
+    __builtin_cpu_init(); \
+    if (__builtin_cpu_supports("avx2")) { \
+        NAME##_classify = NAME##_classify_avx2; \
+        NAME##_classify_isa = "avx2"; \
+    } \
+}
+#else
+/* Other architectures classify batches in plain C. */
+#define BOARD_CLASSIFY_KERNELS(NAME, ROWS, COLS, K)
+#endif
+
+/**
+ * @brief Instantiates the board kernels for one geometry, prefixed with the given name:
+ *
+ * - NAME_ROWS, NAME_COLUMNS, NAME_SQUARES and NAME_IN_A_ROW: the geometry.
+ * - NAME_FULL: the bitboard with every square held.
+ * - NAME_bits(board, mark): the bitboard of the squares holding a mark.
+ * - NAME_win(bits): whether a bitboard holds a line of k.
+ * - NAME_full(bits): whether a bitboard (of both players) holds every square.
+ * - NAME_init(board): fills a board with the square numbers, starting from '1'.
+ * - NAME_print(board): prints a board as a grid.
+ * - NAME_SYMMETRIES: the number of symmetries of the board (8 rotations and reflections of a
+ *   square board, 4 of a rectangular one), symmetry 0 being the identity.
+ * - NAME_transform(bits, sym): the bitboard mapped through a symmetry.
+ * - NAME_canonical(p1, p2, &sym): the smallest key of both players' bitboards over every
+ *   symmetry, along with the symmetry giving it.
+ * - NAME_map_square(sym, square) and NAME_unmap_square(sym, square): a square (from 0) mapped
+ *   through a symmetry and back, e.g. to play a move found for the canonical board.
+ * - NAME_classify(p1, p2, count, states): classifies a batch of boards (both players' bitboards)
+ *   as BOARD_OPEN, BOARD_P1_WIN, BOARD_P2_WIN or BOARD_DRAW, with the widest kernel the CPU
+ *   supports (named by NAME_classify_isa). NAME_classify_scalar() is the plain C kernel.
+ *
+ * @param NAME The prefix of the kernels.
+ * @param ROWS The number of rows (at most BOARD_MAX_SIDE).
+ * @param COLS The number of columns (at most BOARD_MAX_SIDE).
+ * @param K The number of marks in a row to win (at most the smaller side).
+ */
+#define BOARD_KERNELS(NAME, ROWS, COLS, K) \
+enum { NAME##_ROWS = (ROWS), NAME##_COLUMNS = (COLS), NAME##_SQUARES = (ROWS)*(COLS), NAME##_IN_A_ROW = (K), \
+    NAME##_FULL = BOARD_SPAN((ROWS)*(COLS)), NAME##_SYMMETRIES = ((ROWS) == (COLS)) ? 8 : 4 }; \
+_Static_assert((ROWS) <= BOARD_MAX_SIDE && (COLS) <= BOARD_MAX_SIDE, #NAME ": board too large"); \
+_Static_assert((K) >= 1 && (K) <= (ROWS) && (K) <= (COLS), #NAME ": no line of k fits on the board"); \
+ \
+static inline uint32_t NAME##_bits(const char *board, char mark) { \
+    return BOARD_BITS(board, mark, (ROWS)*(COLS)); \
+} \
+ \
+static inline int NAME##_win(uint32_t bits) { \
+    return BOARD_LINES(bits, ROWS, COLS, K) != 0; \
+} \
+ \
+static inline int NAME##_full(uint32_t bits) { \
+    return bits == NAME##_FULL; \
+} \
+ \
+static inline void NAME##_init(char *board) { \
+    int i; \
+    for (i = 0; i < (ROWS)*(COLS); i++) board[i] = '1' + i; \
+} \
+ \
+static inline void NAME##_print(const char *board) { \
+    int r, c; \
+    for (r = 0; r < (ROWS); r++) { \
+        for (c = 0; c < (COLS); c++) printf("     %s", (c < (COLS)-1) ? "|" : "\n"); \
+        for (c = 0; c < (COLS); c++) { \
+            int square = r*(COLS) + c; \
+            /* Open squares past 9 are shown by their number rather than the character after '9' */ \
+            if (board[square] == '1' + square && square >= 9) printf(" %2d %s", square + 1, (c < (COLS)-1) ? " |" : "\n"); \
+            else printf("  %c %s", board[square], (c < (COLS)-1) ? " |" : "\n"); \
+        } \
+        for (c = 0; c < (COLS); c++) printf("%s%s", (r < (ROWS)-1) ? "_____" : "     ", (c < (COLS)-1) ? "|" : "\n"); \
+    } \
+    printf("\n"); \
+} \
+ \
+static struct { \
+    uint32_t bits[NAME##_SYMMETRIES][BOARD_CHUNKS((ROWS)*(COLS))][256];    /* each chunk of a bitboard mapped through each symmetry */ \
+    unsigned char square[NAME##_SYMMETRIES][(ROWS)*(COLS)];               /* each square mapped through each symmetry */ \
+    unsigned char inverse[NAME##_SYMMETRIES][(ROWS)*(COLS)];              /* each square mapped back from each symmetry */ \
+} NAME##_symmetry; \
+ \
+__attribute__((constructor)) static void NAME##_init_symmetries(void) { \
+    int sym, square, chunk, value, bit; \
+    for (sym = 0; sym < NAME##_SYMMETRIES; sym++) { \
+        /* Transpose (square boards only), then mirror the columns and the rows */ \
+        for (square = 0; square < (ROWS)*(COLS); square++) { \
+            int r = square / (COLS), c = square % (COLS), t; \
+            if (sym & 4) { t = r; r = c; c = t; } \
+            if (sym & 1) c = (COLS)-1 - c; \
+            if (sym & 2) r = (ROWS)-1 - r; \
+            NAME##_symmetry.square[sym][square] = r*(COLS) + c; \
+            NAME##_symmetry.inverse[sym][r*(COLS) + c] = square; \
+        } \
+        for (chunk = 0; chunk < BOARD_CHUNKS((ROWS)*(COLS)); chunk++) { \
+            for (value = 0; value < 256; value++) { \
+                uint32_t bits = 0; \
+                for (bit = 0; bit < 8 && chunk*8 + bit < (ROWS)*(COLS); bit++) { \
+                    if (value >> bit & 1) bits |= 1u << NAME##_symmetry.square[sym][chunk*8 + bit]; \
+                } \
+                NAME##_symmetry.bits[sym][chunk][value] = bits; \
+            } \
+        } \
+    } \
+} \
+ \
+static inline uint32_t NAME##_transform(uint32_t bits, int sym) { \
+    uint32_t mapped = 0; \
+    int chunk; \
+    for (chunk = 0; chunk < BOARD_CHUNKS((ROWS)*(COLS)); chunk++) mapped |= NAME##_symmetry.bits[sym][chunk][bits >> 8*chunk & 0xFF]; \
+    return mapped; \
+} \
+ \
+static inline uint64_t NAME##_canonical(uint32_t p1, uint32_t p2, int *sym) { \
+    uint64_t best = (uint64_t)p2 << ((ROWS)*(COLS)) | p1; \
+    int s; \
+    *sym = 0; \
+    for (s = 1; s < NAME##_SYMMETRIES; s++) { \
+        uint64_t key = (uint64_t)NAME##_transform(p2, s) << ((ROWS)*(COLS)) | NAME##_transform(p1, s); \
+        if (key < best) { best = key; *sym = s; } \
+    } \
+    return best; \
+} \
+ \
+static inline int NAME##_map_square(int sym, int square) { \
+    return NAME##_symmetry.square[sym][square]; \
+} \
+ \
+static inline int NAME##_unmap_square(int sym, int square) { \
+    return NAME##_symmetry.inverse[sym][square]; \
+} \
+ \
+__attribute__((unused)) static void NAME##_classify_scalar(const uint32_t *p1, const uint32_t *p2, int count, uint8_t *states) { \
+    int i; \
+    for (i = 0; i < count; i++) { \
+        states[i] = NAME##_win(p1[i]) ? BOARD_P1_WIN : NAME##_win(p2[i]) ? BOARD_P2_WIN : NAME##_full(p1[i] | p2[i]) ? BOARD_DRAW : BOARD_OPEN; \
+    } \
+} \
+ \
+__attribute__((unused)) static void (*NAME##_classify)(const uint32_t *p1, const uint32_t *p2, int count, uint8_t *states) = NAME##_classify_scalar; \
+__attribute__((unused)) static const char *NAME##_classify_isa = "scalar"; \
+BOARD_CLASSIFY_KERNELS(NAME, ROWS, COLS, K)
+
+#endif
@@ -15,11 +15,25 @@
 #include <errno.h>
 #include <sys/time.h>
 #include <ctype.h>
-/* Define the number of rows and columns */
+#include <sys/un.h>
+#include <sys/mman.h>
+#include "tictactoeShm.h"
+#include "tictactoeBoard.h"
+/* Define the number of rows and columns (the geometry can be overridden when building) */
+#ifndef ROWS
 #define ROWS 3
+#endif
+#ifndef COLUMNS
 #define COLUMNS 3
+#endif
+/* The number of marks in a row needed to win */
+#ifndef IN_A_ROW
+#define IN_A_ROW 3
+#endif
 /* The number of command line arguments. */
 #define NUM_ARGS 3
+/* The number of bytes in a NEW_GAME handshake cookie. */
+#define COOKIE_SIZE 8
 
 /* C language requires that you predefine all the routines you are writing */
 struct buffer
@@ -30,12 +44,29 @@ struct buffer
     char data;
     char gameNumber;
 };
+/* NEW_GAME datagram carrying a handshake cookie from servers that require one */
+struct cookieBuffer
+{
+    struct buffer command;
+    unsigned char cookie[COOKIE_SIZE];
+};
+/* The board kernels for the client's board geometry (ttt_bits(), ttt_win(), ttt_full(), ...) */
+BOARD_KERNELS(ttt, ROWS, COLUMNS, IN_A_ROW)
+
 int checkwin(char board[ROWS][COLUMNS]);
 void print_board(char board[ROWS][COLUMNS]);
 int tictactoe();
 int initSharedState(char board[ROWS][COLUMNS]);
 struct buffer P2choice();
 void set_timeout(int sd, int second);
+void shm_connect(const char *path);
+int send_datagram(int sd, const void *data, size_t length, struct sockaddr_in *serverAdd);
+int recv_datagram(int sd, void *data, size_t length, struct sockaddr_in *serverAdd);
+
+/* Shared-memory channel to a server on the same host (-m), NULL when playing over UDP */
+struct Shm_Channel *channel = NULL;
+int serverEvent, clientEvent;     // eventfds that wake the server and this client
+int shmSpins, shmTimeout = -1;    // spins before sleeping, and the receive timeout in seconds
 
 int main(int argc, char *argv[])
 {
@@ -52,8 +83,21 @@ int main(int argc, char *argv[])
     {
         printf("Wrong number of command line arguments");
         printf("Input is as follows: tictactoeP2 <port-num> <ip-address>");
+        printf("                 or: tictactoeP2 -m <shm-socket>");
         exit(1);
     }
+    // plays through shared memory with a server on the same host
+    if (strcmp(argv[1], "-m") == 0)
+    {
+        shm_connect(argv[2]);
+        sd = -1;
+        Buffer.version = 4;
+        send_datagram(sd, &Buffer, sizeof(Buffer), &server_address);
+        printf("Connected to the server!\n");
+        initSharedState(board);
+        tictactoe(board, sd, &server_address);
+        return 0;
+    }
     // create the socket
     sd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sd < 0)
@@ -82,11 +126,10 @@ int main(int argc, char *argv[])
     }
 
     // connnect to the sever
-    socklen_t fromLength = sizeof(struct sockaddr);
     Buffer.version = 4;
     Buffer.command = 0;
     Buffer.seqNum = 0;
-    if (sendto(sd, &Buffer, sizeof(Buffer), 0, (struct sockaddr *)&server_address, fromLength) < 0)
+    if (send_datagram(sd, &Buffer, sizeof(Buffer), &server_address) < 0)
     {
         close(sd);
         perror("error    connecting    stream    socket");
@@ -108,6 +151,7 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
 
     char gameNumber;
     struct buffer player2, player1 = {0};
+    struct cookieBuffer reply = {0};
     /* loop, first print the board, then ask player 'n' to make a move */
     player2.seqNum = 0;
     int WrongSeq = 0;
@@ -115,7 +159,6 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
     do
     {
 
-        socklen_t fromLength = sizeof(struct sockaddr);
         int choice;
         print_board(board);            // call function to print the board on the screen
         player = (player % 2) ? 1 : 2; // Mod math to figure out who the player is
@@ -132,7 +175,19 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
                 set_timeout(sd, 30);
             }
             printf("Waiting for square selection from player 1..\n"); // gets chosen spot from player 1
-            rc = recvfrom(sd, &player1, sizeof(player1), 0, (struct sockaddr *)serverAdd, &fromLength);
+            rc = recv_datagram(sd, &reply, sizeof(reply), serverAdd);
+            player1 = reply.command;
+            // checks for a handshake cookie from the server
+            // echoes it back with the NEW_GAME command so a game is allocated
+            if (rc == sizeof(reply) && player1.command == 0)
+            {
+                printf("Server sent a handshake cookie, echoing it back...\n");
+                reply.command.version = 4;
+                reply.command.seqNum = 0;
+                reply.command.command = 0;
+                rc = send_datagram(sd, &reply, sizeof(reply), serverAdd);
+                continue;
+            }
             pick = player1.data;
             if (gameNumber == 0)
             {
@@ -144,7 +199,7 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
             {
                 printf("Datagram recived was 1 behind...\n");
                 printf("Resending last Datagram...\n");
-                rc = sendto(sd, &player2, sizeof(player2), 0, (struct sockaddr *)serverAdd, fromLength);
+                rc = send_datagram(sd, &player2, sizeof(player2), serverAdd);
                  continue;
                 }
                 */
@@ -170,7 +225,7 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
                         }
 
                         printf("Resend Version: %d , SeqNumber %d , Command %d, Data %c\n", player2.version, player2.seqNum, player2.command, player2.data);
-                        rc = sendto(sd, &player2, sizeof(player2), 0, (struct sockaddr *)serverAdd, fromLength);
+                        rc = send_datagram(sd, &player2, sizeof(player2), serverAdd);
 
                         timeout++;
                         continue;
@@ -190,7 +245,7 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
                 printf("Expected Sequence number is wrong...\n");
                 printf("Looking for next sequcence number...\n");
                 printf("Resend Version: %d , SeqNumber %d , Command %d, Data %c\n", player2.version, player2.seqNum, player2.command, player2.data);
-                rc = sendto(sd, &player2, sizeof(player2), 0, (struct sockaddr *)serverAdd, fromLength);
+                rc = send_datagram(sd, &player2, sizeof(player2), serverAdd);
                 WrongSeq = 1;
                 continue;
             }
@@ -221,7 +276,7 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
         /* the program is using 3 rows and 3 columns. We have to do some  */
         /* simple math to conver a 1-9 to the right row/column            */
         /******************************************************************/
-        row = (int)((choice - 1) / ROWS);
+        row = (int)((choice - 1) / COLUMNS);
         column = (choice - 1) % COLUMNS;
 
         /* first check to see if the row/column chosen is has a digit in it, if it */
@@ -237,7 +292,7 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
                 i = checkwin(board);
                 printf("Sending normally...\n");
                 printf("NormalSend Version: %d , SeqNumber %d , Command %d, Data %c\n", player2.version, player2.seqNum, player2.command, player2.data);
-                rc = sendto(sd, &player2, sizeof(player2), 0, (struct sockaddr *)serverAdd, fromLength);
+                rc = send_datagram(sd, &player2, sizeof(player2), serverAdd);
                 timeout = 0;
                 if (rc < 0)
                 {
@@ -286,7 +341,7 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
                 for (b = 0; b != 3 && gameover == 0; b++)
                 {
                     printf("GameOverSend Version: %d , SeqNumber %d , Command %d, Data %c\n", player2.version, player2.seqNum, player2.command, player2.data);
-                    rc = sendto(sd, &player2, sizeof(player2), 0, (struct sockaddr *)serverAdd, fromLength);
+                    rc = send_datagram(sd, &player2, sizeof(player2), serverAdd);
                     if (rc < 0)
                     {
                         printf("%d\n", rc);
@@ -296,7 +351,7 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
                         exit(1);
                     }
                     set_timeout(sd, 60);
-                    rc = recvfrom(sd, &player1, sizeof(player1), 0, (struct sockaddr *)serverAdd, &fromLength);
+                    rc = recv_datagram(sd, &player1, sizeof(player1), serverAdd);
                     if (rc <= 0)
                     {
                         if ((errno == EAGAIN || errno == EWOULDBLOCK))
@@ -328,7 +383,7 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
                 {
                     printf("Waiting for player 1 to issue a GAME_OVER command...\n");
                     set_timeout(sd, 30);   // sets timeout
-                    rc = recvfrom(sd, &player1, sizeof(player1), 0, (struct sockaddr *)serverAdd, &fromLength); 
+                    rc = recv_datagram(sd, &player1, sizeof(player1), serverAdd); 
                     printf("Player 1 version: %d , SeqNum: %d , Command: %d , Data: %c GameNumber %d \n", player1.version, player1.seqNum, player1.command, player1.data, player1.gameNumber);
                    
                     if (rc <= 0)
@@ -342,7 +397,7 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
                                 printf("Client hasnt gotten a move back from the sever in a while...\n");
                                 printf("Resending recent datagram..\n");
                                 printf("Resend Version: %d , SeqNumber %d , Command %d, Data %c\n", player2.version, player2.seqNum, player2.command, player2.data);
-                                rc = sendto(sd, &player2, sizeof(player2), 0, (struct sockaddr *)serverAdd, fromLength);
+                                rc = send_datagram(sd, &player2, sizeof(player2), serverAdd);
                                 continue;
                             }
                             else
@@ -360,7 +415,7 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
                     {
                         printf("ERROR: DIDNT GET GAME_OVER RESENDING BEFORE GAME OVER\n");
                         printf("Resend Version: %d , SeqNumber %d , Command %d, Data %c\n", player2.version, player2.seqNum, player2.command, player2.data);
-                        rc = sendto(sd, &player2, sizeof(player2), 0, (struct sockaddr *)serverAdd, fromLength);
+                        rc = send_datagram(sd, &player2, sizeof(player2), serverAdd);
                     }
                     else if (player1.command == 2)
                     {
@@ -387,37 +442,17 @@ int tictactoe(char board[ROWS][COLUMNS], int sd, struct sockaddr_in *serverAdd)
 int checkwin(char board[ROWS][COLUMNS])
 {
     /************************************************************************/
-    /* brute force check to see if someone won, or if there is a draw       */
-    /* return a 0 if the game is 'over' and return -1 if game should go on  */
+    /* check each player's bitboard to see if someone won, or if there is a */
+    /* draw: return a 0 if the game is 'over' and return -1 if game should  */
+    /* go on                                                                */
     /************************************************************************/
-    if (board[0][0] == board[0][1] && board[0][1] == board[0][2]) // row matches
-        return 1;
-
-    else if (board[1][0] == board[1][1] && board[1][1] == board[1][2]) // row matches
-        return 1;
-
-    else if (board[2][0] == board[2][1] && board[2][1] == board[2][2]) // row matches
-        return 1;
+    const char *squares = &board[0][0];
+    uint32_t xBits = ttt_bits(squares, 'X'), oBits = ttt_bits(squares, 'O');
 
-    else if (board[0][0] == board[1][0] && board[1][0] == board[2][0]) // column
+    if (ttt_win(xBits) || ttt_win(oBits)) // row, column or diagonal matches
         return 1;
 
-    else if (board[0][1] == board[1][1] && board[1][1] == board[2][1]) // column
-        return 1;
-
-    else if (board[0][2] == board[1][2] && board[1][2] == board[2][2]) // column
-        return 1;
-
-    else if (board[0][0] == board[1][1] && board[1][1] == board[2][2]) // diagonal
-        return 1;
-
-    else if (board[2][0] == board[1][1] && board[1][1] == board[0][2]) // diagonal
-        return 1;
-
-    else if (board[0][0] != '1' && board[0][1] != '2' && board[0][2] != '3' &&
-             board[1][0] != '4' && board[1][1] != '5' && board[1][2] != '6' &&
-             board[2][0] != '7' && board[2][1] != '8' && board[2][2] != '9')
-
+    else if (ttt_full(xBits | oBits))
         return 0; // Return of 0 means game over
     else
         return -1; // return of -1 means keep playing
@@ -426,40 +461,21 @@ int checkwin(char board[ROWS][COLUMNS])
 void print_board(char board[ROWS][COLUMNS])
 {
     /*****************************************************************/
-    /* brute force print out the board and all the squares/values    */
+    /* print out the board and all the squares/values                */
     /*****************************************************************/
 
     printf("\n\n\n\tCurrent TicTacToe Game\n\n");
 
     printf("Player 1 (X)  -  Player 2 (O)\n\n\n");
 
-    printf("     |     |     \n");
-    printf("  %c  |  %c  |  %c \n", board[0][0], board[0][1], board[0][2]);
-
-    printf("_____|_____|_____\n");
-    printf("     |     |     \n");
-
-    printf("  %c  |  %c  |  %c \n", board[1][0], board[1][1], board[1][2]);
-
-    printf("_____|_____|_____\n");
-    printf("     |     |     \n");
-
-    printf("  %c  |  %c  |  %c \n", board[2][0], board[2][1], board[2][2]);
-
-    printf("     |     |     \n\n");
+    ttt_print(&board[0][0]);
 }
 
 int initSharedState(char board[ROWS][COLUMNS])
 {
     /* this just initializing the shared state aka the board */
-    int i, j, count = 1;
     printf("in sharedstate area\n");
-    for (i = 0; i < 3; i++)
-        for (j = 0; j < 3; j++)
-        {
-            board[i][j] = count + '0';
-            count++;
-        }
+    ttt_init(&board[0][0]);
 
     return 0;
 }
@@ -472,9 +488,9 @@ struct buffer P2choice(struct buffer player2)
     scanf("%d", &input);                   //using scanf to get the choice
     while (getchar() != '\n')
         ;
-    while (input < 1 || input > 9) //makes sure the input is between 1-9
+    while (input < 1 || input > ROWS * COLUMNS) //makes sure the input is a square on the board
     {
-        printf("Invalid input choose a number between 1-9.\n");
+        printf("Invalid input choose a number between 1-%d.\n", ROWS * COLUMNS);
         printf("Player 2, enter a number:  "); // player 2 picks a spot
 
         scanf("%d", &input);
@@ -491,6 +507,12 @@ struct buffer P2choice(struct buffer player2)
 void set_timeout(int sd, int second)
 {
     struct timeval time;
+    // shared memory receives wait on the eventfd instead
+    if (channel != NULL)
+    {
+        shmTimeout = second;
+        return;
+    }
     time.tv_sec = second;
     time.tv_usec = 0;
     if (setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &time, sizeof(time)) < 0)
@@ -500,3 +522,69 @@ void set_timeout(int sd, int second)
         exit(1);
     }
 }
+/* Connects to a server on the same host and maps the shared-memory channel it hands over */
+void shm_connect(const char *path)
+{
+    int conn, fds[3] = {-1, -1, -1};
+    char control[CMSG_SPACE(sizeof(fds))] = {0}, hello;
+    struct iovec iov = {&hello, sizeof(hello)};
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    struct sockaddr_un shmAddr = {0};
+    shmAddr.sun_family = AF_UNIX;
+    strncpy(shmAddr.sun_path, path, sizeof(shmAddr.sun_path) - 1);
+    conn = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (conn < 0 || connect(conn, (struct sockaddr *)&shmAddr, sizeof(shmAddr)) < 0)
+    {
+        perror("error connecting to the shared memory socket");
+        exit(1);
+    }
+    // receives the memfd holding the rings and both eventfds
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(conn, &msg, 0) != sizeof(hello) || (cmsg = CMSG_FIRSTHDR(&msg)) == NULL || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+        printf("Server did not hand over a shared memory channel\n");
+        exit(1);
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    channel = mmap(NULL, sizeof(struct Shm_Channel), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    if (channel == MAP_FAILED)
+    {
+        perror("error mapping the shared memory channel");
+        exit(1);
+    }
+    close(fds[0]);
+    serverEvent = fds[1];
+    clientEvent = fds[2];
+    // spinning only helps when the server runs on another CPU
+    shmSpins = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? SHM_SPINS : 0;
+    // the connection stays open so the server sees the client leave
+    printf("Using shared memory channel from %s\n", path);
+}
+/* Sends a datagram to the server through shared memory or the socket */
+int send_datagram(int sd, const void *data, size_t length, struct sockaddr_in *serverAdd)
+{
+    if (channel != NULL)
+    {
+        return shm_push(&channel->toServer, serverEvent, data, length);
+    }
+    return sendto(sd, data, length, 0, (struct sockaddr *)serverAdd, sizeof(struct sockaddr_in));
+}
+/* Receives a datagram from the server through shared memory or the socket */
+int recv_datagram(int sd, void *data, size_t length, struct sockaddr_in *serverAdd)
+{
+    socklen_t fromLength = sizeof(struct sockaddr_in);
+    if (channel != NULL)
+    {
+        if (!shm_wait(&channel->toClient, clientEvent, shmSpins, (shmTimeout < 0) ? -1 : shmTimeout * 1000))
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        return shm_pop(&channel->toClient, data, length);
+    }
+    return recvfrom(sd, data, length, 0, (struct sockaddr *)serverAdd, &fromLength);
+}
@@ -0,0 +1,79 @@
+/***********************************************************/
+/* Game history log written by the TicTacToe server (-H)   */
+/* and read by tictactoeStats. The log is a directory of   */
+/* numbered segment files, each a header followed by one   */
+/* length-prefixed record per finished game, appended in   */
+/* the order the games ended. A segment being written is   */
+/* padded with zeros (a zero length ends it), and is cut   */
+/* to the bytes written once the next segment is started.  */
+/***********************************************************/
+
+#ifndef TICTACTOE_HISTORY_H
+#define TICTACTOE_HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* The magic number identifying a game history segment. */
+#define HISTORY_MAGIC "TTTHIST2"
+/* The name of each segment in the history directory, by its number. */
+#define HISTORY_SEGMENT_NAME "history-%06u.seg"
+/* The most moves a record can hold (an Ultimate TicTacToe game). */
+#define HISTORY_MAX_MOVES 81
+/* The types of game a record can be for. */
+#define HISTORY_CLASSIC 0       // a game on the board the server was built for (see the segment header)
+#define HISTORY_ULTIMATE 1      // Ultimate TicTacToe
+/* The outcomes of a recorded game. */
+#define HISTORY_DRAW 0          // nobody won
+#define HISTORY_P1_WIN 1        // the server won
+#define HISTORY_P2_WIN 2        // the remote player won
+#define HISTORY_ABANDONED 3     // the game ended before it was over (timeout, bad move or player leaving)
+
+/* Structure for the header of a game history segment. */
+struct History_Segment {
+    char magic[8];          // HISTORY_MAGIC
+    uint32_t rows;          // number of rows of the server's classic board
+    uint32_t columns;       // number of columns of the server's classic board
+    uint32_t inARow;        // number of marks in a row needed to win a classic game
+    uint32_t reserved;      // unused (keeps the records 8-byte aligned)
+};
+
+/* Structure for the fixed part of a game record, followed by its moves. */
+struct History_Record {
+    uint32_t length;        // number of bytes in the record (this header and its moves)
+    uint8_t type;           // HISTORY_CLASSIC or HISTORY_ULTIMATE
+    uint8_t outcome;        // HISTORY_DRAW, HISTORY_P1_WIN, HISTORY_P2_WIN or HISTORY_ABANDONED
+    uint8_t numMoves;       // number of moves following the header
+    uint8_t resends;        // number of commands the server resent in the game
+    uint32_t address;       // IPv4 address of Player 2 (network byte order)
+    uint16_t port;          // port of Player 2 (network byte order)
+    uint16_t timeouts;      // number of times the game timed out waiting for Player 2
+    int64_t start;          // microseconds since the epoch the game started at
+    int64_t end;            // microseconds since the epoch the game ended at
+};
+
+/* Structure for a move of a game record, Player 1's first and alternating from there. */
+struct History_Move {
+    uint8_t square;         // square played (from 1)
+    uint8_t reserved[3];    // unused (keeps the time 4-byte aligned)
+    uint32_t micros;        // microseconds since the previous move (or the start of the game), at most 2^32-1
+};
+
+/**
+ * @brief Finds the next record of a segment, checking that it lies within the segment.
+ *
+ * @param segment The mapped segment.
+ * @param size The number of bytes in the segment.
+ * @param offset The offset of the record, updated to the offset of the record after it.
+ * @return The record, or NULL at the end of the segment (or at a record cut short by a crash).
+ */
+static inline const struct History_Record *history_next(const char *segment, size_t size, size_t *offset) {
+    const struct History_Record *record = (const struct History_Record *)(segment + *offset);
+    if (*offset + sizeof(struct History_Record) > size || record->length < sizeof(struct History_Record)
+        || record->length != sizeof(struct History_Record) + record->numMoves * sizeof(struct History_Move)
+        || *offset + record->length > size) return NULL;
+    *offset += record->length;
+    return record;
+}
+
+#endif
@@ -5,19 +5,51 @@
 /***********************************************************/
 
 /* #include files go here */
+#define _GNU_SOURCE     // for sched_setaffinity() and the CPU_SET macros
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <time.h>
+#include <signal.h>
 #include <string.h>
+#include <limits.h>
 #include <strings.h>
+#include <math.h>
 #include <netdb.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sched.h>
+#include <pthread.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/sock_diag.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include "tictactoeShm.h"
+#include "tictactoeBoard.h"
+#include "tictactoeSolved.h"
+#include "tictactoeHistory.h"
+#ifdef USE_IO_URING
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#ifdef SIMULATION
+#include <stdarg.h>
+
+/* Server output is only printed when a simulation is traced (or reports its results). */
+int sim_printf(const char *format, ...);
+#define printf sim_printf
+#endif
 
 /*************************/
 /* ENVIRONMENT CONSTANTS */
@@ -26,8 +58,10 @@
 /* The protocol version number used. */
 #define VERSION 4
 
-/* The number of command line arguments. */
+/* The number of positional command line arguments (including the program name). */
 #define NUM_ARGS 2
+/* The command line options accepted by the server. */
+#define OPTIONS "f:u:cip:y:m:w:t:PT:s:H:r:S:N:Ub:"
 /* The maximum size of a buffer for the program. */
 #define BUFFER_SIZE 100
 /* The error code used to signal an invalid move. */
@@ -39,17 +73,210 @@
 /* The number of seconds spend waiting before the server times out. */
 #define SERVER_TIMEOUT (GAME_TIMEOUT/2)
 
-/* The number of rows for the TicIacToe board. */
+/* The number of rows for the TicIacToe board (the geometry can be overridden when building). */
+#ifndef ROWS
 #define ROWS 3
+#endif
 /* The number of columns for the TicIacToe board. */
+#ifndef COLUMNS
 #define COLUMNS 3
-/* The maximum number of games the server can play simultaneously. */
-#define MAX_GAMES 10
+#endif
+/* The number of marks in a row needed to win. */
+#ifndef IN_A_ROW
+#define IN_A_ROW 3
+#endif
+/* The maximum number of games the server can play simultaneously (at most 127, the game number is a char). */
+#define MAX_GAMES 40
+/* The number of seconds the resends made when the server times out are spread across. */
+#define RESEND_SPREAD 2.0
+/* The number of seconds of random jitter added to a resend (doubled for each resend already made in the game). */
+#define RESEND_JITTER 0.1
+/* The minimum number of seconds between resends to the same IP address. */
+#define RESEND_GAP 0.05
+/* The number of seconds ahead a resend can be sent early, to go out in the same batch as others. */
+#define RESEND_COALESCE 0.01
+/* The maximum number of resends sent in one batch. */
+#define RESEND_BATCH 8
+/* The maximum number of finished games kept waiting out their grace period (a tombstone is a
+ * twelfth the size of a game, so these add a third to the roster's memory, and the two together
+ * take about five times the memory of the 10 game slots the roster had before tombstones). */
+#define MAX_TOMBSTONES (4 * MAX_GAMES)
+/* The default number of search worker threads that compute the server's moves. */
+#define SEARCH_THREADS 2
+/* The maximum number of search worker threads. */
+#define MAX_SEARCH_THREADS 16
+/* The number of searches each queue of the search pool holds (one per game at most). */
+#define SEARCH_QUEUE_SIZE MAX_GAMES
+/* The number of positions remembered by the searches of each thread (must be a power of 2). */
+#define POSITION_TABLE_SIZE 4096
+/* The number of slots probed for a position before giving up on remembering it. */
+#define POSITION_PROBES 8
+/* The number of positions in the transposition table shared by the threads of parallel searches
+ * (must be a power of 2). */
+#define SHARED_TABLE_SIZE (1 << 21)
+/* The number of positions in the move cache shared by every game and thread (must be a power of 2). */
+#define MOVE_CACHE_SIZE (1 << 16)
+/* The number of slots in each bucket of the move cache (one cache line), the slots a position can be kept in. */
+#define MOVE_CACHE_WAYS 8
+/* A move cache slot: the canonical position plus one (so an empty slot is 0), the best square, and
+ * the reference bit set when the slot is used and cleared as the clock hand passes it. */
+#define CACHE_SLOT(key, move) (((uint64_t)(key) + 1) << 8 | (uint64_t)(move) << 1)
+#define CACHE_KEY(slot) (((slot) >> 8) - 1)
+#define CACHE_MOVE(slot) ((int)((slot) >> 1 & 0x7F))
+#define CACHE_REFERENCED 1ull
+/* The largest number of tasks a parallel search is split into (a move and a reply per task). */
+#define MAX_SEARCH_TASKS (ROWS*COLUMNS * ROWS*COLUMNS)
+/* The types of game a player can ask for with NEW_GAME. */
+#define GAME_CLASSIC 0          // a game on the server's board
+#define GAME_ULTIMATE 1         // Ultimate TicTacToe, a 3x3 board of 3x3 boards
+/* The NEW_GAME data asking for a game of Ultimate TicTacToe (any other data asks for a classic game). */
+#define ULTIMATE_REQUEST 'U'
+/* The number of squares of an Ultimate TicTacToe game (9 boards of 9 squares). */
+#define ULTIMATE_SQUARES 81
+/* The default number of seconds the server spends searching each Ultimate TicTacToe move (-T). */
+#define ULTIMATE_BUDGET 0.1
+/* The number of nodes in the Monte Carlo search tree of each game, node 0 unused. */
+#define MCTS_NODES (1 << 17)
+/* The number of playouts through a node before its moves are added to the tree. */
+#define MCTS_EXPAND_VISITS 2
+/* The weight of exploration against the win rate when selecting a move in the tree (UCT). */
+#define MCTS_EXPLORATION 1.0
+/* The number of playouts a thread runs between checks of the clock. */
+#define MCTS_CHECK_INTERVAL 32
+/* The most playouts run for one move, whatever the time budget (the simulated clock stands still). */
+#define MCTS_MAX_PLAYOUTS 200000
 /* The baord marker used for Player 1 */
 #define P1_MARK 'X'
 /* The baord marker used for Player 2 */
 #define P2_MARK 'O'
 
+/* The magic bytes identifying a game roster file. */
+#define ROSTER_MAGIC "TTTROSTR"
+/* The layout version of the game roster file, bumped whenever struct TTT_Game changes. */
+#define ROSTER_VERSION 3
+/* The number of milliseconds the old server waits for the new server to acknowledge a handoff. */
+#define HANDOFF_TIMEOUT 1000
+/* The number of bytes each game history segment is mapped with before the next one is started. */
+#define HISTORY_SEGMENT_SIZE (64 << 20)
+
+/* The number of source addresses tracked by the rate limiter (must be a power of 2). */
+#define RATE_TABLE_SIZE 1024
+/* The number of rate limiter slots probed for a source address before one is evicted. */
+#define RATE_PROBES 8
+/* The number of seconds a source address can go unseen before its rate limiter slot is reused. */
+#define RATE_MAX_AGE (2 * GAME_TIMEOUT)
+/* The default number of commands per second a source address is allowed to send (the other limits scale with it). */
+#define COMMAND_RATE 10.0
+/* The number of commands a source address can send in a burst (a whole game of Ultimate TicTacToe at full speed). */
+#define COMMAND_BURST 50.0
+/* The number of NEW_GAME commands per second a source address is allowed to send. */
+#define NEW_GAME_RATE 0.2
+/* The number of NEW_GAME commands a source address can send in a burst. */
+#define NEW_GAME_BURST 3.0
+
+/* The number of bytes in a NEW_GAME handshake cookie. */
+#define COOKIE_SIZE 8
+/* The number of seconds in each time window a handshake cookie is issued for. */
+#define COOKIE_WINDOW 30
+/* The number of bytes of ancillary data (receive timestamp and drop counter) read with each datagram. */
+#define RECV_CONTROL_SIZE (CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t)))
+/* The number of power-of-two microsecond buckets in the queueing delay histogram. */
+#define DELAY_BUCKETS 20
+/* The maximum number of bytes the server socket receive buffer is grown to when datagrams are dropped. */
+#define MAX_RCVBUF (16 * 1024 * 1024)
+/* The number of received commands each priority class of the command scheduler holds. */
+#define SCHEDULE_QUEUE_SIZE 64
+/* The number of seconds a NEW_GAME can wait to be handled before it is shed (the player resends it). */
+#define SHED_DELAY 0.5
+/* The priority classes of the command scheduler, highest first. */
+#define PRIORITY_LIVE 0         // commands for games being played, and resends answered from them
+#define PRIORITY_ADMISSION 1    // NEW_GAME commands that would start a game
+#define NUM_PRIORITIES 2
+/* The number of iterations run by the micro-benchmarks. */
+#define BENCH_ITERATIONS 1000000
+/* The number of datagrams sent per round trip by the I/O benchmarks. */
+#define BENCH_BATCH 32
+
+/* The number of seconds between game timer checks while the server busy-polls its socket. */
+#define BUSY_TIMER_INTERVAL 0.1
+/* The number of round trips timed by the latency benchmark. */
+#define BENCH_ROUND_TRIPS 20000
+
+/* The number of datagrams each queue of an in-memory transport holds (must be a power of 2). */
+#define MEMORY_QUEUE_SIZE 64
+/* The number of games played by the engine benchmark. */
+#define BENCH_GAMES 200
+/* The number of positions classified by each pass of the classify benchmark (a multiple of 32). */
+#define BENCH_POSITIONS 4096
+/* The number of passes over the positions made by the classify benchmark. */
+#define BENCH_REPEATS 2000
+/* The number of games played by each thread of the self-play mode unless -N is given. */
+#define SELF_PLAY_GAMES 1000
+/* The opponents the self-play mode can play against (-S). */
+#define SELF_PLAY_RANDOM 1      // plays a random legal move
+#define SELF_PLAY_SCRIPTED 2    // plays the first legal square
+#define SELF_PLAY_SELF 3        // searches its moves like the server
+/* The number of Ultimate TicTacToe games played by the ultimate benchmark. */
+#define BENCH_ULTIMATE_GAMES 5
+/* The maximum number of co-located clients connected through shared memory at once. */
+#define SHM_MAX_CLIENTS 16
+/* The number of commands taken from shared memory before the UDP socket is checked again. */
+#define SHM_UDP_INTERVAL 8
+
+/* The number of messages each queue between the stages of a pipelined server holds (must be a power of 2). */
+#define PIPELINE_QUEUE_SIZE 1024
+/* The maximum number of replies the send stage of a pipelined server sends with one system call. */
+#define PIPELINE_BATCH 32
+/* The number of players loading the server at once in the pipeline benchmark (fewer than MAX_GAMES). */
+#define BENCH_PLAYERS 8
+/* The number of seconds each run of the pipeline benchmark lasts. */
+#define BENCH_SECONDS 3
+
+/* The default number of simulated players playing at once. */
+#define SIM_PLAYERS 10
+/* The number of seconds a simulated datagram takes to be delivered (before jitter). */
+#define SIM_LATENCY 0.01
+/* The maximum number of seconds of jitter added to each simulated datagram. */
+#define SIM_JITTER 0.005
+/* The maximum number of seconds a reordered simulated datagram is held back. */
+#define SIM_REORDER_DELAY 0.1
+/* The maximum number of seconds a simulated player waits before starting its next game. */
+#define SIM_THINK_TIME 1.0
+/* The number of seconds a simulated player waits for the server's move (as the client does). */
+#define SIM_MOVE_TIMEOUT 30
+/* The number of seconds a simulated player waits after sending GAME_OVER (as the client does). */
+#define SIM_GAME_OVER_TIMEOUT 60
+/* The number of timeouts (or resends) after which a simulated player gives up (as the client does). */
+#define SIM_MAX_TRIES 3
+/* The port of the first simulated player (each player uses the port after the previous one). */
+#define SIM_PORT_BASE 10000
+/* The states of a simulated player. */
+#define SIM_IDLE 0              // between games
+#define SIM_AWAIT_MOVE 1        // waiting for the server's move
+#define SIM_AWAIT_ACK 2         // sent GAME_OVER, waiting to see if the server resends its move
+#define SIM_AWAIT_GAME_OVER 3   // made the last move, waiting for the server's GAME_OVER
+#define SIM_RETIRED 4           // played its share of the games
+/* The kinds of simulation events. */
+#define SIM_TO_SERVER 0         // datagram delivered to the server
+#define SIM_TO_PLAYER 1         // datagram delivered to a player
+#define SIM_TIMER 2             // player timer expires
+
+/* The number of submission queue entries in the io_uring. */
+#define URING_ENTRIES 256
+/* The number of buffers in the io_uring receive buffer ring (must be a power of 2). */
+#define URING_BUFFERS 256
+/* The size of each io_uring receive buffer (header, sender address and datagram). */
+#define URING_BUFFER_SIZE 128
+/* The number of replies that can be in flight through the io_uring at once. */
+#define URING_SEND_SLOTS 64
+/* The ID of the io_uring receive buffer group. */
+#define URING_BGID 1
+/* The tags (upper 32 bits of user_data) identifying io_uring completions. */
+#define URING_RECV_TAG 1ull
+#define URING_TIMEOUT_TAG 2ull
+#define URING_UPDATE_TAG 3ull
+#define URING_SEND_TAG 4ull
+
 /**************************/
 /* ENVIRONMENT STRUCTURES */
 /**************************/
@@ -63,6 +290,23 @@ struct Buffer {
     char gameNum;   // game number
 };
 
+/* Structure to send and recieve NEW_GAME datagrams carrying a handshake cookie. */
+struct Cookie_Buffer {
+    struct Buffer command;              // NEW_GAME command
+    unsigned char cookie[COOKIE_SIZE];  // cookie proving the player can receive at their address
+};
+
+/* Structure for the state of a game of Ultimate TicTacToe. Square s (from 0) is square s%9 of
+ * small board s/9, each numbered like the squares of a classic board. */
+struct Ultimate_State {
+    uint16_t squares[2][9];     // squares of each small board held by each player
+    uint16_t won[2];            // small boards won by each player
+    uint16_t closed;            // small boards won or full
+    int8_t next;                // small board the next move must be played on, -1 if any open board
+    int8_t toMove;              // player to move (0 for Player 1, 1 for Player 2)
+    int8_t result;              // -1 while playing, the winning player (0 or 1), or 2 for a draw
+};
+
 /* Structure for each game of TicTacToe. */
 struct TTT_Game {
     int gameNum;                    // game number
@@ -73,15 +317,545 @@ struct TTT_Game {
     int winner;                     // player who won, 0 if draw, -1 if game not over
     struct Buffer lastSent;         // the previous command that was sent in the game
     char board[ROWS*COLUMNS];       // TicTacToe game board state
+    int type;                       // GAME_CLASSIC or GAME_ULTIMATE
+    struct Ultimate_State ultimate; // Ultimate TicTacToe game state (GAME_ULTIMATE only)
+    int64_t started;                // microseconds since the epoch the game started at (for the game history)
+    double lastMoved;               // time the last move was played (or the game started)
+    int numMoves;                   // number of moves played in the game
+    int numResends;                 // number of commands resent in the game
+    int numTimeouts;                // number of times the game timed out waiting for the remote player
+    struct History_Move moves[HISTORY_MAX_MOVES];   // the moves played in the game, in order
+    uint32_t checksum;              // checksum of the record, used to detect torn writes
+};
+
+/* Structure for a finished game waiting out its grace period after GAME_OVER was sent. */
+struct TTT_Tombstone {
+    struct sockaddr_in p2Address;   // address of remote player for game, blank if unused
+    int winner;                     // player who won, 0 if draw
+    double timeout;                 // amount of time left in the grace period
+    struct Buffer gameOver;         // the GAME_OVER command sent (with game number and final sequence number)
+};
+
+/* Structure for the header at the start of a game roster file. */
+struct Roster_Header {
+    char magic[8];          // file identifier (ROSTER_MAGIC)
+    uint32_t version;       // layout version of the file (ROSTER_VERSION)
+    uint32_t numGames;      // number of game records in the file
+    uint32_t gameSize;      // size of each game record in bytes
+    uint32_t reserved;      // unused, keeps the game records 8-byte aligned
+};
+
+/* Structure for the memory-mapped game roster (a versioned header followed by the games). */
+struct Game_Roster {
+    struct Roster_Header header;    // header describing the layout of the roster
+    struct TTT_Game games[MAX_GAMES];   // the array of playable TicTacToe games
+};
+
+/* Structure for the game history log the server appends each game it finishes to. */
+struct History_Log {
+    const char *dir;        // directory the segments are written in
+    int fd;                 // file descriptor of the segment being written, -1 if none
+    char *segment;          // the segment being written, NULL if games aren't recorded
+    size_t used;            // number of bytes written to the segment
+    unsigned number;        // number of the segment being written
+    unsigned segments;      // number of segments started
+    unsigned long records;  // number of games recorded
+    unsigned long bytes;    // number of bytes of records written
+};
+
+/* Structure for a thread of the self-play mode, playing games against the chosen opponent. */
+struct Self_Player {
+    pthread_t thread;               // the thread playing the games
+    int index;                      // index of the thread (its games are numbered after it)
+    unsigned seed;                  // state of the random opponent's generator
+    struct TTT_Game game;           // the game played by the server
+    struct TTT_Game mirror;         // the game seen from Player 2's side, searched by the self opponent
+    unsigned long moves;            // number of moves played by both players
+    unsigned long results[4];       // number of games by outcome (draw, Player 1 win, Player 2 win, abandoned)
+    double *latencies;              // number of seconds the server took to answer each command
+    int numLatencies;               // number of commands answered
+};
+
+/* Structure for the token buckets of a source address tracked by the rate limiter. */
+struct Rate_Entry {
+    in_addr_t addr;         // IP address of the source, 0 if the slot is unused
+    float tokens;           // number of commands the source can currently send
+    float newGameTokens;    // number of NEW_GAME commands the source can currently send
+    double lastSeen;        // time the source last sent a command
+};
+
+/* Structure for the resends scheduled by the server, paced and sent in batches. */
+struct Resend_Schedule {
+    double due[MAX_GAMES];          // time each game's resend is due, 0 if none is scheduled
+    int seqNum[MAX_GAMES];          // sequence number of each game when its resend was scheduled
+    double lastSent[MAX_GAMES];     // time a resend was last sent in each game
+    double windowStart;             // start of the current one second resend rate window
+    int windowCount;                // number of resends sent in the current window
+    unsigned seed;                  // state of the jitter generator
+};
+
+/* Structure for a received command waiting in the command scheduler. */
+struct Scheduled_Command {
+    struct sockaddr_in playerAddr;      // address of the remote player
+    struct Buffer datagram;             // the command
+    unsigned char cookie[COOKIE_SIZE];  // handshake cookie that may follow a NEW_GAME command
+    int length;                         // number of bytes received for the command
+    double arrived;                     // time the command arrived (when the kernel received it, if known)
+};
+
+/* Structure for the received commands of a priority class waiting to be handled, in arrival order. */
+struct Command_Queue {
+    struct Scheduled_Command commands[SCHEDULE_QUEUE_SIZE]; // the commands
+    int head;                           // position of the oldest command
+    int count;                          // number of commands waiting
+};
+
+/* Structure for the counters describing the commands handled by the server. */
+struct Server_Stats {
+    unsigned long received;         // number of datagrams received
+    unsigned long dropped;          // number of datagrams discarded as invalid
+    unsigned long limited;          // number of commands rejected by the rate limiter
+    unsigned long newGamesLimited;  // number of those that were NEW_GAME commands
+    unsigned long evictions;        // number of active sources evicted from the rate limiter
+    unsigned long kernelDrops;      // number of datagrams dropped by the kernel (receive buffer full)
+    unsigned long kernelDropsBase;  // drops the kernel had counted on a taken over socket before this server
+    unsigned long queueDelay[DELAY_BUCKETS];    // histogram of time datagrams waited in the socket queue
+    int rcvbuf;                     // current size of the server socket receive buffer in bytes
+    unsigned long searches;         // number of moves searched by the search thread pool
+    int searchQueueMax;             // largest number of searches waiting for a worker at once
+    double searchWait;              // total seconds searches waited for a worker
+    double searchWaitMax;           // longest a search waited for a worker in seconds
+    unsigned long shed;             // number of NEW_GAME commands shed because the server fell behind
+    int scheduledMax[NUM_PRIORITIES];   // largest number of commands waiting in each priority class at once
+    unsigned long resends;          // number of commands resent
+    unsigned long resendBatches;    // number of batches the resends were sent in
+    int resendBurstMax;             // largest number of resends sent in one batch
+    int resendRateMax;              // largest number of resends sent in a one second window
+    unsigned long resendsDeferred;  // number of times a resend was deferred to pace its destination
+    unsigned long solvedMoves;      // number of moves answered from the solved-position database
+    unsigned long solvedMisses;     // number of moves searched because the database lacked the position
+    unsigned long ultimateMoves;    // number of Ultimate TicTacToe moves searched
+    unsigned long ultimatePlayouts; // number of playouts run by those searches
+    unsigned long ultimateReused;   // number of those playouts kept from the trees of earlier moves
+};
+
+#ifdef USE_IO_URING
+/* Structure for a reply queued to be sent through the io_uring. */
+struct Uring_Send {
+    struct msghdr msg;              // message header referenced by the SQE
+    struct iovec iov;               // vector pointing at the datagram
+    struct sockaddr_in addr;        // address to send the datagram to
+    char data[URING_BUFFER_SIZE];   // copy of the datagram
+    int busy;                       // whether the reply is still in flight
+};
+
+/* Structure for the io_uring I/O backend of the server socket. */
+struct Uring_Backend {
+    int fd;                             // io_uring file descriptor
+    int sd;                             // socket descriptor of the server comminication endpoint
+    unsigned *sqHead, *sqTail, *sqArray, sqMask, sqEntries;    // submission queue ring
+    unsigned sqPending;                 // tail of the submission queue including unpublished SQEs
+    unsigned toSubmit;                  // number of SQEs not yet submitted
+    struct io_uring_sqe *sqes;          // submission queue entries
+    unsigned *cqHead, *cqTail, cqMask;  // completion queue ring
+    struct io_uring_cqe *cqes;          // completion queue entries
+    struct io_uring_buf_ring *bufRing;  // ring of buffers provided for multishot receives
+    unsigned short bufTail;             // tail of the buffer ring
+    char buffers[URING_BUFFERS][URING_BUFFER_SIZE];  // the receive buffers
+    struct msghdr recvTemplate;         // layout of each received buffer (address length)
+    struct __kernel_timespec timeout;   // server timeout
+    int recvArmed;                      // whether the multishot receive is armed
+    int timeoutArmed;                   // whether the server timeout is armed
+    int timeoutStale;                   // whether a datagram arrived since the timeout was armed
+    double lastReceived;                // time the last datagram was received
+    struct io_uring_sqe *lastSend;      // most recently queued reply SQE that is unsubmitted
+    struct sockaddr_in lastSendAddr;    // destination of that reply
+    int nextSend;                       // next send slot to try
+    struct Uring_Send sends[URING_SEND_SLOTS];  // replies in flight
+    unsigned long enters;               // number of io_uring_enter() system calls made
+};
+#endif
+
+/* Structure for a transport carrying commands between the server and the remote players. The
+ * game logic only ever sends and receives through a transport, never through a socket directly. */
+struct Transport {
+    const char *name;       // name of the transport, for messages
+    int sd;                 // socket descriptor the transport is polled on, -1 if it has none
+    int pace;               // whether resends are paced, the server waking up as each one comes due
+    int validated;          // whether the commands received were already validated before reaching the transport
+    void *state;            // state of the transport implementation
+    /* Sends a datagram to a remote player, returning the number of bytes sent or -1 on error */
+    int (*send)(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest);
+    /* Receives a datagram like recvmsg(), returning -1 with errno EAGAIN if the server timed out */
+    int (*receive)(struct Transport *transport, struct msghdr *msg);
+    /* Checks whether a datagram can be received without waiting, NULL if the transport can't tell */
+    int (*ready)(struct Transport *transport);
+    /* Waits up to the given seconds for a datagram like poll(), NULL if the transport is polled on its socket */
+    int (*wait)(struct Transport *transport, double timeout);
+};
+
+/* Structure for a datagram waiting in an in-memory transport queue. */
+struct Memory_Datagram {
+    struct sockaddr_in address;     // address of the remote player sending or receiving the datagram
+    size_t length;                  // number of bytes in the datagram
+    struct Cookie_Buffer datagram;  // the datagram
+};
+
+/* Structure for an in-memory transport, a pair of queues that the program embedding the server
+ * pushes commands into and pops replies from. */
+struct Memory_Transport {
+    struct Memory_Datagram inbox[MEMORY_QUEUE_SIZE];    // commands waiting for the server
+    struct Memory_Datagram outbox[MEMORY_QUEUE_SIZE];   // replies sent by the server
+    unsigned inHead, inTail;        // positions to receive and push the next command at
+    unsigned outHead, outTail;      // positions to pop and send the next reply at
+};
+
+/* Structure for a co-located client connected to the shared-memory transport. */
+struct Shm_Client {
+    struct Shm_Channel *channel;    // rings shared with the client, NULL if the slot is free
+    int conn;                       // UNIX connection to the client (hung up when the client exits)
+    int event;                      // eventfd the client sleeps on
+    struct sockaddr_in address;     // synthetic address (0.x.x.x) the client is known by in the games
+};
+
+/* Structure for a shared-memory transport, which carries the commands of co-located clients
+ * through rings in shared memory and those of remote players over the UDP socket. */
+struct Shm_Transport {
+    int listenSd;                   // UNIX socket co-located clients connect to
+    int event;                      // eventfd the server sleeps on (shared by all clients)
+    struct Shm_Client clients[SHM_MAX_CLIENTS];     // connected clients
+    unsigned next;                  // client whose ring is checked first on the next receive
+    unsigned sinceUdp;              // commands taken from shared memory since the socket was checked
+    unsigned long connections;      // number of clients accepted so far
+};
+
+/* Structure for a command or reply passed between the stages of a pipelined server. */
+struct Pipeline_Message {
+    struct sockaddr_in address;     // address of the remote player the datagram came from or goes to
+    int length;                     // number of bytes in the datagram
+    struct Cookie_Buffer datagram;  // the datagram
+};
+
+/* Structure for a slot of a pipeline queue. The sequence number tells producers and the consumer
+ * whose turn it is: the slot at position p is free for writing when it equals p, and holds a
+ * message for the consumer when it equals p+1. */
+struct Pipeline_Slot {
+    uint64_t sequence;                  // position the slot is next written (or read) at
+    struct Pipeline_Message message;    // the message
+};
+
+/* Structure for a bounded lock-free queue between pipeline stages, with any number of producers
+ * and a single consumer. The positions are kept on their own cache lines. */
+struct Pipeline_Queue {
+    _Alignas(64) uint64_t tail;     // next position to push at (claimed by producers)
+    _Alignas(64) uint64_t head;     // next position to pop at (only written by the consumer)
+    _Alignas(64) uint32_t sleeping; // whether the consumer is (about to be) asleep on the eventfd
+    unsigned maxOccupancy;          // most messages waiting in the queue at once
+    int event;                      // eventfd the consumer sleeps on
+    struct Pipeline_Slot slots[PIPELINE_QUEUE_SIZE];    // the messages
+};
+
+/* Structure for the counters of a pipeline stage. Each is only written by the stage's thread. */
+struct Pipeline_Stage {
+    const char *name;               // name of the stage, for the stats
+    int cpu;                        // CPU core the stage is pinned to, -1 if not pinned
+    struct Pipeline_Queue *input;   // queue the stage takes its work from, NULL for the socket
+    unsigned long processed;        // number of datagrams handled by the stage
+    unsigned long dropped;          // number of datagrams dropped (invalid, or the next queue was full)
+    double busy;                    // number of seconds spent working rather than waiting
+    double since;                   // time the stage last started working (game stage only)
+};
+
+/* Structure for a server split into receive, game and send stages on separate threads. */
+struct Pipeline {
+    int sd;                         // socket descriptor of the server comminication endpoint
+    double start;                   // time the pipeline started
+    struct Pipeline_Queue commands; // validated commands from the receive stage to the game stage
+    struct Pipeline_Queue replies;  // replies from the game stage to the send stage
+    struct Pipeline_Stage stages[3];    // receive, game and send stages
+};
+
+/* Structure for the players loading a server in the pipeline benchmark. */
+struct Bench_Load {
+    struct sockaddr_in server;      // address of the server under load
+    int leaveEarly;                 // whether players leave right after the server's first move
+    double deadline;                // time the players stop starting new games
+    unsigned long nextAddress;      // number of player addresses used so far
+    unsigned long games, commands, timeouts;    // games played, commands sent, and replies never received
+    unsigned long numSamples;       // number of reply times taken
+    double samples[BENCH_ROUND_TRIPS];  // times taken for the server to reply to a command
+};
+
+/* Structure for the optional server settings provided on the command line. */
+struct Server_Options {
+    const char *rosterFile;     // file backing the game roster, NULL if games aren't persisted
+    const char *upgradeSocket;  // UNIX socket used to hand the server off to a new binary, NULL if disabled
+    int cookies;                // whether NEW_GAME requires a handshake cookie before a game is allocated
+    int uring;                  // whether the server socket uses the io_uring backend
+    int busyPoll;               // whether the server spins on its socket instead of sleeping
+    int cpu;                    // CPU core the busy-polling server is pinned to, -1 if not pinned
+    int busyPollBudget;         // number of microseconds for SO_BUSY_POLL, 0 if not used
+    const char *shmSocket;      // UNIX socket co-located clients connect to for shared memory, NULL if disabled
+    int searchThreads;          // number of search worker threads, 0 to search moves inline (-1 for the default)
+    int splitThreads;           // number of threads each move search is split across, 1 to search on one thread
+    int pipeline;               // whether the server runs as a pipeline of receive, game and send stages
+    int ultimate;               // whether players may ask for Ultimate TicTacToe (its searches need search threads)
+    double moveBudget;          // number of seconds spent searching each Ultimate TicTacToe move
+    const char *solvedFile;     // solved-position database answering the server's moves, NULL if moves are searched
+    const char *historyDir;     // directory finished games are logged to, NULL if games aren't recorded
+    double commandRate;         // number of commands per second each source address is allowed, 0 if not limited
+    int selfPlay;               // opponent of the self-play mode (SELF_PLAY_RANDOM, ...), 0 to serve players
+    int selfPlayGames;          // number of games played by each self-play thread
+    int selfPlayThreads;        // number of threads playing games in the self-play mode
+    int selfPlayUltimate;       // whether the self-play games are Ultimate TicTacToe
+    const char *benchmark;      // name of the benchmark to run instead of the server, NULL if none
+};
+
+#ifdef SIMULATION
+/* Structure for a datagram delivery or player timer scheduled in the simulation. */
+struct Sim_Event {
+    double time;                    // virtual time the event happens at
+    unsigned long order;            // order the event was scheduled in (breaks ties deterministically)
+    int type;                       // SIM_TO_SERVER, SIM_TO_PLAYER or SIM_TIMER
+    int player;                     // index of the simulated player the event belongs to
+    unsigned timer;                 // generation of the player timer (stale timers are ignored)
+    struct sockaddr_in address;     // address of the player sending or receiving the datagram
+    size_t length;                  // number of bytes in the datagram
+    struct Cookie_Buffer datagram;  // the datagram being delivered
+};
+
+/* Structure for a simulated remote player, a state machine following tictactoeClient. */
+struct Sim_Player {
+    struct sockaddr_in address;     // address of the player for its current game
+    int state;                      // state of the player (SIM_IDLE, SIM_AWAIT_MOVE, ...)
+    int tries;                      // number of timeouts (or resends) in the current state
+    unsigned timer;                 // generation of the armed player timer
+    int seqNum;                     // sequence number of the last command sent
+    int gameNum;                    // game number assigned by the server, 0 if not known yet
+    int result;                     // winner of the game as seen by the player, -1 if not over
+    double started;                 // virtual time the current game was started
+    struct TTT_Game game;           // the player's copy of the game (only the board is used)
+    size_t lastLength;              // number of bytes in the last datagram sent
+    struct Cookie_Buffer lastSent;  // the last datagram sent, resent on timeouts
+};
+
+/* Structure for the settings, state and results of a simulation. */
+struct Simulation {
+    unsigned long games;        // number of games to play
+    int numPlayers;             // number of simulated players playing at once
+    unsigned long seed;         // seed of the random number generator
+    double loss;                // probability of a datagram being lost
+    double duplicate;           // probability of a datagram being duplicated
+    double reorder;             // probability of a datagram being held back (reordered)
+    int verbose;                // whether the server output is printed
+    uint64_t random;            // state of the random number generator
+    double clock;               // the virtual clock
+    double wallStart;           // wall clock time the simulation started at
+    struct Sim_Event *events;   // pending events (binary min-heap ordered by time)
+    size_t numEvents;           // number of pending events
+    size_t maxEvents;           // capacity of the event heap
+    unsigned long order;        // number of events scheduled so far
+    struct Sim_Player *players; // the simulated players
+    uint32_t nextHost;          // host part of the next player address handed out
+    unsigned long started, finished, abandoned, errors, retired;    // games and players by outcome
+    unsigned long results[3];   // finished games by winner (draw, Player 1, Player 2)
+    double gameTime;            // total virtual time taken by finished games
+    unsigned long sent, lost, duplicated, reordered, timeouts;  // datagram and timer counters
+};
+#endif
+
+/* Structure for the search of a move for Player 1, run by the search thread pool. */
+struct Search_Job {
+    struct TTT_Game game;   // copy of the game when the search was requested
+    double submitted;       // time the search was requested
+    double waited;          // number of seconds the search waited for a worker
+    int move;               // best move found by the search
+};
+
+/* Structure for the pool of worker threads searching moves while the server keeps receiving
+ * commands. Workers take jobs from one queue and put them on another once searched, waking the
+ * server through an eventfd. Each game has at most one search in flight. */
+struct Search_Pool {
+    pthread_t threads[MAX_SEARCH_THREADS];  // worker threads
+    int numThreads;                         // number of worker threads, 0 if moves are searched inline
+    int event;                              // eventfd signalled when a search finishes, -1 if no pool
+    pthread_mutex_t lock;                   // lock protecting both queues
+    pthread_cond_t jobReady;                // signalled when a search is queued
+    struct Search_Job jobs[SEARCH_QUEUE_SIZE];      // searches waiting for a worker
+    struct Search_Job results[SEARCH_QUEUE_SIZE];   // searches waiting for the server
+    unsigned jobHead, jobTail;              // positions to take and queue the next search at
+    unsigned resultHead, resultTail;        // positions to take and queue the next result at
+    int pending[MAX_GAMES];                 // whether each game has a search in flight (server thread only)
+};
+
+/* Structure for a position remembered by a search. */
+struct Position_Entry {
+    uint64_t key;   // both players' bitboards and the side to move, 0 if the slot is empty
+    int8_t value;   // minimax value of the position, counted from the position itself
+    int8_t move;    // best square (from 0) for the side to move, in the orientation of the key
+};
+
+/* Structure for a position in the transposition table shared by the threads of parallel searches.
+ * The check word is the key XORed with the data word, so an entry torn by two threads writing it
+ * at once no longer matches its key and is ignored, without any locks. */
+struct Shared_Position {
+    uint64_t check;     // key of the position XORed with the data
+    uint64_t data;      // minimax value (low byte) and best square (next byte) of the position
+};
+
+/* Structure for the positions remembered by the searches of one thread. Positions are stored
+ * under their canonical symmetry, so the rotations and reflections of a board share one entry. */
+struct Position_Table {
+    struct Position_Entry entries[POSITION_TABLE_SIZE];     // open-addressed slots
+    struct Shared_Position *shared;     // shared table used instead of the slots (parallel searches), NULL if not shared
+    int raw;                    // whether positions are stored as played instead (for benchmarks)
+    unsigned long lookups;      // number of positions looked up
+    unsigned long hits;         // number of positions found
+    unsigned long stored;       // number of positions remembered
+    unsigned long dropped;      // number of positions not remembered because their slots were taken
+};
+
+/* Structure for the cache of Player 1's best moves shared by every game and thread of the server,
+ * so a position is searched once per server rather than once per game or thread. Each slot packs
+ * a position, its move and a reference bit in one word, and full buckets evict with the CLOCK
+ * algorithm, sweeping a hand per bucket. */
+struct Move_Cache {
+    _Alignas(64) uint64_t slots[MOVE_CACHE_SIZE];   // buckets of MOVE_CACHE_WAYS slots, 0 if empty
+    unsigned char hands[MOVE_CACHE_SIZE / MOVE_CACHE_WAYS];    // next slot of each bucket the clock hand checks
+    int disabled;               // whether moves are always searched (for benchmarks)
+    unsigned long hits;         // number of positions found
+    unsigned long misses;       // number of positions searched because they weren't found
+    unsigned long stored;       // number of positions added to an empty slot
+    unsigned long evicted;      // number of positions added in place of another
+};
+
+/* Structure for a task of a parallel search: a move of Player 1 and a reply of Player 2. */
+struct Search_Task {
+    uint32_t p1, p2;    // the squares held by each player after the move and the reply
+    int move;           // the square (from 0) of Player 1's move
+    int value;          // minimax value of the position after the reply
+};
+
+/* Structure for the tasks a thread of a parallel search takes from the front of, and other
+ * threads steal from the back of, once they run out. Both ends are packed in one word so each
+ * take or steal is a single CAS. */
+struct Search_Range {
+    _Alignas(64) uint64_t range;    // first task (low half) and one past the last task (high half)
+};
+
+/* Structure for the threads that split each move search among themselves, by work stealing over
+ * the tasks of the search and sharing a lock-free transposition table. The thread requesting a
+ * search takes part in it as thread 0. */
+struct Parallel_Search {
+    pthread_t threads[MAX_SEARCH_THREADS];  // helper threads (thread 0 is the thread searching)
+    int numThreads;                         // number of threads splitting each search, 1 if searches aren't split
+    pthread_mutex_t searchLock;             // lock letting one search at a time use the threads
+    pthread_mutex_t lock;                   // lock protecting the generation and busy count
+    pthread_cond_t started;                 // signalled when a search is started
+    pthread_cond_t finished;                // signalled when the last helper finishes a search
+    unsigned generation;                    // number of searches started
+    int busy;                               // number of helpers still working on the current search
+    void (*work)(int thread);               // runs a thread's share of the current search
+    void *context;                          // state of the current search shared by its threads
+    struct Search_Task tasks[MAX_SEARCH_TASKS];     // tasks of the current search
+    struct Search_Range ranges[MAX_SEARCH_THREADS]; // tasks left to each thread
+    struct Position_Table *tables[MAX_SEARCH_THREADS];  // each thread's view of the shared table (and its counters)
+    struct Shared_Position *shared;         // transposition table shared by the threads
+};
+
+/* Structure for a node of a Monte Carlo search tree: a move and the playouts run through it. */
+struct Mcts_Node {
+    uint32_t child;     // first child node, 0 if none
+    uint32_t sibling;   // next child of the same parent (next free node in the pool), 0 if none
+    uint32_t visits;    // number of playouts through the node (including ones still running)
+    uint32_t reward;    // 2 per win and 1 per draw of those playouts, for the player making the move
+    uint8_t move;       // square (from 0) played to reach the node
+};
+
+/* Structure for the Monte Carlo search tree of a game of Ultimate TicTacToe. The nodes come from
+ * a fixed pool, and the tree is kept from one move to the next so the playouts through the moves
+ * actually played are reused, the rest of the tree going back to the pool. */
+struct Mcts_Tree {
+    pthread_mutex_t lock;               // lock protecting the tree while threads search it
+    struct Mcts_Node *nodes;            // pool of nodes, NULL until the game's first search
+    uint32_t root;                      // root node, 0 if the tree is empty
+    uint32_t freeList;                  // first node returned to the pool, 0 if none
+    uint32_t unused;                    // first node never taken from the pool
+    struct Ultimate_State rootState;    // the game state at the root
+};
+
+/* Structure for a move search of a game of Ultimate TicTacToe shared by its threads. */
+struct Mcts_Search {
+    struct Mcts_Tree *tree;     // tree of the game
+    double deadline;            // time the search has to stop by
+    unsigned long playouts;     // number of playouts started
+};
+
+/* Structure for a benchmark that can be run instead of the server. */
+struct Benchmark {
+    const char *name;       // name used to select the benchmark on the command line
+    void (*run)(void);      // function that runs the benchmark and prints its results
 };
 
+/****************/
+/* SERVER STATE */
+/****************/
+
+/* The optional server settings provided on the command line. */
+struct Server_Options options = {.cpu = -1, .searchThreads = -1, .splitThreads = 1, .moveBudget = ULTIMATE_BUDGET, .commandRate = COMMAND_RATE,
+    .selfPlayGames = SELF_PLAY_GAMES};
+/* The counters describing the commands handled by the server. */
+struct Server_Stats stats = {0};
+/* The token buckets of each source address tracked by the rate limiter. */
+struct Rate_Entry rateTable[RATE_TABLE_SIZE] = {{0}};
+/* Whether the server statistics have been requested (SIGUSR1). */
+volatile sig_atomic_t statsRequested = 0;
+/* The secret key used to issue and check handshake cookies. */
+unsigned char cookieKey[16] = {0};
+/* The finished games waiting out their grace period, kept apart from the game roster (by the thread
+ * running the command handlers, so each self-play thread has its own). */
+__thread struct TTT_Tombstone tombstones[MAX_TOMBSTONES] = {{{0}}};
+/* The received commands waiting to be handled, by priority class. */
+struct Command_Queue schedule[NUM_PRIORITIES] = {{{{{0}}}}};
+/* The resends scheduled by the server. */
+struct Resend_Schedule resends = {.seed = 1};
+/* The number of seconds the last command received waited in the socket queue (0 if unknown). */
+double receiveDelay = 0;
+/* The stages of the server when it runs as a pipeline, NULL if it runs as a single loop. */
+struct Pipeline *pipeline = NULL;
+/* The worker threads searching the server's moves. */
+struct Search_Pool searchPool = {.event = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .jobReady = PTHREAD_COND_INITIALIZER};
+/* The positions remembered by the searches of each thread (the server thread or a search worker). */
+__thread struct Position_Table positionTable = {{{0}}};
+/* The threads splitting each move search (-t). */
+struct Parallel_Search parallel = {.numThreads = 1, .searchLock = PTHREAD_MUTEX_INITIALIZER, .lock = PTHREAD_MUTEX_INITIALIZER,
+    .started = PTHREAD_COND_INITIALIZER, .finished = PTHREAD_COND_INITIALIZER};
+/* The solved-position database mapped read-only (-s), NULL if the server's moves are searched. */
+const struct Solved_Header *solvedPositions = NULL;
+/* The best moves of positions searched by any game or thread. */
+struct Move_Cache moveCache = {{0}};
+/* The game history log finished games are appended to (-H). */
+struct History_Log history = {.fd = -1};
+/* The Monte Carlo search tree of each game of Ultimate TicTacToe. */
+struct Mcts_Tree mctsTrees[MAX_GAMES] = {[0 ... MAX_GAMES-1] = {.lock = PTHREAD_MUTEX_INITIALIZER}};
+#ifdef SIMULATION
+/* The simulated network, clock and players the server runs against. */
+struct Simulation sim = {0};
+#endif
+
 /*****************************/
 /* GENERAL PURPOSE FUNCTIONS */
 /*****************************/
 
 void print_error(const char *msg, int errnum, int terminate);
 void handle_init_error(const char *msg, int errnum);
-void extract_args(char *argv[], int *port);
+void extract_args(int argc, char *argv[], int *port);
+double get_time(void);
+int64_t get_wall_time(void);
+void request_stats(int signum);
+void print_server_stats(void);
+void run_benchmark(const char *name);
+int compare_doubles(const void *a, const void *b);
 
 /********************************/
 /* SOCKET AND NETWORK FUNCTIONS */
@@ -90,38 +864,235 @@ void extract_args(char *argv[], int *port);
 void print_server_info(struct sockaddr_in serverAddr);
 int create_endpoint(struct sockaddr_in *socketAddr, unsigned long address, int port);
 void set_timeout(int sd, int seconds);
-void check_timeout(int sd, struct TTT_Game roster[MAX_GAMES]);
+void enable_receive_accounting(int sd);
+double account_datagram(int sd, struct msghdr *msg);
+void grow_receive_buffer(int sd);
+int listen_for_upgrade(const char *path);
+int take_over_server(const char *path, struct TTT_Game roster[MAX_GAMES]);
+void hand_off_server(int sd, int upgradeSd, struct TTT_Game roster[MAX_GAMES]);
+int wait_for_command(struct Transport *transport, int upgradeSd, struct TTT_Game roster[MAX_GAMES]);
+int busy_wait_for_command(struct Transport *transport, int upgradeSd, struct TTT_Game roster[MAX_GAMES], double *clock);
+void set_busy_poll(int sd);
+void *echo_datagrams(void *arg);
+void bench_latency(void);
+void bench_uring(void);
+
+/***********************/
+/* TRANSPORT FUNCTIONS */
+/***********************/
+
+void init_udp_transport(struct Transport *transport, int sd);
+int udp_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest);
+int udp_receive(struct Transport *transport, struct msghdr *msg);
+int udp_ready(struct Transport *transport);
+void init_uring_transport(struct Transport *transport, int sd);
+int uring_transport_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest);
+int uring_transport_receive(struct Transport *transport, struct msghdr *msg);
+int uring_transport_wait(struct Transport *transport, double timeout);
+void init_memory_transport(struct Transport *transport, struct Memory_Transport *memory);
+int memory_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest);
+int memory_receive(struct Transport *transport, struct msghdr *msg);
+int memory_ready(struct Transport *transport);
+int memory_push(struct Memory_Transport *memory, const struct sockaddr_in *playerAddr, const void *data, size_t length);
+int memory_pop(struct Memory_Transport *memory, struct Memory_Datagram *reply);
+int scatter_datagram(struct msghdr *msg, const struct sockaddr_in *address, const void *data, size_t length);
+void init_null_transport(struct Transport *transport);
+int null_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest);
+int null_receive(struct Transport *transport, struct msghdr *msg);
+int null_ready(struct Transport *transport);
+void init_shm_transport(struct Transport *transport, int sd, const char *path);
+void shm_accept_client(struct Shm_Transport *shm);
+void shm_drop_client(struct Shm_Client *client);
+int shm_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest);
+int shm_receive(struct Transport *transport, struct msghdr *msg);
+int shm_transport_ready(struct Transport *transport);
+int shm_transport_wait(struct Transport *transport, double timeout);
+int shm_pop_command(struct Shm_Transport *shm, struct msghdr *msg);
+void *echo_shm(void *arg);
+void bench_shm(void);
+void bench_engine(void);
+
+/******************************/
+/* PIPELINED SERVER FUNCTIONS */
+/******************************/
+
+struct Pipeline *create_pipeline(int sd);
+void run_pipeline(struct Pipeline *pipeline, struct TTT_Game roster[MAX_GAMES]);
+void pin_pipeline_stage(struct Pipeline_Stage *stage);
+void *pipeline_receive_stage(void *arg);
+void *pipeline_send_stage(void *arg);
+int pipeline_transport_receive(struct Transport *transport, struct msghdr *msg);
+int pipeline_transport_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest);
+int pipeline_transport_ready(struct Transport *transport);
+int pipeline_transport_wait(struct Transport *transport, double timeout);
+void init_pipeline_queue(struct Pipeline_Queue *queue);
+int pipeline_push(struct Pipeline_Queue *queue, const struct Pipeline_Message *message);
+int pipeline_pop(struct Pipeline_Queue *queue, struct Pipeline_Message *message);
+int pipeline_ready(struct Pipeline_Queue *queue);
+int pipeline_wait(struct Pipeline_Queue *queue, int timeout);
+void print_pipeline_stats(struct Pipeline *pipeline);
+void *bench_player(void *arg);
+void bench_pipeline(void);
+
+/**************************/
+/* IO_URING I/O FUNCTIONS */
+/**************************/
+
+#ifdef USE_IO_URING
+int uring_enter(struct Uring_Backend *ring, unsigned minComplete);
+struct io_uring_sqe *uring_get_sqe(struct Uring_Backend *ring, int opcode, uint64_t userData);
+void uring_arm_receive(struct Uring_Backend *ring);
+void uring_arm_timeout(struct Uring_Backend *ring);
+struct Uring_Backend *uring_create(int sd);
+void uring_recycle_buffer(struct Uring_Backend *ring, int bid);
+int uring_reap(struct Uring_Backend *ring);
+int uring_receive(struct Uring_Backend *ring, struct msghdr *msg);
+int uring_wait(struct Uring_Backend *ring, double timeout);
+int uring_send(struct Uring_Backend *ring, const void *data, size_t length, const struct sockaddr_in *dest);
+void uring_flush(struct Uring_Backend *ring);
+#else
+/* Servers built without the io_uring backend never have a ring (the -i option is rejected). */
+#define uring_receive(ring, msg) (errno = ENOSYS, -1)
+#define uring_wait(ring, timeout) (errno = ENOSYS, -1)
+#define uring_send(ring, data, length, dest) (errno = ENOSYS, -1)
+#endif
+void check_timeout(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]);
 int same_address(const struct sockaddr_in *addr1, const struct sockaddr_in *addr2);
+struct Rate_Entry *find_rate_entry(in_addr_t addr, double now);
+int admit_command(const struct sockaddr_in *playerAddr, const struct Buffer *datagram);
+uint64_t siphash(const unsigned char key[16], const unsigned char *data, size_t length);
+uint64_t make_cookie(const struct sockaddr_in *playerAddr, uint32_t window);
+int check_cookie(const struct sockaddr_in *playerAddr, const unsigned char cookie[COOKIE_SIZE], int length);
+void send_cookie(struct Transport *transport, const struct sockaddr_in *playerAddr);
+void bench_cookie(void);
 
 /******************************/
 /* TIC-TAC-TOE GAME FUNCTIONS */
 /******************************/
 
+/* The board kernels for the server's board geometry (ttt_bits(), ttt_win(), ttt_full(), ...). */
+BOARD_KERNELS(ttt, ROWS, COLUMNS, IN_A_ROW)
+
 void init_shared_state(struct TTT_Game *game);
 void reset_game(struct TTT_Game *game);
 void init_game_roster(struct TTT_Game roster[MAX_GAMES]);
+uint32_t checksum_game(const struct TTT_Game *game);
+void seal_game_roster(struct TTT_Game roster[MAX_GAMES]);
+int check_game_roster(struct TTT_Game roster[MAX_GAMES]);
+struct TTT_Game *map_game_roster(const char *path);
+void update_game_clocks(struct TTT_Game roster[MAX_GAMES], double elapsed);
 int games_in_progress(int *numWaiting, struct TTT_Game roster[MAX_GAMES]);
 int find_open_game(struct TTT_Game roster[MAX_GAMES]);
-int get_command(int sd, struct sockaddr_in *playerAddr, struct Buffer *datagram);
+int get_command(struct Transport *transport, struct sockaddr_in *playerAddr, struct Buffer *datagram, unsigned char cookie[COOKIE_SIZE]);
+int validate_command(const struct Buffer *datagram);
+int commands_scheduled(void);
+int classify_command(struct TTT_Game roster[MAX_GAMES], const struct Scheduled_Command *command);
+int schedule_command(struct TTT_Game roster[MAX_GAMES], const struct Scheduled_Command *command);
+int receive_command(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]);
+void drain_commands(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]);
+int next_command(struct Transport *transport, struct TTT_Game roster[MAX_GAMES], struct Scheduled_Command *command);
+int handle_command(struct Transport *transport, struct TTT_Game roster[MAX_GAMES], const struct sockaddr_in *playerAddr,
+    const struct Buffer *datagram, const unsigned char cookie[COOKIE_SIZE], int length);
 int validate_sequence_num(const struct sockaddr_in *playerAddr, const struct Buffer *datagram, const struct TTT_Game *game);
-void resend_command(int sd, struct TTT_Game *game);
+void resend_command(struct Transport *transport, struct TTT_Game *game);
+void schedule_resend(struct Transport *transport, struct TTT_Game roster[MAX_GAMES], int gameIndx, double delay);
+void schedule_resends(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]);
+double next_resend_due(void);
+void send_due_resends(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]);
 int validate_move(int choice, const struct TTT_Game *game);
-int minimax(struct TTT_Game *game, int depth, int isMax);
+int decode_move(const struct TTT_Game *game, char data);
+char encode_move(const struct TTT_Game *game, int move);
+void mark_square(struct TTT_Game *game, int move, char mark);
+uint64_t position_key(const struct Position_Table *table, uint32_t p1, uint32_t p2, int isMax, int *sym);
+struct Position_Entry *find_position(struct Position_Table *table, uint64_t key);
+int recall_position(struct Position_Table *table, uint64_t key, int *value, int *move);
+void remember_position(struct Position_Table *table, uint64_t key, int value, int move);
+void map_solved_positions(const char *path);
+int find_solved_move(uint32_t p1, uint32_t p2);
+unsigned move_cache_bucket(uint64_t key);
+int lookup_cached_move(uint64_t key);
+void cache_move(uint64_t key, int move);
+void *bench_cache_player(void *arg);
+void bench_cache(void);
+int minimax(struct Position_Table *table, uint32_t p1, uint32_t p2, int isMax, int *move);
 int find_best_move(struct TTT_Game *game);
-int send_p1_move(int sd, struct TTT_Game *game);
+void bench_symmetry(void);
+void bench_classify(void);
+void start_parallel_search(int numThreads);
+void *parallel_search_helper(void *arg);
+int take_search_task(int thread);
+void run_parallel(void (*work)(int thread), void *context);
+void run_search_tasks(int thread);
+int parallel_best_move(uint32_t p1, uint32_t p2);
+void bench_parallel(void);
+int send_p1_move(struct Transport *transport, struct TTT_Game *game, int move);
+int play_p1_move(struct Transport *transport, struct TTT_Game *game, int move);
+void request_p1_move(struct Transport *transport, struct TTT_Game *game);
+void start_search_pool(int numThreads);
+void *search_worker(void *arg);
+void submit_search(const struct TTT_Game *game);
+void collect_searches(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]);
+void wait_for_searches(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]);
 int check_win(const struct TTT_Game *game);
 int check_draw(const struct TTT_Game *game);
 void print_board(const struct TTT_Game *game);
 int check_game_over(struct TTT_Game *game);
-void send_game_over(int sd, struct TTT_Game *game);
-void tictactoe(int sd);
+void send_game_over(struct Transport *transport, struct TTT_Game *game);
+void bury_game(struct TTT_Game *game);
+struct TTT_Tombstone *find_tombstone(const struct sockaddr_in *playerAddr, const struct Buffer *datagram);
+void answer_tombstone(struct Transport *transport, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Tombstone *tombstone);
+void remove_tombstones(const struct sockaddr_in *playerAddr);
+int age_tombstones(double elapsed);
+void tictactoe(struct Transport *transport, int upgradeSd, struct TTT_Game roster[MAX_GAMES]);
+
+/**********************************/
+/* ULTIMATE TIC-TAC-TOE FUNCTIONS */
+/**********************************/
+
+/* The board kernels for the small boards of Ultimate TicTacToe (and the board of small boards). */
+BOARD_KERNELS(utt, 3, 3, 3)
+
+void ultimate_init(struct Ultimate_State *state);
+int ultimate_legal(const struct Ultimate_State *state, int square);
+void ultimate_play(struct Ultimate_State *state, int square);
+int ultimate_moves(const struct Ultimate_State *state, uint8_t moves[ULTIMATE_SQUARES]);
+int ultimate_same(const struct Ultimate_State *state1, const struct Ultimate_State *state2);
+int ultimate_rollout(struct Ultimate_State *state, uint32_t *seed);
+void print_ultimate(const struct Ultimate_State *state);
+uint32_t mcts_alloc(struct Mcts_Tree *tree);
+void mcts_free(struct Mcts_Tree *tree, uint32_t node);
+void mcts_release(struct Mcts_Tree *tree);
+void mcts_reuse(struct Mcts_Tree *tree, const struct Ultimate_State *state);
+int mcts_expand(struct Mcts_Tree *tree, uint32_t node, const struct Ultimate_State *state);
+uint32_t mcts_select(struct Mcts_Tree *tree, uint32_t node);
+void mcts_search(struct Mcts_Search *search, int thread);
+void mcts_parallel_search(int thread);
+int mcts_best_move(const struct TTT_Game *game);
+void bench_ultimate(void);
+
+/**************************/
+/* GAME HISTORY FUNCTIONS */
+/**************************/
+
+int open_history(struct History_Log *log, const char *dir);
+void close_history(struct History_Log *log);
+void record_game(struct History_Log *log, const struct TTT_Game *game);
+void bench_history(void);
+
+/***********************/
+/* SELF-PLAY FUNCTIONS */
+/***********************/
+
+void run_self_play(void);
+void *self_play_thread(void *arg);
+int opponent_move(struct Self_Player *player);
 
 /*******************/
 /* PLAYER COMMANDS */
 /*******************/
 
 /* Function pointer type for function to handle player commands. */
-typedef void (*command_handler)(int sd, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game);
+typedef void (*command_handler)(struct Transport *transport, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game);
 /* The command to begin a new game. */
 #define NEW_GAME 0x00
 /* The command to issue a move. */
@@ -129,9 +1100,32 @@ typedef void (*command_handler)(int sd, const struct sockaddr_in *playerAddr, co
 /* The command to signal that the game has ended. */
 #define GAME_OVER 0x02
 
-void new_game(int sd, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game);
-void move(int sd, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game);
-void game_over(int sd, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game);
+void new_game(struct Transport *transport, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game);
+void move(struct Transport *transport, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game);
+void game_over(struct Transport *transport, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game);
+
+#ifdef SIMULATION
+/************************/
+/* SIMULATION FUNCTIONS */
+/************************/
+
+void run_simulation(int argc, char *argv[]);
+void print_simulation(void);
+double sim_uniform(void);
+void sim_schedule(struct Sim_Event *event);
+struct Sim_Event sim_next_event(void);
+void sim_transmit(int type, int player, const struct sockaddr_in *address, const void *data, size_t length);
+int sim_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest);
+int sim_receive(struct Transport *transport, struct msghdr *msg);
+void sim_arm_timer(int player, double seconds);
+void sim_player_send(int player);
+void sim_start_game(int player);
+void sim_end_game(int player, unsigned long *outcome);
+void sim_retire_player(int player);
+void sim_player_receive(int player, const struct Cookie_Buffer *datagram, size_t length);
+void sim_player_timeout(int player);
+int sim_game_result(const struct TTT_Game *game);
+#endif
 
 /**
  * @brief This program creates and sets up a TicTacToe server which acts as Player 1 in a
@@ -154,19 +1148,63 @@ void game_over(int sd, const struct sockaddr_in *playerAddr, const struct Buffer
  * the value EXIT_FAILURE indicates unsuccessful termination.
  */
 int main(int argc, char *argv[]) {
-    int sd, portNumber;
+    int sd = -1, upgradeSd = -1, portNumber;
     struct sockaddr_in serverAddress;
+    struct Transport transport;
+    struct TTT_Game *gameRoster;
+    struct sigaction statsAction = {0};
+
+#ifdef SIMULATION
+    /* Run the server against simulated players instead of the network */
+    run_simulation(argc, argv);
+#endif
 
-    /* If arg count correct, extract arguments to their respective variables */
-    if (argc != NUM_ARGS) handle_init_error("argc: Invalid number of command line arguments", 0);
-    extract_args(argv, &portNumber);
+    /* Extract arguments to their respective variables */
+    extract_args(argc, argv, &portNumber);
+    /* Run the requested benchmark instead of the server */
+    if (options.benchmark != NULL) run_benchmark(options.benchmark);
+    /* Print the server statistics whenever SIGUSR1 is received */
+    statsAction.sa_handler = request_stats;
+    sigaction(SIGUSR1, &statsAction, NULL);
+    /* Generate the secret key for handshake cookies */
+    if (options.cookies && getrandom(cookieKey, sizeof(cookieKey), 0) != sizeof(cookieKey)) {
+        print_error("main: getrandom", errno, 1);
+    }
 
-    /* Create server socket and print server information */
-    sd = create_endpoint(&serverAddress, INADDR_ANY, portNumber);
+    /* Map the solved positions shared (read-only) with any other server on the host */
+    if (options.solvedFile != NULL) map_solved_positions(options.solvedFile);
+    /* Start the log finished games are recorded to */
+    if (options.historyDir != NULL && open_history(&history, options.historyDir) == -1) exit(EXIT_FAILURE);
+    /* Split each move search across threads if asked to */
+    start_parallel_search(options.splitThreads);
+    /* Play games against the chosen opponent instead of serving players if asked to (this never returns) */
+    if (options.selfPlay) run_self_play();
+    /* Map (and initialize or resume) all games */
+    gameRoster = map_game_roster(options.rosterFile);
+    /* Take over the socket and games of a running server if possible, otherwise create server socket */
+    if (options.upgradeSocket != NULL) sd = take_over_server(options.upgradeSocket, gameRoster);
+    if (sd == -1) {
+        sd = create_endpoint(&serverAddress, INADDR_ANY, portNumber);
+    } else {
+        socklen_t addrLength = sizeof(serverAddress);
+        getsockname(sd, (struct sockaddr *)&serverAddress, &addrLength);
+    }
+    /* Listen for the next binary upgrade and print server information */
+    if (options.upgradeSocket != NULL) upgradeSd = listen_for_upgrade(options.upgradeSocket);
     print_server_info(serverAddress);
+    /* Have the kernel report how long each datagram was queued and how many it dropped */
+    enable_receive_accounting(sd);
+    /* Carry commands over the server socket directly or through the io_uring backend */
+    (options.uring) ? init_uring_transport(&transport, sd) : init_udp_transport(&transport, sd);
+    /* Also carry the commands of co-located clients through shared memory */
+    if (options.shmSocket != NULL) init_shm_transport(&transport, sd, options.shmSocket);
+    /* Split the server into receive, game and send stages if asked to (this never returns) */
+    if (options.pipeline) run_pipeline(create_pipeline(sd), gameRoster);
+    /* Search the server's moves on worker threads so the transport is never kept waiting */
+    start_search_pool(options.searchThreads);
 
     /* Start the TicTacToe server */
-    tictactoe(sd);
+    tictactoe(&transport, upgradeSd, gameRoster);
 
     return 0;
 }
@@ -199,7 +1237,9 @@ void print_error(const char *msg, int errnum, int terminate) {
  */
 void handle_init_error(const char *msg, int errnum) {
     print_error(msg, errnum, 0);
-    printf("Usage is: tictactoeServer <remote-port>\n");
+    printf("Usage is: tictactoeServer [-f roster-file] [-u upgrade-socket] [-c] [-i] [-p cpu [-y usec]] [-m shm-socket] [-w threads] [-t threads] [-P] [-T msec] [-s solved-db] [-H history-dir] [-r rate] <remote-port>\n");
+    printf("      or: tictactoeServer -S <random|scripted|self> [-N games] [-w threads] [-U] [-t threads] [-T msec] [-s solved-db]\n");
+    printf("      or: tictactoeServer -b <benchmark>\n");
     /* Exits the process signaling unsuccessful termination */
     exit(EXIT_FAILURE);
 }
@@ -208,6 +1248,8 @@ void handle_init_error(const char *msg, int errnum) {
  * @brief Extracts the user provided arguments to their respective local variables and performs
  * validation on their formatting. If any errors are found, the function terminates the process.
  * 
+ * @param argc Non-negative value representing the number of arguments passed to the program
+ * from the environment in which the program is run.
  * @param argv Pointer to the first element of an array of argc + 1 pointers, of which the
  * last one is NULL and the previous ones, if any, point to strings that represent the
  * arguments passed to the program from the host environment. If argv[0] is not a NULL
@@ -215,12 +1257,251 @@ void handle_init_error(const char *msg, int errnum) {
  * name, which is empty if the program name is not available from the host environment.
  * @param port The remote port number that the server should listen on
  */
-void extract_args(char *argv[], int *port) {
+void extract_args(int argc, char *argv[], int *port) {
+    int opt;
+    /* Extract the optional server settings */
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+            case 'f':   // file to persist the game roster in
+                options.rosterFile = optarg;
+                break;
+            case 'u':   // UNIX socket used to hand the server off to a new binary
+                options.upgradeSocket = optarg;
+                break;
+            case 'c':   // require a handshake cookie before allocating a game
+                options.cookies = 1;
+                break;
+            case 'i':   // use the io_uring backend for the server socket
+#ifndef USE_IO_URING
+                handle_init_error("-i: Server was built without io_uring support (build with 'make URING=1')", 0);
+#endif
+                options.uring = 1;
+                break;
+            case 'p':   // busy-poll the server socket on the given CPU core
+                options.busyPoll = 1;
+                options.cpu = strtol(optarg, NULL, 10);
+                break;
+            case 'y':   // SO_BUSY_POLL budget for the busy-polling server
+                options.busyPollBudget = strtol(optarg, NULL, 10);
+                break;
+            case 'm':   // UNIX socket co-located clients connect to for shared-memory channels
+                options.shmSocket = optarg;
+                break;
+            case 'w':   // number of search worker threads
+                options.searchThreads = strtol(optarg, NULL, 10);
+                if (options.searchThreads < 0 || options.searchThreads > MAX_SEARCH_THREADS) handle_init_error("-w: Invalid number of search threads", 0);
+                break;
+            case 't':   // number of threads each move search is split across
+                options.splitThreads = strtol(optarg, NULL, 10);
+                if (options.splitThreads < 1 || options.splitThreads > MAX_SEARCH_THREADS) handle_init_error("-t: Invalid number of threads", 0);
+                break;
+            case 'P':   // run the server as a pipeline of receive, game and send stages
+                options.pipeline = 1;
+                break;
+            case 'T':   // number of milliseconds spent searching each Ultimate TicTacToe move
+                options.moveBudget = strtol(optarg, NULL, 10) / 1000.0;
+                if (options.moveBudget <= 0) handle_init_error("-T: Invalid move time budget", 0);
+                break;
+            case 's':   // database of solved positions answering the server's moves
+                options.solvedFile = optarg;
+                break;
+            case 'H':   // directory finished games are logged to
+                options.historyDir = optarg;
+                break;
+            case 'r':   // number of commands per second each source address is allowed
+                options.commandRate = strtod(optarg, NULL);
+                if (options.commandRate < 0) handle_init_error("-r: Invalid command rate", 0);
+                break;
+            case 'S':   // play games against an opponent instead of serving players
+                if (strcmp(optarg, "random") == 0) {
+                    options.selfPlay = SELF_PLAY_RANDOM;
+                } else if (strcmp(optarg, "scripted") == 0) {
+                    options.selfPlay = SELF_PLAY_SCRIPTED;
+                } else if (strcmp(optarg, "self") == 0) {
+                    options.selfPlay = SELF_PLAY_SELF;
+                } else {
+                    handle_init_error("-S: Invalid opponent", 0);
+                }
+                break;
+            case 'N':   // number of games played by each self-play thread
+                options.selfPlayGames = strtol(optarg, NULL, 10);
+                if (options.selfPlayGames < 1) handle_init_error("-N: Invalid number of games", 0);
+                break;
+            case 'U':   // play Ultimate TicTacToe in the self-play mode
+                options.selfPlayUltimate = 1;
+                break;
+            case 'b':   // run a benchmark instead of the server
+                options.benchmark = optarg;
+                break;
+            default:
+                handle_init_error("Invalid command line option", 0);
+        }
+    }
+    /* The io_uring backend can't hand its socket off yet */
+    if (options.uring && options.upgradeSocket != NULL) handle_init_error("-i: Hot upgrades are not supported with the io_uring backend", 0);
+    /* The io_uring backend waits in the kernel, so it can't busy-poll */
+    if (options.uring && options.busyPoll) handle_init_error("-p: Busy polling is not supported with the io_uring backend", 0);
+    /* The shared-memory transport waits on its own, so it can't be busy-polled, run on io_uring or handed off */
+    if (options.shmSocket != NULL && (options.uring || options.busyPoll || options.upgradeSocket != NULL)) {
+        handle_init_error("-m: Shared memory can't be combined with -i, -p or -u", 0);
+    }
+    /* Searches finish by waking the server's poll(), which the io_uring and shared-memory transports don't use */
+    if (options.searchThreads > 0 && (options.uring || options.shmSocket != NULL)) {
+        handle_init_error("-w: Search threads can't be combined with -i or -m", 0);
+    }
+    /* The pipeline has its own receive and send stages, and its game stage searches inline */
+    if (options.pipeline && (options.uring || options.busyPoll || options.shmSocket != NULL || options.upgradeSocket != NULL || options.searchThreads > 0)) {
+        handle_init_error("-P: The pipeline can't be combined with -i, -p, -m, -u or -w", 0);
+    }
+    /* Self-play plays its games on the -w threads, each searching inline with its own game (and its opponent's) */
+    if (options.selfPlay) {
+        options.selfPlayThreads = (options.searchThreads < 1) ? 1 : options.searchThreads;
+        options.searchThreads = 0;
+        if (options.selfPlayThreads > ((options.selfPlay == SELF_PLAY_SELF && options.selfPlayUltimate) ? MAX_GAMES/2 : MAX_GAMES)) {
+            handle_init_error("-w: Too many self-play threads", 0);
+        }
+        if (options.historyDir != NULL) handle_init_error("-S: Self-play can't be combined with -H", 0);
+    }
+    if (options.searchThreads == -1) options.searchThreads = (options.uring || options.shmSocket != NULL || options.pipeline) ? 0 : SEARCH_THREADS;
+    /* An inline Ultimate TicTacToe search would hold up every other game for its whole budget */
+    options.ultimate = options.searchThreads > 0 || options.selfPlay || options.benchmark != NULL;
+    /* Benchmarks and self-play don't need a port to listen on */
+    if ((options.benchmark != NULL || options.selfPlay) && argc == optind) return;
+    /* Check that the positional arg count is correct */
+    if (argc - optind != NUM_ARGS - 1) handle_init_error("argc: Invalid number of command line arguments", 0);
     /* Extract and validate remote port number */
-    *port = strtol(argv[1], NULL, 10);
+    *port = strtol(argv[optind], NULL, 10);
     if (*port < 1 || *port != (u_int16_t)(*port)) handle_init_error("remote-port: Invalid port number", 0);
 }
 
+/**
+ * @brief Gets the current time from a monotonic clock.
+ * 
+ * @return The number of seconds elapsed since an arbitrary fixed point.
+ */
+double get_time(void) {
+    struct timespec now;
+#ifdef SIMULATION
+    return sim.clock;
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Gets the current time from the real-time clock (the simulated clock in a simulation).
+ * 
+ * @return The number of microseconds elapsed since the epoch.
+ */
+int64_t get_wall_time(void) {
+    struct timespec now;
+#ifdef SIMULATION
+    return sim.clock * 1e6;
+#endif
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * @brief Signal handler that flags the server statistics to be printed by the server loop.
+ * 
+ * @param signum The number of the signal received.
+ */
+void request_stats(int signum) {
+    statsRequested = 1;
+}
+
+/**
+ * @brief Prints the counters describing the commands handled by the server.
+ */
+void print_server_stats(void) {
+    int i;
+    printf("[+]Server stats: %lu received, %lu dropped, %lu rate limited (%lu NEW_GAME), %lu sources evicted\n",
+        stats.received, stats.dropped, stats.limited, stats.newGamesLimited, stats.evictions);
+    printf("[+]Socket stats: %lu dropped by the kernel, %d byte receive buffer\n", __atomic_load_n(&stats.kernelDrops, __ATOMIC_RELAXED),
+        __atomic_load_n(&stats.rcvbuf, __ATOMIC_RELAXED));
+    /* Print the non-empty buckets of the queueing delay histogram */
+    printf("[+]Queueing delay (us):");
+    for (i = 0; i < DELAY_BUCKETS; i++) {
+        unsigned long count = __atomic_load_n(&stats.queueDelay[i], __ATOMIC_RELAXED);
+        if (count > 0) printf(" <%lu: %lu", 2ul << i, count);
+    }
+    printf("\n");
+    printf("[+]Scheduler stats: %d live and %d NEW_GAME commands waiting (max %d and %d), %lu NEW_GAME shed\n",
+        schedule[PRIORITY_LIVE].count, schedule[PRIORITY_ADMISSION].count, stats.scheduledMax[PRIORITY_LIVE],
+        stats.scheduledMax[PRIORITY_ADMISSION], stats.shed);
+    printf("[+]Resend stats: %lu resends in %lu batches (largest %d), peak %d resends/s, %lu deferred to pace a destination\n",
+        stats.resends, stats.resendBatches, stats.resendBurstMax, stats.resendRateMax, stats.resendsDeferred);
+    if (solvedPositions != NULL) {
+        printf("[+]Solved stats: %lu moves answered from the database, %lu searched\n",
+            __atomic_load_n(&stats.solvedMoves, __ATOMIC_RELAXED), __atomic_load_n(&stats.solvedMisses, __ATOMIC_RELAXED));
+    }
+    if (stats.ultimateMoves > 0) {
+        unsigned long moves = __atomic_load_n(&stats.ultimateMoves, __ATOMIC_RELAXED);
+        printf("[+]Ultimate stats: %lu moves searched, %.0f playouts per move (%.0f kept from earlier moves)\n", moves,
+            (double)__atomic_load_n(&stats.ultimatePlayouts, __ATOMIC_RELAXED) / moves, (double)__atomic_load_n(&stats.ultimateReused, __ATOMIC_RELAXED) / moves);
+    }
+    if (moveCache.hits + moveCache.misses > 0) {
+        unsigned long hits = __atomic_load_n(&moveCache.hits, __ATOMIC_RELAXED), misses = __atomic_load_n(&moveCache.misses, __ATOMIC_RELAXED);
+        printf("[+]Move cache stats: %lu hits, %lu misses (%.1f%% hit), %lu positions cached, %lu evicted\n", hits, misses,
+            100.0 * hits / (hits + misses), __atomic_load_n(&moveCache.stored, __ATOMIC_RELAXED), __atomic_load_n(&moveCache.evicted, __ATOMIC_RELAXED));
+    }
+    if (history.segment != NULL) {
+        printf("[+]History stats: %lu games recorded (%lu bytes) in %u segments, writing %s/" HISTORY_SEGMENT_NAME "\n",
+            history.records, history.bytes, history.segments, history.dir, history.number);
+    }
+    /* Print the counters of each pipeline stage */
+    if (pipeline != NULL) print_pipeline_stats(pipeline);
+    /* Print the search thread pool queue depth and wait times */
+    if (searchPool.numThreads > 0) {
+        int depth;
+        pthread_mutex_lock(&searchPool.lock);
+        depth = searchPool.jobTail - searchPool.jobHead;
+        pthread_mutex_unlock(&searchPool.lock);
+        printf("[+]Search stats: %lu moves searched on %d threads, %d queued (max %d), %.1f us average wait (max %.1f us)\n",
+            stats.searches, searchPool.numThreads, depth, stats.searchQueueMax,
+            (stats.searches > 0) ? stats.searchWait * 1e6 / stats.searches : 0.0, stats.searchWaitMax * 1e6);
+    }
+    statsRequested = 0;
+}
+
+/**
+ * @brief Runs the benchmark with the given name and terminates the process. If there is no
+ * benchmark with that name, the available benchmarks are listed instead.
+ * 
+ * @param name The name of the benchmark to run.
+ */
+void run_benchmark(const char *name) {
+    int i;
+    struct Benchmark benchmarks[] = {{"cookie", bench_cookie}, {"uring", bench_uring}, {"latency", bench_latency}, {"engine", bench_engine}, {"shm", bench_shm}, {"pipeline", bench_pipeline}, {"symmetry", bench_symmetry}, {"parallel", bench_parallel}, {"ultimate", bench_ultimate}, {"classify", bench_classify}, {"cache", bench_cache}, {"history", bench_history}};
+    /* Search for the requested benchmark */
+    for (i = 0; i < sizeof(benchmarks)/sizeof(benchmarks[0]); i++) {
+        if (strcmp(benchmarks[i].name, name) == 0) {
+            benchmarks[i].run();
+            exit(EXIT_SUCCESS);
+        }
+    }
+    /* List the available benchmarks */
+    print_error("run_benchmark: Unknown benchmark", 0, 0);
+    printf("Available benchmarks:");
+    for (i = 0; i < sizeof(benchmarks)/sizeof(benchmarks[0]); i++) printf(" %s", benchmarks[i].name);
+    printf("\n");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Compares two doubles for sorting with qsort().
+ * 
+ * @param a Pointer to the first double.
+ * @param b Pointer to the second double.
+ * @return A negative number, zero, or a positive number if the first double is less than, equal
+ * to, or greater than the second.
+ */
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
 /**
  * @brief Prints the server information needed for the client to comminicate with the server.
  * 
@@ -294,713 +1575,5457 @@ void set_timeout(int sd, int seconds) {
 }
 
 /**
- * @brief Checks each TicTacToe game to see if it has timed out or not. If one has, the previous
- * command for that game is resent. If one has and the last command received was a GAME_OVER
- * command, the game is reset.
+ * @brief Asks the kernel to attach a receive timestamp (SO_TIMESTAMPNS) and a count of datagrams
+ * it dropped (SO_RXQ_OVFL) to each datagram received on the server socket.
  * 
  * @param sd The socket descriptor of the server comminication endpoint.
- * @param roster The array of playable TicTacToe games.
  */
-void check_timeout(int sd, struct TTT_Game roster[MAX_GAMES]) {
-    int i;
-    /* Searches over all games */
-    for (i = 0; i < MAX_GAMES; i++) {
-        struct TTT_Game *game = &roster[i];
-        /* Check if current game timeout has expired */
-        if (game->timeout <= 0) {
-            printf("[+]Game #%d has timed out.\n", game->gameNum);
-            /* Check if the server has sent GAME_OVER command and is waiting */
-            if (game->lastSent.command != GAME_OVER) {
-                /* Command likely got lost -> resend previously sent command */
-                printf("Player at %s (port %d) likely lost the previous command\n", inet_ntoa(game->p2Address.sin_addr), game->p2Address.sin_port);
-                resend_command(sd, game);
-            } else {
-                /* Grace period over -> end game */
-                printf("Haven't heard back after sending GAME_OVER command\n");
-                reset_game(game);
+void enable_receive_accounting(int sd) {
+    int on = 1;
+    socklen_t length = sizeof(stats.rcvbuf);
+    if (setsockopt(sd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == -1) print_error("enable_receive_accounting: SO_TIMESTAMPNS", errno, 0);
+    if (setsockopt(sd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == -1) print_error("enable_receive_accounting: SO_RXQ_OVFL", errno, 0);
+    getsockopt(sd, SOL_SOCKET, SO_RCVBUF, &stats.rcvbuf, &length);
+}
+
+/**
+ * @brief Reads the ancillary data received with a datagram, recording how long the datagram
+ * waited in the socket queue and how many datagrams the kernel has dropped since the last one.
+ * If new drops appear, the receive buffer is grown. Only the thread receiving from the socket
+ * calls this (the pipeline's receive stage), so the counters are only stored atomically for the
+ * threads printing them.
+ * 
+ * @param sd The socket descriptor of the server comminication endpoint.
+ * @param msg The message header the datagram was received with.
+ * @return The number of seconds the datagram waited in the socket queue, or 0 if unknown.
+ */
+double account_datagram(int sd, struct msghdr *msg) {
+    struct cmsghdr *cmsg;
+    double waited = 0;
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) continue;
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            /* Time from the kernel receiving the datagram until now, bucketed by power of two */
+            struct timespec received, now;
+            long delay;
+            int bucket = 0;
+            memcpy(&received, CMSG_DATA(cmsg), sizeof(received));
+            clock_gettime(CLOCK_REALTIME, &now);
+            delay = (now.tv_sec - received.tv_sec) * 1000000 + (now.tv_nsec - received.tv_nsec) / 1000;
+            while (bucket < DELAY_BUCKETS-1 && delay >= (2l << bucket)) bucket++;
+            __atomic_fetch_add(&stats.queueDelay[bucket], 1, __ATOMIC_RELAXED);
+            waited = delay / 1e6;
+        } else if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+            /* Total number of datagrams the kernel has dropped on this socket */
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            if (drops - stats.kernelDropsBase > stats.kernelDrops) {
+                printf("[+]Kernel dropped %lu datagrams (receive buffer full).\n", drops - stats.kernelDropsBase - stats.kernelDrops);
+                __atomic_store_n(&stats.kernelDrops, drops - stats.kernelDropsBase, __ATOMIC_RELAXED);
+                grow_receive_buffer(sd);
             }
         }
     }
+    return waited;
 }
 
 /**
- * @brief Checks to see if two communication endpoints have the same address (IP and port) or not.
+ * @brief Doubles the size of the server socket receive buffer (up to MAX_RCVBUF). The size is
+ * forced past the system limit if the server is privileged enough to do so.
  * 
- * @param addr1 The address of communication endpoint 1.
- * @param addr2 The address of communication endpoint 2.
- * @return True if the endpoint addresses are the same, false otherwise. 
+ * @param sd The socket descriptor of the server comminication endpoint.
  */
-int same_address(const struct sockaddr_in *addr1, const struct sockaddr_in *addr2) {
-    /* Check endpoint IP addresses */
-    if (addr1->sin_addr.s_addr != addr2->sin_addr.s_addr) return 0;
-    /* Check endpoint port numbers */
-    if (addr1->sin_port != addr2->sin_port) return 0;
-    return 1;
+void grow_receive_buffer(int sd) {
+    int size = stats.rcvbuf, rcvbuf;    // the kernel doubles the requested size, so this doubles it
+    socklen_t length = sizeof(rcvbuf);
+    if (size >= MAX_RCVBUF) return;
+    if (size > MAX_RCVBUF / 2) size = MAX_RCVBUF / 2;
+    if (setsockopt(sd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) == -1 && setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) == -1) {
+        print_error("grow_receive_buffer: setsockopt", errno, 0);
+        return;
+    }
+    getsockopt(sd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &length);
+    __atomic_store_n(&stats.rcvbuf, rcvbuf, __ATOMIC_RELAXED);
+    printf("[+]Server socket receive buffer grown to %d bytes.\n", rcvbuf);
 }
 
 /**
- * @brief Initializes the starting state of the game board that both players start with.
+ * @brief Creates the UNIX socket that a newly started server binary connects to in order to take
+ * over this server. If any errors are found, the function terminates the process.
  * 
- * @param game The current game of TicTacToe being played.
+ * @param path The path of the UNIX socket.
+ * @return The socket descriptor listening for upgrade requests.
  */
-void init_shared_state(struct TTT_Game *game) {    
-    int i;
-    /* Initializes the shared state (aka the board)  */
-    for (i = 1; i <= sizeof(game->board); i++) {
-        game->board[i-1] = i + '0';
+int listen_for_upgrade(const char *path) {
+    int upgradeSd;
+    struct sockaddr_un upgradeAddr = {0};
+    upgradeAddr.sun_family = AF_UNIX;
+    strncpy(upgradeAddr.sun_path, path, sizeof(upgradeAddr.sun_path)-1);
+    /* Create socket, replacing the one left by the previous server (if any) */
+    if ((upgradeSd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) print_error("listen_for_upgrade: socket", errno, 1);
+    unlink(path);
+    /* Bind socket to path and listen for the next server binary */
+    if (bind(upgradeSd, (struct sockaddr *)&upgradeAddr, sizeof(upgradeAddr)) == -1) {
+        print_error("listen_for_upgrade: bind", errno, 1);
     }
+    if (listen(upgradeSd, 1) == -1) print_error("listen_for_upgrade: listen", errno, 1);
+    printf("[+]Listening for server upgrades at %s.\n", path);
+    return upgradeSd;
 }
 
 /**
- * @brief Resets the current game for a new player.
+ * @brief Attempts to take over a running server through its upgrade socket. The running server
+ * passes over its bound socket (SCM_RIGHTS) along with a snapshot of its game roster, which
+ * replaces the given roster, and then exits once the handoff has been acknowledged.
  * 
- * @param game The current game of TicTacToe being played.
+ * @param path The path of the UNIX socket the running server is listening on.
+ * @param roster The array of playable TicTacToe games.
+ * @return The socket descriptor of the server comminication endpoint that was taken over, or -1
+ * if there was no running server to take over.
  */
-void reset_game(struct TTT_Game *game) {
-    struct sockaddr_in blankAddr = {0};
-    struct Buffer blankCommand = {0};
-    if (game->gameNum > 0) printf("Game #%d has ended. Resetting game for new player\n", game->gameNum);
-    /* Reset game attributes */
-    game->seqNum = 0;
-    game->timeout = GAME_TIMEOUT;
-    game->resends = MAX_RESENDS;
-    game->p2Address = blankAddr;
-    game->winner = -1;
-    game->lastSent = blankCommand;
-    /* Reset game board */
-    init_shared_state(game);
+int take_over_server(const char *path, struct TTT_Game roster[MAX_GAMES]) {
+    int conn, sd = -1;
+    char control[CMSG_SPACE(sizeof(int))] = {0}, ack = 1;
+    struct sockaddr_un upgradeAddr = {0};
+    struct Game_Roster *snapshot = malloc(sizeof(struct Game_Roster));
+    struct iovec iov = {snapshot, sizeof(struct Game_Roster)};
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t length = sizeof(meminfo);
+    upgradeAddr.sun_family = AF_UNIX;
+    strncpy(upgradeAddr.sun_path, path, sizeof(upgradeAddr.sun_path)-1);
+    /* Connect to the running server (if there is one) */
+    if (snapshot == NULL) print_error("take_over_server: malloc", errno, 1);
+    if ((conn = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) print_error("take_over_server: socket", errno, 1);
+    if (connect(conn, (struct sockaddr *)&upgradeAddr, sizeof(upgradeAddr)) == -1) {
+        printf("[+]No running server found at %s (%s).\n", path, strerror(errno));
+        close(conn);
+        free(snapshot);
+        return -1;
+    }
+    /* Receive the server socket and snapshot of the game roster */
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(conn, &msg, MSG_WAITALL) != sizeof(struct Game_Roster)) {
+        print_error("take_over_server: Incomplete handoff from running server", errno, 1);
+    }
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) memcpy(&sd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (sd == -1) print_error("take_over_server: Running server did not pass its socket", 0, 1);
+    /* Count only the drops from the handoff on (the socket's counter already holds the ones the old server saw) */
+    if (getsockopt(sd, SOL_SOCKET, SO_MEMINFO, meminfo, &length) == 0 && length > SK_MEMINFO_DROPS * sizeof(uint32_t)) {
+        stats.kernelDropsBase = meminfo[SK_MEMINFO_DROPS];
+    } else {
+        print_error("take_over_server: getsockopt SO_MEMINFO", errno, 0);
+    }
+    /* Adopt the games if the snapshot has the same layout as this server */
+    if (snapshot->header.version == ROSTER_VERSION && snapshot->header.numGames == MAX_GAMES
+        && snapshot->header.gameSize == sizeof(struct TTT_Game)) {
+        memcpy(roster, snapshot->games, sizeof(snapshot->games));
+        printf("[+]Took over %d game(s) from the running server.\n", check_game_roster(roster));
+    } else {
+        print_error("take_over_server: Running server has a different roster layout. Games were not taken over", 0, 0);
+    }
+    /* Acknowledge the handoff so the running server can exit */
+    if (send(conn, &ack, sizeof(ack), 0) != sizeof(ack)) print_error("take_over_server: send", errno, 1);
+    printf("[+]Server socket taken over successfully.\n");
+    close(conn);
+    free(snapshot);
+    return sd;
 }
 
 /**
- * @brief Initializes the starting state of each game of TicTacToe in the current game roster.
+ * @brief Hands the server off to a newly started server binary. The bound server socket and a
+ * snapshot of the game roster are passed to the new server, and once it acknowledges the handoff
+ * this process exits, leaving any queued datagrams in the shared socket for the new server. If the
+ * handoff fails, this server continues to run.
  * 
+ * @param sd The socket descriptor of the server comminication endpoint.
+ * @param upgradeSd The socket descriptor listening for upgrade requests.
  * @param roster The array of playable TicTacToe games.
  */
-void init_game_roster(struct TTT_Game roster[MAX_GAMES]) {
-    int i;
-    printf("[+]Initializing shared game states.\n");
-    /* Iterates over all games */
-    for (i = 0;  i < MAX_GAMES; i++) {
-        struct TTT_Game *game = &roster[i];
-        /* Initialize current game attributes to default values */
-        reset_game(game);
-        /* Set current game number */
-        game->gameNum = i+1;
+void hand_off_server(int sd, int upgradeSd, struct TTT_Game roster[MAX_GAMES]) {
+    int conn;
+    char control[CMSG_SPACE(sizeof(int))] = {0}, ack = 0;
+    struct Game_Roster *snapshot = (struct Game_Roster *)((uintptr_t)roster - offsetof(struct Game_Roster, games));
+    struct iovec iov = {snapshot, sizeof(struct Game_Roster)};
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    struct pollfd reply;
+    /* Accept the upgrade request from the new server */
+    if ((conn = accept(upgradeSd, NULL, NULL)) == -1) {
+        print_error("hand_off_server: accept", errno, 0);
+        return;
+    }
+    printf("[+]New server binary requested a handoff.\n");
+    /* Send the server socket along with the snapshot of the (sealed) game roster */
+    seal_game_roster(roster);
+    snapshot->header.version = ROSTER_VERSION;
+    snapshot->header.numGames = MAX_GAMES;
+    snapshot->header.gameSize = sizeof(struct TTT_Game);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &sd, sizeof(int));
+    if (sendmsg(conn, &msg, 0) != sizeof(struct Game_Roster)) {
+        print_error("hand_off_server: sendmsg", errno, 0);
+        close(conn);
+        return;
+    }
+    /* Wait for the new server to acknowledge that it has taken over */
+    reply.fd = conn;
+    reply.events = POLLIN;
+    if (poll(&reply, 1, HANDOFF_TIMEOUT) == 1 && recv(conn, &ack, sizeof(ack), 0) == sizeof(ack) && ack) {
+        printf("[+]Server handed off to the new binary. Exiting.\n");
+        close_history(&history);
+        exit(EXIT_SUCCESS);
     }
+    print_error("hand_off_server: New server did not acknowledge the handoff. Continuing to serve", 0, 0);
+    close(conn);
 }
 
 /**
- * @brief Determines how many games are currently being played.
+ * @brief Waits until a command is ready to be received or the server times out. Moves found by
+ * the search thread pool in the meantime are sent, and if a new server binary requests a handoff,
+ * the server is handed off to it once the searches in flight have finished. Transports that can't
+ * be polled on their socket wait through their own hook (they have no upgrade socket or search
+ * threads to wait on as well).
  * 
- * @param numWaiting The number of game to return that are in progress, are finished, and are
- * waiting to be reset.
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param upgradeSd The socket descriptor listening for upgrade requests, or -1 if disabled.
  * @param roster The array of playable TicTacToe games.
- * @return The number of games currently being played. 
+ * @return True if a command is ready to be received, false if the server has timed out.
  */
-int games_in_progress(int *numWaiting, struct TTT_Game roster[MAX_GAMES]) {
-    int i, count = 0;
-    *numWaiting = 0;
-    /* Searches over all games */
-    for (i = 0; i < MAX_GAMES; i++) {
-        struct TTT_Game *game = &roster[i];
-        /* Check if current game still in default state or has been started */
-        if (game->seqNum > 0) {
-            /* If game is in grace period after sending GAME_OVER, increment numWaiting */
-            if (game->lastSent.command == GAME_OVER && game->timeout > 0) (*numWaiting)++;
-            /* Increment number of games in progress */
-            count++;
+int wait_for_command(struct Transport *transport, int upgradeSd, struct TTT_Game roster[MAX_GAMES]) {
+    struct pollfd fds[3] = {{transport->sd, POLLIN, 0}, {upgradeSd, POLLIN, 0}, {searchPool.event, POLLIN, 0}};
+    double remaining, deadline = get_time() + SERVER_TIMEOUT;
+    int rv;
+    /* Wait for either socket or a finished search (a request for the server stats is not a timeout) */
+    while ((remaining = deadline - get_time()) > 0) {
+        double due = next_resend_due();
+        /* Wake up in time for the next scheduled resend */
+        if (due > 0 && due - get_time() < remaining) remaining = (due > get_time()) ? due - get_time() : 0;
+        rv = (transport->wait != NULL) ? transport->wait(transport, remaining) : poll(fds, 3, (int)(remaining * 1000) + 1);
+        if (rv == 0) {
+            if (due == 0) break;
+            send_due_resends(transport, roster);
+            continue;
+        }
+        if (rv == -1) {
+            if (errno != EINTR) break;
+            if (statsRequested) print_server_stats();
+            continue;
         }
+        if (transport->wait != NULL || fds[0].revents) return 1;
+        if (fds[1].revents) {
+            wait_for_searches(transport, roster);
+            hand_off_server(transport->sd, upgradeSd, roster);
+        }
+        if (fds[2].revents) collect_searches(transport, roster);
     }
-    return count;
+    return 0;
 }
 
 /**
- * @brief Finds an open game of TicTacToe to play if one is available.
+ * @brief Spins on the server socket until a command is ready to be received or the server times
+ * out, instead of sleeping in the kernel. The game timers are run and moves found by the search
+ * thread pool are sent between polls, and if a new server binary requests a handoff in the
+ * meantime, the server is handed off to it.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param upgradeSd The socket descriptor listening for upgrade requests, or -1 if disabled.
+ * @param roster The array of playable TicTacToe games.
+ * @param clock The time the game timeout clocks were last updated, advanced as the timers run.
+ * @return True if a command is ready to be received, false if the server has timed out.
+ */
+int busy_wait_for_command(struct Transport *transport, int upgradeSd, struct TTT_Game roster[MAX_GAMES], double *clock) {
+    double now, start = get_time();
+    struct pollfd fds[3] = {{transport->sd, POLLIN, 0}, {upgradeSd, POLLIN, 0}, {searchPool.event, POLLIN, 0}};
+    /* Poll both sockets and the search pool without sleeping until the server times out */
+    while ((now = get_time()) - start < SERVER_TIMEOUT) {
+        if (poll(fds, 3, 0) > 0) {
+            if (fds[0].revents) return 1;
+            if (fds[1].revents) {
+                wait_for_searches(transport, roster);
+                hand_off_server(transport->sd, upgradeSd, roster);
+            }
+            if (fds[2].revents) collect_searches(transport, roster);
+        }
+        /* Send the scheduled resends as they come due */
+        if (next_resend_due() > 0 && next_resend_due() <= now) send_due_resends(transport, roster);
+        /* Run the game timers between polls */
+        if (now - *clock >= BUSY_TIMER_INTERVAL) {
+            update_game_clocks(roster, now - *clock);
+            *clock = now;
+            check_timeout(transport, roster);
+            seal_game_roster(roster);
+        }
+        if (statsRequested) print_server_stats();
+    }
+    return 0;
+}
+
+/**
+ * @brief Sets up the server socket for busy polling. The socket is made non-blocking, the process
+ * is pinned to the configured CPU core, and SO_BUSY_POLL is set if a budget was given. Failing to
+ * pin the process or set SO_BUSY_POLL (which may need CAP_NET_ADMIN) is not fatal.
+ * 
+ * @param sd The socket descriptor of the server comminication endpoint.
+ */
+void set_busy_poll(int sd) {
+    cpu_set_t cpus;
+    /* Make the socket non-blocking so receives never sleep */
+    if (fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK) == -1) print_error("set_busy_poll: fcntl", errno, 1);
+    /* Pin the process to its core */
+    if (options.cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(options.cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) == -1) print_error("set_busy_poll: sched_setaffinity", errno, 0);
+    }
+    /* Let the kernel busy-poll the device queue on receives */
+    if (options.busyPollBudget > 0 && setsockopt(sd, SOL_SOCKET, SO_BUSY_POLL, &options.busyPollBudget, sizeof(int)) == -1) {
+        print_error("set_busy_poll: setsockopt SO_BUSY_POLL", errno, 0);
+    }
+    if (options.cpu >= 0) printf("[+]Busy polling the server socket on CPU %d.\n", options.cpu);
+    else printf("[+]Busy polling the server socket.\n");
+}
+
+/**
+ * @brief Sets up a transport that carries commands directly over a UDP socket.
+ * 
+ * @param transport The transport to set up.
+ * @param sd The socket descriptor of the server comminication endpoint.
+ */
+void init_udp_transport(struct Transport *transport, int sd) {
+    transport->name = "udp";
+    transport->sd = sd;
+    transport->pace = 1;
+    transport->validated = 0;
+    transport->state = NULL;
+    transport->send = udp_send;
+    transport->receive = udp_receive;
+    transport->ready = udp_ready;
+    transport->wait = NULL;
+}
+
+/**
+ * @brief Sends a datagram to a remote player over the UDP socket of the transport.
+ * 
+ * @param transport The UDP transport.
+ * @param data The datagram to send.
+ * @param length The number of bytes in the datagram.
+ * @param dest The address to send the datagram to.
+ * @return The number of bytes sent, or -1 if an error occured.
+ */
+int udp_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest) {
+    return sendto(transport->sd, data, length, 0, (struct sockaddr *)dest, sizeof(struct sockaddr_in));
+}
+
+/**
+ * @brief Receives a datagram from the UDP socket of the transport.
+ * 
+ * @param transport The UDP transport.
+ * @param msg The message header to store the sender address, datagram and ancillary data in.
+ * @return The number of bytes received, or -1 if an error occured (errno is EAGAIN if the server
+ * timed out).
+ */
+int udp_receive(struct Transport *transport, struct msghdr *msg) {
+    return recvmsg(transport->sd, msg, 0);
+}
+
+/**
+ * @brief Checks whether a datagram is waiting in the UDP socket of the transport.
+ * 
+ * @param transport The UDP transport.
+ * @return True if a datagram can be received without waiting.
+ */
+int udp_ready(struct Transport *transport) {
+    struct pollfd pfd = {transport->sd, POLLIN, 0};
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/**
+ * @brief Sets up a transport that carries commands over a UDP socket through the io_uring
+ * backend. If any errors are found, the function terminates the process.
+ * 
+ * @param transport The transport to set up.
+ * @param sd The socket descriptor of the server comminication endpoint.
+ */
+void init_uring_transport(struct Transport *transport, int sd) {
+#ifdef USE_IO_URING
+    transport->name = "io_uring";
+    transport->sd = sd;
+    transport->pace = 1;
+    transport->validated = 0;
+    transport->state = uring_create(sd);
+    transport->send = uring_transport_send;
+    transport->receive = uring_transport_receive;
+    transport->ready = NULL;    // completions are only reaped while waiting
+    transport->wait = uring_transport_wait;
+#else
+    print_error("init_uring_transport: Server built without the io_uring backend", 0, 1);
+#endif
+}
+
+/**
+ * @brief Queues a datagram to a remote player on the io_uring of the transport.
+ * 
+ * @param transport The io_uring transport.
+ * @param data The datagram to send.
+ * @param length The number of bytes in the datagram.
+ * @param dest The address to send the datagram to.
+ * @return The number of bytes queued (or sent), or -1 if an error occured.
+ */
+int uring_transport_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest) {
+    return uring_send(transport->state, data, length, dest);
+}
+
+/**
+ * @brief Receives a datagram through the io_uring of the transport.
+ * 
+ * @param transport The io_uring transport.
+ * @param msg The message header to store the sender address, datagram and ancillary data in.
+ * @return The number of bytes received, or -1 if an error occured (errno is EAGAIN if the server
+ * timed out).
+ */
+int uring_transport_receive(struct Transport *transport, struct msghdr *msg) {
+    return uring_receive(transport->state, msg);
+}
+
+/**
+ * @brief Waits for a datagram to complete on the io_uring of the transport.
+ * 
+ * @param transport The io_uring transport.
+ * @param timeout The number of seconds to wait for at most.
+ * @return 1 if a datagram can be received without waiting, 0 if none arrived in time, or -1 if an
+ * error occured.
+ */
+int uring_transport_wait(struct Transport *transport, double timeout) {
+    return uring_wait(transport->state, timeout);
+}
+
+/**
+ * @brief Sets up a transport that carries commands through a pair of in-memory queues, so the
+ * server can be embedded in (and driven by) another program without any sockets.
+ * 
+ * @param transport The transport to set up.
+ * @param memory The (zeroed) queues of the transport.
+ */
+void init_memory_transport(struct Transport *transport, struct Memory_Transport *memory) {
+    transport->name = "memory";
+    transport->sd = -1;
+    transport->pace = 0;
+    transport->validated = 0;
+    transport->state = memory;
+    transport->send = memory_send;
+    transport->receive = memory_receive;
+    transport->ready = memory_ready;
+    transport->wait = NULL;
+}
+
+/**
+ * @brief Sends a reply to a remote player by adding it to the outbox of an in-memory transport.
+ * 
+ * @param transport The in-memory transport.
+ * @param data The datagram to send.
+ * @param length The number of bytes in the datagram.
+ * @param dest The address to send the datagram to.
+ * @return The number of bytes sent, or -1 if the outbox is full (errno is ENOBUFS).
+ */
+int memory_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest) {
+    struct Memory_Transport *memory = transport->state;
+    struct Memory_Datagram *reply;
+    if (memory->outTail - memory->outHead == MEMORY_QUEUE_SIZE) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    reply = &memory->outbox[memory->outTail++ & (MEMORY_QUEUE_SIZE-1)];
+    reply->address = *dest;
+    reply->length = (length < sizeof(reply->datagram)) ? length : sizeof(reply->datagram);
+    memcpy(&reply->datagram, data, reply->length);
+    return reply->length;
+}
+
+/**
+ * @brief Receives the next command from the inbox of an in-memory transport. The transport never
+ * waits, so an empty inbox times out the server right away.
+ * 
+ * @param transport The in-memory transport.
+ * @param msg The message header to store the sender address and (scattered) datagram in.
+ * @return The number of bytes received, or -1 if the inbox is empty (errno is EAGAIN).
+ */
+int memory_receive(struct Transport *transport, struct msghdr *msg) {
+    struct Memory_Transport *memory = transport->state;
+    struct Memory_Datagram *command;
+    if (memory->inHead == memory->inTail) {
+        errno = EAGAIN;
+        return -1;
+    }
+    command = &memory->inbox[memory->inHead++ & (MEMORY_QUEUE_SIZE-1)];
+    return scatter_datagram(msg, &command->address, &command->datagram, command->length);
+}
+
+/**
+ * @brief Checks whether a command is waiting in the inbox of an in-memory transport.
+ * 
+ * @param transport The in-memory transport.
+ * @return True if a command can be received without waiting.
+ */
+int memory_ready(struct Transport *transport) {
+    struct Memory_Transport *memory = transport->state;
+    return memory->inHead != memory->inTail;
+}
+
+/**
+ * @brief Adds a command from a remote player to the inbox of an in-memory transport.
+ * 
+ * @param memory The queues of the in-memory transport.
+ * @param playerAddr The address of the remote player.
+ * @param data The datagram containing the command.
+ * @param length The number of bytes in the datagram.
+ * @return The number of bytes added, or -1 if the inbox is full.
+ */
+int memory_push(struct Memory_Transport *memory, const struct sockaddr_in *playerAddr, const void *data, size_t length) {
+    struct Memory_Datagram *command;
+    if (memory->inTail - memory->inHead == MEMORY_QUEUE_SIZE) return -1;
+    command = &memory->inbox[memory->inTail++ & (MEMORY_QUEUE_SIZE-1)];
+    command->address = *playerAddr;
+    command->length = (length < sizeof(command->datagram)) ? length : sizeof(command->datagram);
+    memcpy(&command->datagram, data, command->length);
+    return command->length;
+}
+
+/**
+ * @brief Removes the oldest reply from the outbox of an in-memory transport.
+ * 
+ * @param memory The queues of the in-memory transport.
+ * @param reply The reply removed (with the address of the remote player it was sent to).
+ * @return True if there was a reply to remove, false if the outbox is empty.
+ */
+int memory_pop(struct Memory_Transport *memory, struct Memory_Datagram *reply) {
+    if (memory->outHead == memory->outTail) return 0;
+    *reply = memory->outbox[memory->outHead++ & (MEMORY_QUEUE_SIZE-1)];
+    return 1;
+}
+
+/**
+ * @brief Copies a datagram received without a socket into a message header like recvmsg() would,
+ * storing the sender address and scattering the datagram over the I/O vectors. No ancillary data
+ * is returned.
+ * 
+ * @param msg The message header to store the sender address and datagram in.
+ * @param address The address of the remote player that sent the datagram.
+ * @param data The datagram.
+ * @param length The number of bytes in the datagram.
+ * @return The number of bytes copied into the I/O vectors.
+ */
+int scatter_datagram(struct msghdr *msg, const struct sockaddr_in *address, const void *data, size_t length) {
+    size_t copied = 0;
+    int i;
+    memcpy(msg->msg_name, address, sizeof(struct sockaddr_in));
+    for (i = 0; i < msg->msg_iovlen && copied < length; i++) {
+        size_t part = (length - copied < msg->msg_iov[i].iov_len) ? length - copied : msg->msg_iov[i].iov_len;
+        memcpy(msg->msg_iov[i].iov_base, (const char *)data + copied, part);
+        copied += part;
+    }
+    msg->msg_controllen = 0;
+    return copied;
+}
+
+/**
+ * @brief Sets up a transport that discards every reply and never receives a command, for driving
+ * the command handlers directly (the replies sent are still kept as each game's last sent command).
+ * 
+ * @param transport The transport to set up.
+ */
+void init_null_transport(struct Transport *transport) {
+    transport->name = "null";
+    transport->sd = -1;
+    transport->pace = 0;
+    transport->validated = 0;
+    transport->state = NULL;
+    transport->send = null_send;
+    transport->receive = null_receive;
+    transport->ready = null_ready;
+    transport->wait = NULL;
+}
+
+/**
+ * @brief Sends a reply to a remote player through the null transport, discarding it.
+ * 
+ * @param transport The null transport.
+ * @param data The datagram to send.
+ * @param length The number of bytes in the datagram.
+ * @param dest The address of the remote player.
+ * @return The number of bytes "sent".
+ */
+int null_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest) {
+    return length;
+}
+
+/**
+ * @brief Receives a command through the null transport, which never has one.
+ * 
+ * @param transport The null transport.
+ * @param msg The message header to fill in.
+ * @return -1 with errno set to EAGAIN.
+ */
+int null_receive(struct Transport *transport, struct msghdr *msg) {
+    errno = EAGAIN;
+    return -1;
+}
+
+/**
+ * @brief Checks whether the null transport has a command waiting, which it never does.
+ * 
+ * @param transport The null transport.
+ * @return False.
+ */
+int null_ready(struct Transport *transport) {
+    return 0;
+}
+
+/**
+ * @brief Sets up a transport that carries the commands of clients on the same host through
+ * shared memory, alongside the remote players on the UDP socket. Clients connect to a UNIX
+ * socket and are handed a memfd holding their pair of rings, so no system calls are made per
+ * command while both sides are busy. If any errors are found, the function terminates the process.
+ * 
+ * @param transport The transport to set up.
+ * @param sd The socket descriptor of the server comminication endpoint.
+ * @param path The path of the UNIX socket co-located clients connect to.
+ */
+void init_shm_transport(struct Transport *transport, int sd, const char *path) {
+    struct Shm_Transport *shm = calloc(1, sizeof(struct Shm_Transport));
+    struct sockaddr_un shmAddr = {0};
+    shmAddr.sun_family = AF_UNIX;
+    strncpy(shmAddr.sun_path, path, sizeof(shmAddr.sun_path)-1);
+    if (shm == NULL) print_error("init_shm_transport: calloc", errno, 1);
+    /* Create the eventfd the clients wake the server through */
+    if ((shm->event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) print_error("init_shm_transport: eventfd", errno, 1);
+    /* Create socket (replacing the one left by a previous server, if any) and listen for clients */
+    if ((shm->listenSd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) print_error("init_shm_transport: socket", errno, 1);
+    unlink(path);
+    if (bind(shm->listenSd, (struct sockaddr *)&shmAddr, sizeof(shmAddr)) == -1) print_error("init_shm_transport: bind", errno, 1);
+    if (listen(shm->listenSd, SHM_MAX_CLIENTS) == -1) print_error("init_shm_transport: listen", errno, 1);
+    transport->name = "shm";
+    transport->sd = sd;
+    transport->pace = 1;
+    transport->validated = 0;
+    transport->state = shm;
+    transport->send = shm_send;
+    transport->receive = shm_receive;
+    transport->ready = shm_transport_ready;
+    transport->wait = shm_transport_wait;
+    printf("[+]Listening for co-located clients at %s.\n", path);
+}
+
+/**
+ * @brief Accepts a co-located client on the shared-memory transport. The client is given a memfd
+ * holding its rings, the eventfd it wakes the server through, and the eventfd it sleeps on
+ * (SCM_RIGHTS), and is known in the games by a synthetic 0.x.x.x address that no UDP datagram
+ * can come from. Errors only turn the client away.
+ * 
+ * @param shm The shared-memory transport.
+ */
+void shm_accept_client(struct Shm_Transport *shm) {
+    int conn, memFd, i, fds[3];
+    char control[CMSG_SPACE(sizeof(fds))] = {0}, hello = 1;
+    struct iovec iov = {&hello, sizeof(hello)};
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    struct Shm_Client *client = NULL;
+    if ((conn = accept4(shm->listenSd, NULL, NULL, SOCK_CLOEXEC)) == -1) {
+        print_error("shm_accept_client: accept", errno, 0);
+        return;
+    }
+    /* Find a free slot for the client */
+    for (i = 0; i < SHM_MAX_CLIENTS && client == NULL; i++) {
+        if (shm->clients[i].channel == NULL) client = &shm->clients[i];
+    }
+    if (client == NULL) {
+        print_error("shm_accept_client: Too many co-located clients. Client turned away", 0, 0);
+        close(conn);
+        return;
+    }
+    /* Create the shared rings and the eventfd the client sleeps on */
+    if ((memFd = memfd_create("tictactoe-shm", MFD_CLOEXEC)) == -1 || ftruncate(memFd, sizeof(struct Shm_Channel)) == -1) {
+        print_error("shm_accept_client: memfd_create", errno, 0);
+        if (memFd != -1) close(memFd);
+        close(conn);
+        return;
+    }
+    client->channel = mmap(NULL, sizeof(struct Shm_Channel), PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    client->event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (client->channel == MAP_FAILED || client->event == -1) {
+        print_error("shm_accept_client: mmap/eventfd", errno, 0);
+        if (client->channel != MAP_FAILED) munmap(client->channel, sizeof(struct Shm_Channel));
+        if (client->event != -1) close(client->event);
+        client->channel = NULL;
+        close(memFd);
+        close(conn);
+        return;
+    }
+    client->conn = conn;
+    /* Pass the rings and both eventfds to the client */
+    fds[0] = memFd;
+    fds[1] = shm->event;
+    fds[2] = client->event;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(conn, &msg, MSG_NOSIGNAL) != sizeof(hello)) {
+        print_error("shm_accept_client: sendmsg", errno, 0);
+        shm_drop_client(client);
+        close(memFd);
+        return;
+    }
+    close(memFd);
+    /* Give the client a unique address to be known by in the games */
+    shm->connections++;
+    client->address.sin_family = AF_INET;
+    client->address.sin_addr.s_addr = htonl(((shm->connections - 1) % 0xFFFFFF) + 1);
+    client->address.sin_port = htons(client - shm->clients);
+    printf("[+]Co-located client connected through shared memory as %s.\n", inet_ntoa(client->address.sin_addr));
+}
+
+/**
+ * @brief Disconnects a co-located client from the shared-memory transport, freeing its slot. Any
+ * game it was playing times out like that of a remote player who left.
+ * 
+ * @param client The client to disconnect.
+ */
+void shm_drop_client(struct Shm_Client *client) {
+    munmap(client->channel, sizeof(struct Shm_Channel));
+    close(client->event);
+    close(client->conn);
+    client->channel = NULL;
+}
+
+/**
+ * @brief Sends a datagram to a remote player, through the rings of a co-located client if the
+ * destination is one of their synthetic addresses, or over the UDP socket otherwise.
+ * 
+ * @param transport The shared-memory transport.
+ * @param data The datagram to send.
+ * @param length The number of bytes in the datagram.
+ * @param dest The address to send the datagram to.
+ * @return The number of bytes sent, or -1 if an error occured (errno is ENOTCONN if the client has
+ * disconnected, or ENOBUFS if its ring is full).
+ */
+int shm_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest) {
+    struct Shm_Transport *shm = transport->state;
+    struct Shm_Client *client;
+    unsigned slot = ntohs(dest->sin_port);
+    /* Send to remote players over the socket */
+    if ((ntohl(dest->sin_addr.s_addr) >> 24) != 0) return udp_send(transport, data, length, dest);
+    /* Push the datagram into the ring of the co-located client (waking it if it is asleep) */
+    client = &shm->clients[slot % SHM_MAX_CLIENTS];
+    if (slot >= SHM_MAX_CLIENTS || client->channel == NULL || !same_address(&client->address, dest)) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    if (shm_push(&client->channel->toClient, client->event, data, length) == -1) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    return length;
+}
+
+/**
+ * @brief Checks whether a command is waiting in the rings of any co-located client or in the UDP
+ * socket of the shared-memory transport.
+ * 
+ * @param transport The shared-memory transport.
+ * @return True if a command can be received without waiting.
+ */
+int shm_transport_ready(struct Transport *transport) {
+    struct Shm_Transport *shm = transport->state;
+    struct pollfd pfd = {transport->sd, POLLIN, 0};
+    int i;
+    for (i = 0; i < SHM_MAX_CLIENTS; i++) {
+        if (shm->clients[i].channel != NULL && shm_ready(&shm->clients[i].channel->toServer)) return 1;
+    }
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/**
+ * @brief Takes the next command from the rings of the co-located clients, checking them in
+ * round-robin order so no client can starve the others.
+ * 
+ * @param shm The shared-memory transport.
+ * @param msg The message header to store the sender address and datagram in.
+ * @return The number of bytes received, or -1 if every ring is empty.
+ */
+int shm_pop_command(struct Shm_Transport *shm, struct msghdr *msg) {
+    struct Cookie_Buffer command;
+    int i, rv;
+    for (i = 0; i < SHM_MAX_CLIENTS; i++) {
+        struct Shm_Client *client = &shm->clients[(shm->next + i) % SHM_MAX_CLIENTS];
+        if (client->channel != NULL && (rv = shm_pop(&client->channel->toServer, &command, sizeof(command))) != -1) {
+            shm->next = (shm->next + i + 1) % SHM_MAX_CLIENTS;
+            return scatter_datagram(msg, &client->address, &command, rv);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Receives the next command from either the co-located clients or the UDP socket. The UDP
+ * socket is checked at least every few commands so remote players aren't starved. When nothing
+ * is waiting, the server goes to sleep in shm_transport_wait() until a command arrives or the
+ * server times out.
+ * 
+ * @param transport The shared-memory transport.
+ * @param msg The message header to store the sender address, datagram and ancillary data in.
+ * @return The number of bytes received, or -1 if an error occured (errno is EAGAIN if the server
+ * timed out).
+ */
+int shm_receive(struct Transport *transport, struct msghdr *msg) {
+    struct Shm_Transport *shm = transport->state;
+    double start = get_time(), remaining;
+    int rv;
+    while (1) {
+        /* Take a command from shared memory unless the socket is due to be checked */
+        if (shm->sinceUdp < SHM_UDP_INTERVAL && (rv = shm_pop_command(shm, msg)) != -1) {
+            shm->sinceUdp++;
+            return rv;
+        }
+        shm->sinceUdp = 0;
+        if ((rv = recvmsg(transport->sd, msg, MSG_DONTWAIT)) != -1 || (errno != EAGAIN && errno != EWOULDBLOCK)) return rv;
+        if ((rv = shm_pop_command(shm, msg)) != -1) return rv;
+        /* Nothing is waiting, so sleep until something is or the server times out */
+        if ((remaining = SERVER_TIMEOUT - (get_time() - start)) <= 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (shm_transport_wait(transport, remaining) == -1) return -1;
+    }
+}
+
+/**
+ * @brief Waits until a command is waiting in the rings of a co-located client or in the UDP
+ * socket. The clients are told to wake the server through its eventfd while it sleeps, and new
+ * clients are accepted and those who hung up are disconnected as they are seen.
+ * 
+ * @param transport The shared-memory transport.
+ * @param timeout The number of seconds to wait for at most.
+ * @return 1 if a command can be received without waiting, 0 if none arrived in time, or -1 if an
+ * error occured.
+ */
+int shm_transport_wait(struct Transport *transport, double timeout) {
+    struct Shm_Transport *shm = transport->state;
+    struct pollfd fds[SHM_MAX_CLIENTS + 3];
+    int owners[SHM_MAX_CLIENTS];
+    double remaining, deadline = get_time() + timeout;
+    uint64_t count;
+    int i, rv, numFds;
+    while (!shm_transport_ready(transport)) {
+        if ((remaining = deadline - get_time()) <= 0) return 0;
+        /* Tell the clients to wake the server and check the rings once more */
+        for (i = 0; i < SHM_MAX_CLIENTS; i++) {
+            if (shm->clients[i].channel != NULL) shm_set_sleeping(&shm->clients[i].channel->toServer, 1);
+        }
+        fds[0] = (struct pollfd){transport->sd, POLLIN, 0};
+        fds[1] = (struct pollfd){shm->event, POLLIN, 0};
+        fds[2] = (struct pollfd){shm->listenSd, POLLIN, 0};
+        for (i = 0, numFds = 3; i < SHM_MAX_CLIENTS; i++) {
+            if (shm->clients[i].channel == NULL) continue;
+            if (shm_ready(&shm->clients[i].channel->toServer)) fds[1].revents = POLLIN;
+            owners[numFds - 3] = i;
+            fds[numFds++] = (struct pollfd){shm->clients[i].conn, POLLIN, 0};
+        }
+        /* Sleep unless a command arrived while the flags were being set */
+        rv = (fds[1].revents) ? 0 : poll(fds, numFds, (int)(remaining * 1000) + 1);
+        for (i = 0; i < SHM_MAX_CLIENTS; i++) {
+            if (shm->clients[i].channel != NULL) shm_set_sleeping(&shm->clients[i].channel->toServer, 0);
+        }
+        if (rv == -1) return -1;
+        /* Clear the wakeups, accept new clients and disconnect those who hung up */
+        if (fds[1].revents && read(shm->event, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+            print_error("shm_transport_wait: read", errno, 0);
+        }
+        if (fds[2].revents) shm_accept_client(shm);
+        for (i = 3; i < numFds; i++) {
+            if (fds[i].revents) {
+                printf("[+]Co-located client %s disconnected.\n", inet_ntoa(shm->clients[owners[i - 3]].address.sin_addr));
+                shm_drop_client(&shm->clients[owners[i - 3]]);
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Echoes datagrams through a shared-memory channel until an empty datagram is received,
+ * waiting for each one like a co-located client does.
+ * 
+ * @param arg Pointer to the shared-memory transport, with the channel as its first client.
+ * @return NULL.
+ */
+void *echo_shm(void *arg) {
+    struct Shm_Transport *shm = arg;
+    struct Shm_Client *client = &shm->clients[0];
+    struct Buffer datagram;
+    int rv, spins = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? SHM_SPINS : 0;
+    while (1) {
+        if (!shm_wait(&client->channel->toServer, shm->event, spins, -1)) continue;
+        if ((rv = shm_pop(&client->channel->toServer, &datagram, sizeof(datagram))) <= 0) break;
+        shm_push(&client->channel->toClient, client->event, &datagram, rv);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Compares the round-trip latency of a command between two threads over loopback UDP
+ * (sleeping in recvmsg()) and through a shared-memory channel (spinning briefly before sleeping
+ * on an eventfd when there is more than one CPU), reporting the p50/p99/p99.9 reply times of each.
+ */
+void bench_shm(void) {
+    int mode, i, sds[2];
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    struct sockaddr_in addrs[2] = {{0}};
+    socklen_t addrLength = sizeof(struct sockaddr_in);
+    static struct Shm_Transport shm;
+    struct Shm_Client *client = &shm.clients[0];
+    static double samples[BENCH_ROUND_TRIPS];
+    for (mode = 0; mode < 2; mode++) {
+        pthread_t server;
+        /* Create the loopback sockets or the shared channel, and start the echoing server */
+        if (mode == 0) {
+            for (i = 0; i < 2; i++) {
+                addrs[i].sin_family = AF_INET;
+                addrs[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                if ((sds[i] = socket(AF_INET, SOCK_DGRAM, 0)) == -1 || bind(sds[i], (struct sockaddr *)&addrs[i], addrLength) == -1) {
+                    print_error("bench_shm: socket", errno, 1);
+                }
+                getsockname(sds[i], (struct sockaddr *)&addrs[i], &addrLength);
+            }
+            options.busyPoll = 0;
+            pthread_create(&server, NULL, echo_datagrams, &sds[0]);
+        } else {
+            client->channel = mmap(NULL, sizeof(struct Shm_Channel), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            shm.event = eventfd(0, EFD_NONBLOCK);
+            client->event = eventfd(0, EFD_NONBLOCK);
+            if (client->channel == MAP_FAILED || shm.event == -1 || client->event == -1) print_error("bench_shm: mmap/eventfd", errno, 1);
+            pthread_create(&server, NULL, echo_shm, &shm);
+        }
+        /* Time each round trip of a command */
+        for (i = 0; i < BENCH_ROUND_TRIPS; i++) {
+            struct Buffer datagram = {VERSION, 1, MOVE, '5', 1};
+            double start = get_time();
+            if (mode == 0) {
+                sendto(sds[1], &datagram, sizeof(datagram), 0, (struct sockaddr *)&addrs[0], addrLength);
+                recv(sds[1], &datagram, sizeof(datagram), 0);
+            } else {
+                shm_push(&client->channel->toServer, shm.event, &datagram, sizeof(datagram));
+                while (!shm_wait(&client->channel->toClient, client->event, (ncpus > 1) ? SHM_SPINS : 0, -1));
+                shm_pop(&client->channel->toClient, &datagram, sizeof(datagram));
+            }
+            samples[i] = (get_time() - start) * 1e6;
+        }
+        /* Stop the server and report the percentiles */
+        if (mode == 0) {
+            sendto(sds[1], NULL, 0, 0, (struct sockaddr *)&addrs[0], addrLength);
+            pthread_join(server, NULL);
+            close(sds[0]);
+            close(sds[1]);
+        } else {
+            shm_push(&client->channel->toServer, shm.event, NULL, 0);
+            pthread_join(server, NULL);
+            munmap(client->channel, sizeof(struct Shm_Channel));
+            close(shm.event);
+            close(client->event);
+        }
+        qsort(samples, BENCH_ROUND_TRIPS, sizeof(double), compare_doubles);
+        printf("shm: %-6s p50 %.1f us, p99 %.1f us, p99.9 %.1f us (%ld CPUs)\n", mode ? "shm" : "udp",
+            samples[BENCH_ROUND_TRIPS/2], samples[BENCH_ROUND_TRIPS*99/100], samples[BENCH_ROUND_TRIPS*999/1000], ncpus);
+    }
+}
+
+/**
+ * @brief Benchmarks the game logic apart from any sockets by playing games through an in-memory
+ * transport, with a scripted player answering each of the server's moves with a random legal
+ * move. The server output is discarded while the games are played.
+ */
+void bench_engine(void) {
+    int g, stdoutFd;
+    unsigned seed = 1;
+    unsigned long commands = 0;
+    double start, elapsed;
+    struct Memory_Transport *memory = calloc(1, sizeof(struct Memory_Transport));
+    struct TTT_Game *roster = map_game_roster(NULL), board = {0};
+    struct Transport transport;
+    if (memory == NULL) print_error("bench_engine: calloc", errno, 1);
+    init_memory_transport(&transport, memory);
+    /* Discard the server output */
+    fflush(stdout);
+    stdoutFd = dup(STDOUT_FILENO);
+    if (freopen("/dev/null", "w", stdout) == NULL) print_error("bench_engine: freopen", errno, 1);
+    start = get_time();
+    for (g = 0; g < BENCH_GAMES; g++) {
+        struct sockaddr_in playerAddr = {0};
+        struct Buffer command = {VERSION, 0, NEW_GAME, 0, 0};
+        struct Memory_Datagram reply;
+        int over = 0;
+        /* Each game is played from its own address so the rate limiter stays out of the way */
+        playerAddr.sin_family = AF_INET;
+        playerAddr.sin_addr.s_addr = htonl((10u << 24) | (g+1));
+        playerAddr.sin_port = htons(4444);
+        reset_game(&board);
+        while (1) {
+            struct sockaddr_in fromAddr;
+            struct Buffer datagram;
+            unsigned char cookie[COOKIE_SIZE];
+            int rv, move, numOpen = 0, i;
+            /* Hand the player's command to the server and take its reply */
+            memory_push(memory, &playerAddr, &command, sizeof(command));
+            if ((rv = get_command(&transport, &fromAddr, &datagram, cookie)) > 0) handle_command(&transport, roster, &fromAddr, &datagram, cookie, rv);
+            commands++;
+            if (over || !memory_pop(memory, &reply)) break;
+            /* Play the server's move, ending the game with GAME_OVER if it is over */
+            command = reply.datagram.command;
+            board.board[command.data - '1'] = P1_MARK;
+            if (check_win(&board) || check_draw(&board)) {
+                command.seqNum++;
+                command.command = GAME_OVER;
+                over = 1;
+                continue;
+            }
+            /* Otherwise answer with a random open square */
+            for (i = 0; i < sizeof(board.board); i++) numOpen += validate_move(i+1, &board);
+            for (move = 1, i = rand_r(&seed) % numOpen; !validate_move(move, &board) || i-- > 0; move++);
+            board.board[move-1] = P2_MARK;
+            command.seqNum++;
+            command.data = move + '0';
+        }
+    }
+    elapsed = get_time() - start;
+    /* Restore the server output */
+    fflush(stdout);
+    dup2(stdoutFd, STDOUT_FILENO);
+    close(stdoutFd);
+    printf("engine: %d games, %lu commands in %.3f s (%.0f games/s, %.1f us/command) over the memory transport\n",
+        BENCH_GAMES, commands, elapsed, BENCH_GAMES / elapsed, elapsed * 1e6 / commands);
+    free(memory);
+}
+
+/**
+ * @brief Benchmarks echoing batches of datagrams over loopback with recvmsg()/sendto() and with
+ * the io_uring backend, reporting the throughput and system calls per datagram of each.
+ */
+void bench_uring(void) {
+#ifdef USE_IO_URING
+    int mode, sds[2], round, i;
+    struct sockaddr_in addrs[2] = {{0}};
+    socklen_t addrLength = sizeof(struct sockaddr_in);
+    const int rounds = BENCH_ITERATIONS / 10 / BENCH_BATCH;
+    /* Create the server and client sockets on loopback */
+    for (i = 0; i < 2; i++) {
+        addrs[i].sin_family = AF_INET;
+        addrs[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if ((sds[i] = socket(AF_INET, SOCK_DGRAM, 0)) == -1 || bind(sds[i], (struct sockaddr *)&addrs[i], addrLength) == -1) {
+            print_error("bench_uring: socket", errno, 1);
+        }
+        getsockname(sds[i], (struct sockaddr *)&addrs[i], &addrLength);
+    }
+    /* Echo the same batches through each I/O path */
+    for (mode = 0; mode < 2; mode++) {
+        struct Uring_Backend *ring = (mode == 1) ? uring_create(sds[0]) : NULL;
+        unsigned long syscalls = 0;
+        double start = get_time(), elapsed;
+        for (round = 0; round < rounds; round++) {
+            struct Buffer datagram = {VERSION, 1, MOVE, '5', 1};
+            /* Client sends a batch of commands */
+            for (i = 0; i < BENCH_BATCH; i++) sendto(sds[1], &datagram, sizeof(datagram), 0, (struct sockaddr *)&addrs[0], addrLength);
+            /* Server receives each command and replies */
+            for (i = 0; i < BENCH_BATCH; i++) {
+                struct sockaddr_in playerAddr;
+                struct iovec iov = {&datagram, sizeof(datagram)};
+                struct msghdr msg = {&playerAddr, sizeof(playerAddr), &iov, 1, NULL, 0, 0};
+                if (ring != NULL) {
+                    uring_receive(ring, &msg);
+                    uring_send(ring, &datagram, sizeof(datagram), &playerAddr);
+                } else {
+                    recvmsg(sds[0], &msg, 0);
+                    sendto(sds[0], &datagram, sizeof(datagram), 0, (struct sockaddr *)&playerAddr, addrLength);
+                    syscalls += 2;
+                }
+            }
+            if (ring != NULL) uring_flush(ring);
+            /* Client receives the replies */
+            for (i = 0; i < BENCH_BATCH; i++) recv(sds[1], &datagram, sizeof(datagram), 0);
+        }
+        elapsed = get_time() - start;
+        if (ring != NULL) syscalls = ring->enters;
+        printf("uring: %-16s %d datagrams, %.0f datagrams/s, %.3f server syscalls/datagram\n", (ring != NULL) ? "io_uring" : "recvmsg/sendto",
+            rounds * BENCH_BATCH, rounds * BENCH_BATCH / elapsed, (double)syscalls / (rounds * BENCH_BATCH));
+    }
+#else
+    print_error("bench_uring: Server was built without io_uring support (build with 'make URING=1')", 0, 1);
+#endif
+}
+
+/**
+ * @brief Echoes datagrams on a socket until an empty datagram is received, waiting for each one
+ * either by sleeping in recvmsg() or by busy polling (as selected in the options).
+ * 
+ * @param arg Pointer to the socket descriptor to echo datagrams on.
+ * @return NULL.
+ */
+void *echo_datagrams(void *arg) {
+    int rv;
+    double clock = get_time();
+    struct TTT_Game *roster = map_game_roster(NULL);
+    struct Transport transport;
+    init_udp_transport(&transport, *(int *)arg);
+    while (1) {
+        struct Buffer datagram;
+        struct sockaddr_in playerAddr;
+        struct iovec iov = {&datagram, sizeof(datagram)};
+        struct msghdr msg = {&playerAddr, sizeof(playerAddr), &iov, 1, NULL, 0, 0};
+        /* Wait for the next datagram the same way the server does */
+        if (options.busyPoll && !busy_wait_for_command(&transport, -1, roster, &clock)) continue;
+        if ((rv = transport.receive(&transport, &msg)) <= 0) break;
+        transport.send(&transport, &datagram, rv, &playerAddr);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Compares the round-trip latency of a command over loopback when the server sleeps in
+ * recvmsg() and when it busy-polls its socket (pinned to the last CPU core, with the client on
+ * the first), reporting the p50/p99/p99.9 reply times of each.
+ */
+void bench_latency(void) {
+    int mode, sds[2], i;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    struct sockaddr_in addrs[2] = {{0}};
+    socklen_t addrLength = sizeof(struct sockaddr_in);
+    static double samples[BENCH_ROUND_TRIPS];
+    for (mode = 0; mode < 2; mode++) {
+        pthread_t server;
+        pthread_attr_t attr;
+        cpu_set_t cpus;
+        /* Create the server and client sockets on loopback */
+        for (i = 0; i < 2; i++) {
+            addrs[i].sin_family = AF_INET;
+            addrs[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addrs[i].sin_port = 0;
+            if ((sds[i] = socket(AF_INET, SOCK_DGRAM, 0)) == -1 || bind(sds[i], (struct sockaddr *)&addrs[i], addrLength) == -1) {
+                print_error("bench_latency: socket", errno, 1);
+            }
+            getsockname(sds[i], (struct sockaddr *)&addrs[i], &addrLength);
+        }
+        /* Start the echoing server (pinned to its own core when busy polling) */
+        options.busyPoll = mode;
+        options.cpu = (ncpus > 1) ? ncpus-1 : -1;
+        if (mode == 1) set_busy_poll(sds[0]);
+        pthread_attr_init(&attr);
+        if (options.cpu >= 0) {
+            CPU_ZERO(&cpus);
+            CPU_SET(options.cpu, &cpus);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+        }
+        pthread_create(&server, &attr, echo_datagrams, &sds[0]);
+        pthread_attr_destroy(&attr);
+        /* Pin the client (this thread) to the first core once the server no longer inherits it */
+        if (options.cpu >= 0) {
+            CPU_ZERO(&cpus);
+            CPU_SET(0, &cpus);
+            sched_setaffinity(0, sizeof(cpus), &cpus);
+        }
+        /* Time each round trip of a command */
+        for (i = 0; i < BENCH_ROUND_TRIPS; i++) {
+            struct Buffer datagram = {VERSION, 1, MOVE, '5', 1};
+            double start = get_time();
+            sendto(sds[1], &datagram, sizeof(datagram), 0, (struct sockaddr *)&addrs[0], addrLength);
+            recv(sds[1], &datagram, sizeof(datagram), 0);
+            samples[i] = (get_time() - start) * 1e6;
+        }
+        /* Stop the server and report the percentiles */
+        sendto(sds[1], NULL, 0, 0, (struct sockaddr *)&addrs[0], addrLength);
+        pthread_join(server, NULL);
+        close(sds[0]);
+        close(sds[1]);
+        qsort(samples, BENCH_ROUND_TRIPS, sizeof(double), compare_doubles);
+        printf("latency: %-14s p50 %.1f us, p99 %.1f us, p99.9 %.1f us (%ld CPUs)\n", mode ? "busy-poll" : "sleep-and-wake",
+            samples[BENCH_ROUND_TRIPS/2], samples[BENCH_ROUND_TRIPS*99/100], samples[BENCH_ROUND_TRIPS*999/1000], ncpus);
+    }
+}
+
+/**
+ * @brief Creates the queues and counters of a pipelined server, in memory that stays shared with
+ * any child processes (so a benchmark can read the counters of a server it forked). If any errors
+ * are found, the function terminates the process.
+ * 
+ * @param sd The socket descriptor of the server comminication endpoint.
+ * @return The pipeline.
+ */
+struct Pipeline *create_pipeline(int sd) {
+    struct Pipeline *newPipeline;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *names[3] = {"receive", "game", "send"};
+    int i;
+    newPipeline = mmap(NULL, sizeof(struct Pipeline), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (newPipeline == MAP_FAILED) print_error("create_pipeline: mmap", errno, 1);
+    newPipeline->sd = sd;
+    init_pipeline_queue(&newPipeline->commands);
+    init_pipeline_queue(&newPipeline->replies);
+    /* Give each stage its own core when there are enough of them */
+    for (i = 0; i < 3; i++) {
+        newPipeline->stages[i].name = names[i];
+        newPipeline->stages[i].cpu = (ncpus >= 3) ? i : -1;
+    }
+    newPipeline->stages[1].input = &newPipeline->commands;
+    newPipeline->stages[2].input = &newPipeline->replies;
+    pipeline = newPipeline;
+    return newPipeline;
+}
+
+/**
+ * @brief Runs the server as a pipeline of three stages connected by bounded lock-free queues: the
+ * receive stage reads and validates datagrams, the game stage owns the game roster and runs the
+ * command handlers (the same loop as the single-threaded server, over a transport made of the
+ * queues), and the send stage sends the replies in batches. The game stage runs on the calling
+ * thread, so this function never returns.
+ * 
+ * @param pipeline The pipeline to run.
+ * @param roster The array of playable TicTacToe games.
+ */
+void run_pipeline(struct Pipeline *pipeline, struct TTT_Game roster[MAX_GAMES]) {
+    pthread_t threads[2];
+    sigset_t signals;
+    struct Transport transport = {"pipeline", -1, 1, 1, pipeline, pipeline_transport_send, pipeline_transport_receive, pipeline_transport_ready, pipeline_transport_wait};
+    /* Start the receive and send stages with the stats signal blocked, so it interrupts the game stage */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    pipeline->start = pipeline->stages[1].since = get_time();
+    if ((errno = pthread_create(&threads[0], NULL, pipeline_receive_stage, pipeline)) != 0
+        || (errno = pthread_create(&threads[1], NULL, pipeline_send_stage, pipeline)) != 0) {
+        print_error("run_pipeline: pthread_create", errno, 1);
+    }
+    pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+    if (pipeline->stages[1].cpu >= 0) printf("[+]Running the server as a pipeline on CPUs 0-2.\n");
+    else printf("[+]Running the server as a pipeline (too few CPUs to pin its stages).\n");
+    /* Run the game stage */
+    pin_pipeline_stage(&pipeline->stages[1]);
+    tictactoe(&transport, -1, roster);
+}
+
+/**
+ * @brief Pins the calling thread to the CPU core of its pipeline stage. Failing to pin it is not
+ * fatal.
+ * 
+ * @param stage The pipeline stage run by the calling thread.
+ */
+void pin_pipeline_stage(struct Pipeline_Stage *stage) {
+    cpu_set_t cpus;
+    if (stage->cpu < 0) return;
+    CPU_ZERO(&cpus);
+    CPU_SET(stage->cpu, &cpus);
+    if ((errno = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) != 0) print_error("pin_pipeline_stage: pthread_setaffinity_np", errno, 0);
+}
+
+/**
+ * @brief Receives datagrams from the server socket, validates them and passes the commands on to
+ * the game stage, forever (the receive stage of a pipelined server).
+ * 
+ * @param arg The pipeline.
+ * @return Never returns.
+ */
+void *pipeline_receive_stage(void *arg) {
+    struct Pipeline *pipeline = arg;
+    struct Pipeline_Stage *stage = &pipeline->stages[0];
+    pin_pipeline_stage(stage);
+    while (1) {
+        struct Pipeline_Message message = {{0}};
+        struct iovec iov = {&message.datagram, sizeof(message.datagram)};
+        union {char buf[RECV_CONTROL_SIZE]; struct cmsghdr align;} control;
+        struct msghdr msg = {&message.address, sizeof(message.address), &iov, 1, control.buf, sizeof(control.buf), 0};
+        double start, busy;
+        /* Wait for the next datagram */
+        if ((message.length = recvmsg(pipeline->sd, &msg, 0)) <= 0) {
+            if (message.length == 0) __atomic_fetch_add(&stage->dropped, 1, __ATOMIC_RELAXED);
+            else if (errno != EINTR && errno != EAGAIN) print_error("pipeline_receive_stage: recvmsg", errno, 0);
+            continue;
+        }
+        start = get_time();
+        /* Account for the datagram and pass it on if it is a valid command (and there's room for it) */
+        account_datagram(pipeline->sd, &msg);
+        if (validate_command(&message.datagram.command) && pipeline_push(&pipeline->commands, &message)) {
+            __atomic_fetch_add(&stage->processed, 1, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_add(&stage->dropped, 1, __ATOMIC_RELAXED);
+        }
+        busy = stage->busy + get_time() - start;
+        __atomic_store(&stage->busy, &busy, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Takes the replies of the game stage and sends them in batches with sendmmsg(), forever
+ * (the send stage of a pipelined server).
+ * 
+ * @param arg The pipeline.
+ * @return Never returns.
+ */
+void *pipeline_send_stage(void *arg) {
+    struct Pipeline *pipeline = arg;
+    struct Pipeline_Stage *stage = &pipeline->stages[2];
+    static struct Pipeline_Message messages[PIPELINE_BATCH];
+    struct mmsghdr msgs[PIPELINE_BATCH] = {{{0}}};
+    struct iovec iovs[PIPELINE_BATCH];
+    pin_pipeline_stage(stage);
+    while (1) {
+        int i, numReplies = 0, sent;
+        double start, busy;
+        /* Wait for a reply, then take as many as are waiting (up to a batch) */
+        while (!pipeline_ready(&pipeline->replies)) pipeline_wait(&pipeline->replies, -1);
+        start = get_time();
+        while (numReplies < PIPELINE_BATCH && pipeline_pop(&pipeline->replies, &messages[numReplies])) {
+            iovs[numReplies].iov_base = &messages[numReplies].datagram;
+            iovs[numReplies].iov_len = messages[numReplies].length;
+            msgs[numReplies].msg_hdr.msg_name = &messages[numReplies].address;
+            msgs[numReplies].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs[numReplies].msg_hdr.msg_iov = &iovs[numReplies];
+            msgs[numReplies].msg_hdr.msg_iovlen = 1;
+            numReplies++;
+        }
+        /* Send the batch (skipping over any reply that can't be sent) */
+        for (i = 0; i < numReplies; i += sent) {
+            if ((sent = sendmmsg(pipeline->sd, &msgs[i], numReplies - i, 0)) <= 0) {
+                print_error("pipeline_send_stage: sendmmsg", errno, 0);
+                __atomic_fetch_add(&stage->dropped, 1, __ATOMIC_RELAXED);
+                sent = 1;
+            } else {
+                __atomic_fetch_add(&stage->processed, sent, __ATOMIC_RELAXED);
+            }
+        }
+        busy = stage->busy + get_time() - start;
+        __atomic_store(&stage->busy, &busy, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Receives the next command passed on by the receive stage of a pipelined server, waiting
+ * for the server timeout at most. The game stage only waits in here, so the time between calls is
+ * counted as busy.
+ * 
+ * @param transport The pipeline transport.
+ * @param msg The message header to store the sender address and datagram in.
+ * @return The number of bytes received, or -1 if an error occured (errno is EAGAIN if the server
+ * timed out, or EINTR if the stats were requested).
+ */
+int pipeline_transport_receive(struct Transport *transport, struct msghdr *msg) {
+    struct Pipeline *pipeline = transport->state;
+    struct Pipeline_Stage *stage = &pipeline->stages[1];
+    struct Pipeline_Message message;
+    double now = get_time(), deadline = now + SERVER_TIMEOUT;
+    int rv = 0;
+    stage->busy += now - stage->since;
+    /* Wait for a command until the server times out */
+    while (!pipeline_pop(&pipeline->commands, &message)) {
+        if ((now = get_time()) >= deadline || rv == -1) {
+            if (rv == 0) errno = EAGAIN;
+            stage->since = get_time();
+            return -1;
+        }
+        if ((rv = pipeline_wait(&pipeline->commands, (int)((deadline - now) * 1000) + 1)) == -1 && errno != EINTR) rv = 0;
+    }
+    stage->processed++;
+    stage->since = get_time();
+    return scatter_datagram(msg, &message.address, &message.datagram, message.length);
+}
+
+/**
+ * @brief Passes a reply on to the send stage of a pipelined server.
+ * 
+ * @param transport The pipeline transport.
+ * @param data The datagram to send.
+ * @param length The number of bytes in the datagram.
+ * @param dest The address to send the datagram to.
+ * @return The number of bytes passed on, or -1 if the send stage is backed up (errno is ENOBUFS).
+ */
+int pipeline_transport_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest) {
+    struct Pipeline *pipeline = transport->state;
+    struct Pipeline_Message message;
+    message.address = *dest;
+    message.length = (length < sizeof(message.datagram)) ? length : sizeof(message.datagram);
+    memcpy(&message.datagram, data, message.length);
+    if (!pipeline_push(&pipeline->replies, &message)) {
+        pipeline->stages[1].dropped++;
+        errno = ENOBUFS;
+        return -1;
+    }
+    return message.length;
+}
+
+/**
+ * @brief Checks whether the receive stage of a pipelined server has passed on a command.
+ * 
+ * @param transport The pipeline transport.
+ * @return True if a command can be received without waiting.
+ */
+int pipeline_transport_ready(struct Transport *transport) {
+    struct Pipeline *pipeline = transport->state;
+    return pipeline_ready(&pipeline->commands);
+}
+
+/**
+ * @brief Waits for the receive stage of a pipelined server to pass on a command. The time spent
+ * waiting isn't counted as busy.
+ * 
+ * @param transport The pipeline transport.
+ * @param timeout The number of seconds to wait for at most.
+ * @return 1 if a command can be received without waiting, 0 if none arrived in time, or -1 if an
+ * error occured (errno is EINTR if the stats were requested).
+ */
+int pipeline_transport_wait(struct Transport *transport, double timeout) {
+    struct Pipeline *pipeline = transport->state;
+    struct Pipeline_Stage *stage = &pipeline->stages[1];
+    double now = get_time(), deadline = now + timeout;
+    int rv = 0;
+    stage->busy += now - stage->since;
+    while (!pipeline_ready(&pipeline->commands) && rv != -1 && (now = get_time()) < deadline) {
+        rv = pipeline_wait(&pipeline->commands, (int)((deadline - now) * 1000) + 1);
+    }
+    stage->since = get_time();
+    return (rv == -1) ? -1 : pipeline_ready(&pipeline->commands);
+}
+
+/**
+ * @brief Sets up an empty pipeline queue. If any errors are found, the function terminates the
+ * process.
+ * 
+ * @param queue The queue to set up.
+ */
+void init_pipeline_queue(struct Pipeline_Queue *queue) {
+    uint64_t i;
+    /* Each slot starts out writable in the first lap around the queue */
+    for (i = 0; i < PIPELINE_QUEUE_SIZE; i++) queue->slots[i].sequence = i;
+    queue->head = queue->tail = 0;
+    if ((queue->event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) print_error("init_pipeline_queue: eventfd", errno, 1);
+}
+
+/**
+ * @brief Pushes a message into a pipeline queue, from any number of producer threads at once. A
+ * producer claims a position by advancing the tail with a compare-and-swap once the slot there
+ * has been emptied by the consumer, fills the slot, then publishes it through its sequence
+ * number. The consumer is woken through the queue's eventfd only if it is asleep.
+ * 
+ * @param queue The queue to push into.
+ * @param message The message to push.
+ * @return True if the message was pushed, false if the queue is full.
+ */
+int pipeline_push(struct Pipeline_Queue *queue, const struct Pipeline_Message *message) {
+    struct Pipeline_Slot *slot;
+    uint64_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED), one = 1;
+    unsigned depth;
+    /* Claim the next free position */
+    while (1) {
+        int64_t lap;
+        slot = &queue->slots[pos & (PIPELINE_QUEUE_SIZE-1)];
+        lap = (int64_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - pos);
+        if (lap == 0) {
+            if (__atomic_compare_exchange_n(&queue->tail, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (lap < 0) {
+            return 0;   // the consumer hasn't emptied the slot from the previous lap yet
+        } else {
+            pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+    /* Fill and publish the slot */
+    slot->message = *message;
+    __atomic_store_n(&slot->sequence, pos+1, __ATOMIC_RELEASE);
+    /* Track the occupancy of the queue */
+    depth = pos+1 - __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    if (depth > __atomic_load_n(&queue->maxOccupancy, __ATOMIC_RELAXED)) __atomic_store_n(&queue->maxOccupancy, depth, __ATOMIC_RELAXED);
+    /* Wake the consumer if it went to sleep before seeing the message */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&queue->sleeping, __ATOMIC_RELAXED) && write(queue->event, &one, sizeof(one)) == -1) {
+        print_error("pipeline_push: write", errno, 0);
+    }
+    return 1;
+}
+
+/**
+ * @brief Pops the oldest message from a pipeline queue (from its single consumer thread).
+ * 
+ * @param queue The queue to pop from.
+ * @param message The message popped.
+ * @return True if a message was popped, false if the queue is empty.
+ */
+int pipeline_pop(struct Pipeline_Queue *queue, struct Pipeline_Message *message) {
+    uint64_t pos = queue->head;
+    struct Pipeline_Slot *slot = &queue->slots[pos & (PIPELINE_QUEUE_SIZE-1)];
+    /* Check that the slot has been published in this lap */
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos+1) return 0;
+    *message = slot->message;
+    /* Hand the slot back to the producers for the next lap */
+    __atomic_store_n(&slot->sequence, pos + PIPELINE_QUEUE_SIZE, __ATOMIC_RELEASE);
+    __atomic_store_n(&queue->head, pos+1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/**
+ * @brief Checks whether the oldest message of a pipeline queue has been published.
+ * 
+ * @param queue The queue to check.
+ * @return True if a message can be popped.
+ */
+int pipeline_ready(struct Pipeline_Queue *queue) {
+    uint64_t pos = queue->head;
+    return __atomic_load_n(&queue->slots[pos & (PIPELINE_QUEUE_SIZE-1)].sequence, __ATOMIC_ACQUIRE) == pos+1;
+}
+
+/**
+ * @brief Puts the consumer of a pipeline queue to sleep until a message is pushed or the timeout
+ * expires. The sleeping flag is set (and the queue checked once more) before sleeping, so a
+ * producer either sees the flag and wakes the consumer, or its message is seen.
+ * 
+ * @param queue The queue being consumed.
+ * @param timeout The number of milliseconds to sleep for at most, or -1 to sleep indefinitely.
+ * @return The result of poll(), or 0 if a message arrived before the consumer slept.
+ */
+int pipeline_wait(struct Pipeline_Queue *queue, int timeout) {
+    struct pollfd event = {queue->event, POLLIN, 0};
+    uint64_t count;
+    int rv = 0;
+    __atomic_store_n(&queue->sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!pipeline_ready(queue) && (rv = poll(&event, 1, timeout)) > 0 && read(queue->event, &count, sizeof(count)) == -1) {
+        print_error("pipeline_wait: read", errno, 0);
+    }
+    __atomic_store_n(&queue->sleeping, 0, __ATOMIC_RELAXED);
+    return rv;
+}
+
+/**
+ * @brief Prints the counters of each stage of a pipelined server: the datagrams it handled and
+ * dropped, the share of time it was busy, and the occupancy of the queue it takes work from. The
+ * counters of the other stages are loaded atomically, as their threads keep updating them.
+ * 
+ * @param pipeline The pipeline.
+ */
+void print_pipeline_stats(struct Pipeline *pipeline) {
+    double elapsed = get_time() - pipeline->start;
+    int i;
+    for (i = 0; i < 3; i++) {
+        struct Pipeline_Stage *stage = &pipeline->stages[i];
+        double busy;
+        __atomic_load(&stage->busy, &busy, __ATOMIC_RELAXED);
+        printf("[+]Pipeline %-7s stage: %lu handled, %lu dropped, %.0f%% busy", stage->name, __atomic_load_n(&stage->processed, __ATOMIC_RELAXED),
+            __atomic_load_n(&stage->dropped, __ATOMIC_RELAXED), (elapsed > 0) ? 100 * busy / elapsed : 0.0);
+        if (stage->input != NULL) {
+            printf(", queue %u (max %u)", (unsigned)(__atomic_load_n(&stage->input->tail, __ATOMIC_RELAXED) - __atomic_load_n(&stage->input->head, __ATOMIC_RELAXED)),
+                __atomic_load_n(&stage->input->maxOccupancy, __ATOMIC_RELAXED));
+        }
+        printf("\n");
+    }
+}
+
+/**
+ * @brief Plays games against a server as fast as it answers, each from a fresh loopback address
+ * (so the rate limiter stays out of the way), until the benchmark deadline, timing every command
+ * the server answers.
+ * 
+ * @param arg The shared state of the benchmark load.
+ * @return NULL.
+ */
+void *bench_player(void *arg) {
+    struct Bench_Load *load = arg;
+    unsigned seed = (unsigned)(uintptr_t)&seed;
+    struct timeval timeout = {1, 0};
+    while (get_time() < load->deadline) {
+        struct sockaddr_in playerAddr = {0};
+        struct TTT_Game board = {0};
+        struct Buffer command = {VERSION, 0, NEW_GAME, 0, 0}, reply;
+        unsigned long n = __atomic_fetch_add(&load->nextAddress, 1, __ATOMIC_RELAXED);
+        int sd, over = 0;
+        /* Create the player socket on its own loopback address */
+        playerAddr.sin_family = AF_INET;
+        playerAddr.sin_addr.s_addr = htonl((127u << 24) | (1u << 16) | (n & 0xFFFF));
+        if ((sd = socket(AF_INET, SOCK_DGRAM, 0)) == -1 || bind(sd, (struct sockaddr *)&playerAddr, sizeof(playerAddr)) == -1) {
+            print_error("bench_player: socket", errno, 1);
+        }
+        setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        reset_game(&board);
+        while (!over) {
+            int i, move, numOpen = 0;
+            double start = get_time();
+            /* Send the command and wait for the server's reply */
+            sendto(sd, &command, sizeof(command), 0, (struct sockaddr *)&load->server, sizeof(load->server));
+            __atomic_fetch_add(&load->commands, 1, __ATOMIC_RELAXED);
+            if (recv(sd, &reply, sizeof(reply), 0) != sizeof(reply)) {
+                __atomic_fetch_add(&load->timeouts, 1, __ATOMIC_RELAXED);
+                break;
+            }
+            if ((i = __atomic_fetch_add(&load->numSamples, 1, __ATOMIC_RELAXED)) < BENCH_ROUND_TRIPS) load->samples[i] = get_time() - start;
+            if (reply.command != MOVE) break;
+            /* Play the server's move, leaving (or ending the game) with GAME_OVER if it is time to */
+            board.board[reply.data - '1'] = P1_MARK;
+            command = reply;
+            command.seqNum++;
+            if (load->leaveEarly || check_win(&board) || check_draw(&board)) {
+                command.command = GAME_OVER;
+                sendto(sd, &command, sizeof(command), 0, (struct sockaddr *)&load->server, sizeof(load->server));
+                __atomic_fetch_add(&load->commands, 1, __ATOMIC_RELAXED);
+                over = 1;
+                continue;
+            }
+            /* Otherwise answer with a random open square */
+            for (i = 0; i < sizeof(board.board); i++) numOpen += (board.board[i] == i + '1');
+            for (move = 1, i = rand_r(&seed) % numOpen; board.board[move-1] != move + '0' || i-- > 0; move++);
+            board.board[move-1] = P2_MARK;
+            command.data = move + '0';
+        }
+        __atomic_fetch_add(&load->games, 1, __ATOMIC_RELAXED);
+        close(sd);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Compares the single-loop server with the pipelined server under a NEW_GAME-heavy mix
+ * (players leave right after the server's first move) and a MOVE-heavy mix (players play whole
+ * games). Each server is forked on a loopback socket with its output discarded and loaded by a
+ * fixed number of players for a few seconds, reporting games/s, commands/s and reply latency, and
+ * the stage counters of the pipelined server.
+ */
+void bench_pipeline(void) {
+    int mix, mode, i;
+    static struct Bench_Load load;
+    for (mix = 0; mix < 2; mix++) {
+        for (mode = 0; mode < 2; mode++) {
+            struct sockaddr_in serverAddr = {0};
+            socklen_t addrLength = sizeof(serverAddr);
+            pthread_t players[BENCH_PLAYERS];
+            struct Pipeline *stages = NULL;
+            double elapsed;
+            pid_t server;
+            int sd;
+            /* Create the server socket on loopback (and the pipeline, so its counters can be read here) */
+            serverAddr.sin_family = AF_INET;
+            serverAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if ((sd = socket(AF_INET, SOCK_DGRAM, 0)) == -1 || bind(sd, (struct sockaddr *)&serverAddr, addrLength) == -1) {
+                print_error("bench_pipeline: socket", errno, 1);
+            }
+            getsockname(sd, (struct sockaddr *)&serverAddr, &addrLength);
+            if (mode == 1) stages = create_pipeline(sd);
+            /* Fork the server */
+            fflush(stdout);
+            if ((server = fork()) == -1) print_error("bench_pipeline: fork", errno, 1);
+            if (server == 0) {
+                struct Transport transport;
+                if (freopen("/dev/null", "w", stdout) == NULL) exit(EXIT_FAILURE);
+                enable_receive_accounting(sd);
+                if (mode == 1) run_pipeline(stages, map_game_roster(NULL));
+                init_udp_transport(&transport, sd);
+                tictactoe(&transport, -1, map_game_roster(NULL));
+            }
+            /* Load the server with the players */
+            memset(&load, 0, sizeof(load));
+            load.server = serverAddr;
+            load.leaveEarly = (mix == 0);
+            load.nextAddress = (mix * 2 + mode) << 14;
+            usleep(100000);
+            load.deadline = get_time() + BENCH_SECONDS;
+            for (i = 0; i < BENCH_PLAYERS; i++) pthread_create(&players[i], NULL, bench_player, &load);
+            for (i = 0; i < BENCH_PLAYERS; i++) pthread_join(players[i], NULL);
+            elapsed = get_time() - load.deadline + BENCH_SECONDS;
+            /* Report the results (and the stage counters) before stopping the server */
+            if (load.numSamples > BENCH_ROUND_TRIPS) load.numSamples = BENCH_ROUND_TRIPS;
+            qsort(load.samples, load.numSamples, sizeof(double), compare_doubles);
+            printf("pipeline: %-14s %-11s %6.1f games/s, %7.1f commands/s, p50 %.2f ms, p99 %.2f ms, %lu timeouts\n",
+                mix ? "MOVE-heavy" : "NEW_GAME-heavy", mode ? "pipelined" : "single-loop", load.games / elapsed, load.commands / elapsed,
+                (load.numSamples > 0) ? load.samples[load.numSamples/2] * 1e3 : 0.0,
+                (load.numSamples > 0) ? load.samples[load.numSamples*99/100] * 1e3 : 0.0, load.timeouts);
+            if (stages != NULL) {
+                print_pipeline_stats(stages);
+                munmap(stages, sizeof(struct Pipeline));
+                pipeline = NULL;
+            }
+            kill(server, SIGKILL);
+            waitpid(server, NULL, 0);
+            close(sd);
+        }
+    }
+    printf("pipeline: %d players, %d s per run, %ld CPUs\n", BENCH_PLAYERS, BENCH_SECONDS, sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+#ifdef USE_IO_URING
+/**
+ * @brief Enters the io_uring to submit the queued SQEs and wait for completions.
+ * 
+ * @param ring The io_uring backend of the server comminication endpoint.
+ * @param minComplete The number of completions to wait for.
+ * @return The number of SQEs submitted, or -1 if an error occured (errno is set).
+ */
+int uring_enter(struct Uring_Backend *ring, unsigned minComplete) {
+    int rv;
+    /* Publish the queued SQEs to the kernel */
+    __atomic_store_n(ring->sqTail, ring->sqPending, __ATOMIC_RELEASE);
+    ring->enters++;
+    rv = syscall(__NR_io_uring_enter, ring->fd, ring->toSubmit, minComplete, (minComplete > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (rv > 0) ring->toSubmit -= rv;
+    ring->lastSend = NULL;
+    return rv;
+}
+
+/**
+ * @brief Gets the next free SQE of the io_uring, submitting the queued SQEs first if the
+ * submission queue is full.
+ * 
+ * @param ring The io_uring backend of the server comminication endpoint.
+ * @param opcode The operation of the SQE.
+ * @param userData The data identifying the SQE in its completion.
+ * @return The cleared SQE.
+ */
+struct io_uring_sqe *uring_get_sqe(struct Uring_Backend *ring, int opcode, uint64_t userData) {
+    struct io_uring_sqe *sqe;
+    unsigned index;
+    /* Make room in the submission queue if it is full */
+    while (ring->sqPending - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >= ring->sqEntries) {
+        if (uring_enter(ring, 0) == -1 && errno != EINTR) print_error("uring_get_sqe: io_uring_enter", errno, 1);
+    }
+    index = ring->sqPending++ & ring->sqMask;
+    ring->sqArray[index] = index;
+    ring->toSubmit++;
+    sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = userData;
+    return sqe;
+}
+
+/**
+ * @brief Arms a multishot receive on the server socket that picks its buffers from the provided
+ * buffer ring, so every datagram received completes without a new submission.
+ * 
+ * @param ring The io_uring backend of the server comminication endpoint.
+ */
+void uring_arm_receive(struct Uring_Backend *ring) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring, IORING_OP_RECVMSG, URING_RECV_TAG << 32);
+    sqe->fd = ring->sd;
+    sqe->addr = (uint64_t)(uintptr_t)&ring->recvTemplate;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    ring->recvArmed = 1;
+}
+
+/**
+ * @brief Arms the server timeout (or moves an armed one) to expire SERVER_TIMEOUT seconds from now.
+ * 
+ * @param ring The io_uring backend of the server comminication endpoint.
+ */
+void uring_arm_timeout(struct Uring_Backend *ring) {
+    struct io_uring_sqe *sqe;
+    ring->timeout.tv_sec = SERVER_TIMEOUT;
+    ring->timeout.tv_nsec = 0;
+    if (!ring->timeoutArmed) {
+        /* Arm a new timeout (len counts the timespecs, off = 0 makes it a pure timer rather than
+           one also completed by the next receive) */
+        sqe = uring_get_sqe(ring, IORING_OP_TIMEOUT, URING_TIMEOUT_TAG << 32);
+        sqe->addr = (uint64_t)(uintptr_t)&ring->timeout;
+        sqe->len = 1;
+        sqe->off = 0;
+        ring->timeoutArmed = 1;
+    } else {
+        /* Push the armed timeout back */
+        sqe = uring_get_sqe(ring, IORING_OP_TIMEOUT_REMOVE, URING_UPDATE_TAG << 32);
+        sqe->addr = URING_TIMEOUT_TAG << 32;
+        sqe->addr2 = (uint64_t)(uintptr_t)&ring->timeout;
+        sqe->timeout_flags = IORING_TIMEOUT_UPDATE;
+    }
+    ring->timeoutStale = 0;
+}
+
+/**
+ * @brief Sets up an io_uring for the server socket with a registered ring of receive buffers.
+ * If any errors are found, the function terminates the process.
+ * 
+ * @param sd The socket descriptor of the server comminication endpoint.
+ * @return The io_uring backend of the server comminication endpoint.
+ */
+struct Uring_Backend *uring_create(int sd) {
+    int i;
+    char *sqRing, *cqRing;
+    struct io_uring_params params = {0};
+    struct io_uring_buf_reg bufReg = {0};
+    struct Uring_Backend *ring = calloc(1, sizeof(struct Uring_Backend));
+    if (ring == NULL) print_error("uring_create: calloc", errno, 1);
+    ring->sd = sd;
+    /* Create the io_uring and map its submission and completion queues */
+    if ((ring->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params)) == -1) print_error("uring_create: io_uring_setup", errno, 1);
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) print_error("uring_create: Kernel io_uring is too old", 0, 1);
+    sqRing = mmap(NULL, params.sq_off.array + params.sq_entries * sizeof(unsigned) + params.cq_off.cqes
+        + params.cq_entries * sizeof(struct io_uring_cqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (sqRing == MAP_FAILED || ring->sqes == MAP_FAILED) print_error("uring_create: mmap", errno, 1);
+    cqRing = sqRing;
+    ring->sqHead = (unsigned *)(sqRing + params.sq_off.head);
+    ring->sqTail = (unsigned *)(sqRing + params.sq_off.tail);
+    ring->sqArray = (unsigned *)(sqRing + params.sq_off.array);
+    ring->sqMask = *(unsigned *)(sqRing + params.sq_off.ring_mask);
+    ring->sqEntries = params.sq_entries;
+    ring->sqPending = *ring->sqTail;
+    ring->cqHead = (unsigned *)(cqRing + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cqRing + params.cq_off.tail);
+    ring->cqMask = *(unsigned *)(cqRing + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cqRing + params.cq_off.cqes);
+    /* Register the ring of buffers that multishot receives pick from */
+    ring->bufRing = mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->bufRing == MAP_FAILED) print_error("uring_create: mmap", errno, 1);
+    bufReg.ring_addr = (uint64_t)(uintptr_t)ring->bufRing;
+    bufReg.ring_entries = URING_BUFFERS;
+    bufReg.bgid = URING_BGID;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &bufReg, 1) == -1) {
+        print_error("uring_create: io_uring_register", errno, 1);
+    }
+    for (i = 0; i < URING_BUFFERS; i++) uring_recycle_buffer(ring, i);
+    /* Receive into each buffer the sender address and ancillary data followed by the datagram */
+    ring->recvTemplate.msg_namelen = sizeof(struct sockaddr_in);
+    ring->recvTemplate.msg_controllen = RECV_CONTROL_SIZE;
+    printf("[+]io_uring backend enabled (%u entries, %d receive buffers).\n", params.sq_entries, URING_BUFFERS);
+    return ring;
+}
+
+/**
+ * @brief Gives a receive buffer back to the kernel once its datagram has been copied out.
+ * 
+ * @param ring The io_uring backend of the server comminication endpoint.
+ * @param bid The ID of the receive buffer.
+ */
+void uring_recycle_buffer(struct Uring_Backend *ring, int bid) {
+    struct io_uring_buf *buf = &ring->bufRing->bufs[ring->bufTail & (URING_BUFFERS-1)];
+    buf->addr = (uint64_t)(uintptr_t)ring->buffers[bid];
+    buf->len = URING_BUFFER_SIZE;
+    buf->bid = bid;
+    __atomic_store_n(&ring->bufRing->tail, ++ring->bufTail, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Handles the completions of the io_uring up to the next received datagram, which is left
+ * at the head of the completion queue for uring_receive() to copy out.
+ * 
+ * @param ring The io_uring backend of the server comminication endpoint.
+ * @return 1 if a received datagram is waiting, 0 if the completions ran dry, or -1 if the server
+ * timed out (errno is EAGAIN).
+ */
+int uring_reap(struct Uring_Backend *ring) {
+    unsigned head = *ring->cqHead;
+    /* Handle each completion that is ready */
+    while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & ring->cqMask];
+        uint64_t tag = cqe->user_data >> 32;
+        int res = cqe->res, flags = cqe->flags, index = cqe->user_data & 0xFFFFFFFF;
+        if (tag == URING_RECV_TAG && res >= 0 && (flags & IORING_CQE_F_BUFFER)) return 1;
+        __atomic_store_n(ring->cqHead, ++head, __ATOMIC_RELEASE);
+        if (tag == URING_RECV_TAG) {
+            /* Multishot receive stops if it is cancelled, fails, or runs out of buffers */
+            if (!(flags & IORING_CQE_F_MORE)) ring->recvArmed = 0;
+            if (res < 0 && res != -ENOBUFS) print_error("uring_reap: recvmsg", -res, 0);
+        } else if (tag == URING_TIMEOUT_TAG) {
+            /* Server timeout expired (unless it raced with being pushed back for a datagram) */
+            ring->timeoutArmed = 0;
+            if (res == -ETIME && get_time() - ring->lastReceived >= SERVER_TIMEOUT) {
+                errno = EAGAIN;
+                return -1;
+            }
+        } else if (tag == URING_SEND_TAG) {
+            /* Reply was sent -> free its slot */
+            ring->sends[index].busy = 0;
+            if (res < 0) print_error("uring_reap: sendmsg", -res, 0);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Receives a datagram through the io_uring with the same semantics as recvmsg() on a
+ * socket with a receive timeout. Datagrams that have already completed are returned without a
+ * system call, and queued replies are only submitted once the completions run dry.
+ * 
+ * @param ring The io_uring backend of the server comminication endpoint.
+ * @param msg The message header to store the sender address and (scattered) datagram in.
+ * @return The number of bytes received, or -1 if an error occured (errno is EAGAIN if the server
+ * timed out).
+ */
+int uring_receive(struct Uring_Backend *ring, struct msghdr *msg) {
+    struct io_uring_cqe *cqe;
+    struct io_uring_recvmsg_out *out;
+    char *control, *payload;
+    size_t length, copied = 0;
+    int i, bid, rv;
+    while ((rv = uring_reap(ring)) == 0) {
+        /* Nothing ready -> rearm what has stopped and wait for a completion, submitting replies */
+        if (!ring->recvArmed) uring_arm_receive(ring);
+        if (!ring->timeoutArmed || ring->timeoutStale) uring_arm_timeout(ring);
+        if (uring_enter(ring, 1) == -1) return -1;
+    }
+    if (rv == -1) return -1;
+    /* Take the datagram at the head of the completion queue */
+    cqe = &ring->cqes[*ring->cqHead & ring->cqMask];
+    bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    out = (struct io_uring_recvmsg_out *)ring->buffers[bid];
+    control = (char *)(out + 1) + ring->recvTemplate.msg_namelen;
+    payload = control + ring->recvTemplate.msg_controllen;
+    length = (out->payloadlen < URING_BUFFER_SIZE - (payload - (char *)out)) ? out->payloadlen : URING_BUFFER_SIZE - (payload - (char *)out);
+    /* Multishot receive stops if it is cancelled, fails, or runs out of buffers */
+    if (!(cqe->flags & IORING_CQE_F_MORE)) ring->recvArmed = 0;
+    __atomic_store_n(ring->cqHead, *ring->cqHead + 1, __ATOMIC_RELEASE);
+    /* Copy out the sender address and scatter the datagram like recvmsg() */
+    memcpy(msg->msg_name, out + 1, (out->namelen < msg->msg_namelen) ? out->namelen : msg->msg_namelen);
+    msg->msg_controllen = (out->controllen < msg->msg_controllen) ? out->controllen : msg->msg_controllen;
+    if (msg->msg_controllen > 0) memcpy(msg->msg_control, control, msg->msg_controllen);
+    for (i = 0; i < msg->msg_iovlen && copied < length; i++) {
+        size_t part = (length - copied < msg->msg_iov[i].iov_len) ? length - copied : msg->msg_iov[i].iov_len;
+        memcpy(msg->msg_iov[i].iov_base, payload + copied, part);
+        copied += part;
+    }
+    uring_recycle_buffer(ring, bid);
+    ring->timeoutStale = 1;
+    ring->lastReceived = get_time();
+    return copied;
+}
+
+/**
+ * @brief Waits for a datagram to complete on the io_uring, submitting the queued replies first.
+ * The other completions are handled as they arrive, and the datagram is left for uring_receive().
+ * 
+ * @param ring The io_uring backend of the server comminication endpoint.
+ * @param timeout The number of seconds to wait for at most.
+ * @return 1 if a datagram can be received without waiting, 0 if none arrived in time (or the
+ * server timed out), or -1 if an error occured.
+ */
+int uring_wait(struct Uring_Backend *ring, double timeout) {
+    struct pollfd pfd = {ring->fd, POLLIN, 0};
+    double remaining, deadline = get_time() + timeout;
+    int rv;
+    while ((rv = uring_reap(ring)) == 0) {
+        /* Rearm what has stopped and submit the replies, then sleep until a completion arrives */
+        if (!ring->recvArmed) uring_arm_receive(ring);
+        if (!ring->timeoutArmed || ring->timeoutStale) uring_arm_timeout(ring);
+        if (uring_enter(ring, 0) == -1 && errno != EINTR) return -1;
+        if ((remaining = deadline - get_time()) <= 0) return 0;
+        if (*ring->cqHead == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE) && poll(&pfd, 1, (int)(remaining * 1000) + 1) == -1) return -1;
+    }
+    return (rv == 1);
+}
+
+/**
+ * @brief Queues a datagram to be sent through the io_uring. Replies are submitted together the
+ * next time the server waits for completions, and consecutive replies to the same destination are
+ * linked so they go out in order. If every send slot is in flight, the datagram is sent directly.
+ * 
+ * @param ring The io_uring backend of the server comminication endpoint.
+ * @param data The datagram to send.
+ * @param length The number of bytes in the datagram.
+ * @param dest The address to send the datagram to.
+ * @return The number of bytes queued, or -1 if an error occured.
+ */
+int uring_send(struct Uring_Backend *ring, const void *data, size_t length, const struct sockaddr_in *dest) {
+    int i;
+    struct Uring_Send *send = NULL;
+    struct io_uring_sqe *sqe;
+    /* Find a free send slot */
+    for (i = 0; i < URING_SEND_SLOTS && send == NULL; i++) {
+        struct Uring_Send *slot = &ring->sends[(ring->nextSend + i) % URING_SEND_SLOTS];
+        if (!slot->busy) send = slot;
+    }
+    if (send == NULL || length > sizeof(send->data)) {
+        return sendto(ring->sd, data, length, 0, (struct sockaddr *)dest, sizeof(struct sockaddr_in));
+    }
+    ring->nextSend = (send - ring->sends + 1) % URING_SEND_SLOTS;
+    /* Copy the datagram into the slot so it outlives the caller */
+    memcpy(send->data, data, length);
+    send->addr = *dest;
+    send->iov.iov_base = send->data;
+    send->iov.iov_len = length;
+    memset(&send->msg, 0, sizeof(send->msg));
+    send->msg.msg_name = &send->addr;
+    send->msg.msg_namelen = sizeof(struct sockaddr_in);
+    send->msg.msg_iov = &send->iov;
+    send->msg.msg_iovlen = 1;
+    send->busy = 1;
+    /* Link to the previous queued reply if it goes to the same destination */
+    if (ring->lastSend != NULL && same_address(&ring->lastSendAddr, dest)) ring->lastSend->flags |= IOSQE_IO_LINK;
+    sqe = uring_get_sqe(ring, IORING_OP_SENDMSG, (URING_SEND_TAG << 32) | (send - ring->sends));
+    sqe->fd = ring->sd;
+    sqe->addr = (uint64_t)(uintptr_t)&send->msg;
+    sqe->len = 1;
+    ring->lastSend = sqe;
+    ring->lastSendAddr = *dest;
+    return length;
+}
+
+/**
+ * @brief Submits the queued replies without waiting for any completions.
+ * 
+ * @param ring The io_uring backend of the server comminication endpoint.
+ */
+void uring_flush(struct Uring_Backend *ring) {
+    if (ring->toSubmit > 0 && uring_enter(ring, 0) == -1) print_error("uring_flush: io_uring_enter", errno, 0);
+}
+#endif
+
+/**
+ * @brief Checks each TicTacToe game to see if it has timed out or not. If one has, the previous
+ * command for that game is resent. (Finished games wait out their grace period as tombstones.)
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param roster The array of playable TicTacToe games.
+ */
+void check_timeout(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]) {
+    int i;
+    /* Searches over all games */
+    for (i = 0; i < MAX_GAMES; i++) {
+        struct TTT_Game *game = &roster[i];
+        /* Check if current game timeout has expired (a game waiting on the server's own move can't) */
+        if (game->timeout <= 0 && !searchPool.pending[i]) {
+            printf("[+]Game #%d has timed out.\n", game->gameNum);
+            /* Command likely got lost -> resend previously sent command */
+            printf("Player at %s (port %d) likely lost the previous command\n", inet_ntoa(game->p2Address.sin_addr), game->p2Address.sin_port);
+            schedule_resend(transport, roster, i, 0);
+            game->numTimeouts++;
+            /* Restart the timeout clock to wait for a reply to the resent command */
+            game->timeout = GAME_TIMEOUT;
+        }
+    }
+}
+
+/**
+ * @brief Checks to see if two communication endpoints have the same address (IP and port) or not.
+ * 
+ * @param addr1 The address of communication endpoint 1.
+ * @param addr2 The address of communication endpoint 2.
+ * @return True if the endpoint addresses are the same, false otherwise. 
+ */
+int same_address(const struct sockaddr_in *addr1, const struct sockaddr_in *addr2) {
+    /* Check endpoint IP addresses */
+    if (addr1->sin_addr.s_addr != addr2->sin_addr.s_addr) return 0;
+    /* Check endpoint port numbers */
+    if (addr1->sin_port != addr2->sin_port) return 0;
+    return 1;
+}
+
+/**
+ * @brief Finds the rate limiter slot for a source address. Slots are probed linearly from the
+ * hash of the address, and slots that have aged out are reused. If every probed slot is held by
+ * an active source, the least recently seen one is evicted. The new source starts with full
+ * buckets either way, so a player pushed out by a flood of other addresses isn't locked out.
+ * 
+ * @param addr The IP address of the source.
+ * @param now The current time.
+ * @return The rate limiter slot for the source address.
+ */
+struct Rate_Entry *find_rate_entry(in_addr_t addr, double now) {
+    double scale = options.commandRate / COMMAND_RATE;
+    int i;
+    /* Take the middle bits of the multiplicative hash, which depend on every byte of the address
+     * (the low bits only depend on the low bits, which in network order are the first octet) */
+    uint32_t hash = (ntohl(addr) * 2654435761u) >> 16;
+    struct Rate_Entry *entry, *oldest = NULL;
+    /* Probe the slots starting from the hash of the address */
+    for (i = 0; i < RATE_PROBES; i++) {
+        entry = &rateTable[(hash + i) & (RATE_TABLE_SIZE-1)];
+        if (entry->addr == addr) return entry;
+        if (oldest == NULL || entry->lastSeen < oldest->lastSeen) oldest = entry;
+    }
+    /* Reuse the least recently seen slot with full buckets for the new source */
+    if (oldest->addr != 0 && now - oldest->lastSeen < RATE_MAX_AGE) stats.evictions++;
+    oldest->addr = addr;
+    oldest->tokens = COMMAND_BURST * scale;
+    oldest->newGameTokens = NEW_GAME_BURST * scale;
+    oldest->lastSeen = now;
+    return oldest;
+}
+
+/**
+ * @brief Applies the per-source token bucket rate limits to a command before it is handled.
+ * Every command costs a token from the source's command bucket, and NEW_GAME commands also cost
+ * a token from the tighter NEW_GAME bucket. The rates and bursts are scaled by the -r command
+ * rate, and every command is admitted if it is 0.
+ * 
+ * @param playerAddr The address of the remote player.
+ * @param datagram The datagram containing the command that the remote player sends.
+ * @return True if the command should be handled, false if it should be dropped.
+ */
+int admit_command(const struct sockaddr_in *playerAddr, const struct Buffer *datagram) {
+    double now = get_time(), scale = options.commandRate / COMMAND_RATE, elapsed;
+    struct Rate_Entry *entry;
+    if (options.commandRate == 0) return 1;
+    entry = find_rate_entry(playerAddr->sin_addr.s_addr, now);
+    elapsed = now - entry->lastSeen;
+    /* Refill the buckets for the time elapsed since the source was last seen */
+    entry->tokens += elapsed * COMMAND_RATE * scale;
+    if (entry->tokens > COMMAND_BURST * scale) entry->tokens = COMMAND_BURST * scale;
+    entry->newGameTokens += elapsed * NEW_GAME_RATE * scale;
+    if (entry->newGameTokens > NEW_GAME_BURST * scale) entry->newGameTokens = NEW_GAME_BURST * scale;
+    entry->lastSeen = now;
+    /* Check that the source has tokens left for the command */
+    if (entry->tokens < 1 || (datagram->command == NEW_GAME && entry->newGameTokens < 1)) {
+        stats.limited++;
+        if (datagram->command == NEW_GAME) stats.newGamesLimited++;
+        return 0;
+    }
+    /* Spend the tokens for the command */
+    entry->tokens--;
+    if (datagram->command == NEW_GAME) entry->newGameTokens--;
+    return 1;
+}
+
+/* Rotates a 64-bit value left by the given number of bits. */
+#define ROTL64(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+/* A single SipHash round over the hash state. */
+#define SIPROUND(v0, v1, v2, v3) do { \
+    v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+    v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32); \
+} while (0)
+
+/**
+ * @brief Computes the SipHash-2-4 keyed MAC of the given data.
+ * 
+ * @param key The 128-bit secret key.
+ * @param data The data to authenticate.
+ * @param length The number of bytes of data.
+ * @return The 64-bit MAC of the data.
+ */
+uint64_t siphash(const unsigned char key[16], const unsigned char *data, size_t length) {
+    size_t i, j;
+    uint64_t k0, k1, v0, v1, v2, v3, word, last = (uint64_t)length << 56;
+    memcpy(&k0, key, sizeof(k0));
+    memcpy(&k1, key + 8, sizeof(k1));
+    v0 = k0 ^ 0x736f6d6570736575ull;
+    v1 = k1 ^ 0x646f72616e646f6dull;
+    v2 = k0 ^ 0x6c7967656e657261ull;
+    v3 = k1 ^ 0x7465646279746573ull;
+    /* Compress each full 8-byte word of the data */
+    for (i = 0; i + 8 <= length; i += 8) {
+        memcpy(&word, data + i, sizeof(word));
+        v3 ^= word;
+        SIPROUND(v0, v1, v2, v3);
+        SIPROUND(v0, v1, v2, v3);
+        v0 ^= word;
+    }
+    /* Compress the remaining bytes along with the data length */
+    for (j = 0; i + j < length; j++) last |= (uint64_t)data[i+j] << (8*j);
+    v3 ^= last;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    v0 ^= last;
+    /* Finalize the hash */
+    v2 ^= 0xff;
+    for (i = 0; i < 4; i++) SIPROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * @brief Makes the handshake cookie for a player address and time window, a MAC of the two under
+ * the server's secret key. Cookies take no server state to issue or check.
+ * 
+ * @param playerAddr The address of the remote player.
+ * @param window The time window the cookie is issued for.
+ * @return The handshake cookie.
+ */
+uint64_t make_cookie(const struct sockaddr_in *playerAddr, uint32_t window) {
+    unsigned char data[12] = {0};
+    /* Pack the IP address, port number and time window */
+    memcpy(data, &playerAddr->sin_addr.s_addr, 4);
+    memcpy(data + 4, &playerAddr->sin_port, 2);
+    memcpy(data + 8, &window, 4);
+    return siphash(cookieKey, data, sizeof(data));
+}
+
+/**
+ * @brief Checks that a NEW_GAME datagram echoes a valid handshake cookie for the player address,
+ * issued in the current or previous time window.
+ * 
+ * @param playerAddr The address of the remote player.
+ * @param cookie The cookie echoed by the remote player.
+ * @param length The number of bytes received for the datagram.
+ * @return True if the cookie is valid, false otherwise.
+ */
+int check_cookie(const struct sockaddr_in *playerAddr, const unsigned char cookie[COOKIE_SIZE], int length) {
+    uint64_t echoed;
+    uint32_t window = get_time() / COOKIE_WINDOW;
+    /* Check that the datagram carries a cookie */
+    if (length != sizeof(struct Cookie_Buffer)) return 0;
+    memcpy(&echoed, cookie, sizeof(echoed));
+    /* Check the cookie against the current and previous window */
+    return echoed == make_cookie(playerAddr, window) || echoed == make_cookie(playerAddr, window-1);
+}
+
+/**
+ * @brief Replies to a NEW_GAME command without a valid cookie with a NEW_GAME datagram carrying a
+ * cookie for the player address. A game is only allocated once the cookie is echoed back.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param playerAddr The address of the remote player.
+ */
+void send_cookie(struct Transport *transport, const struct sockaddr_in *playerAddr) {
+    struct Cookie_Buffer datagram = {{0}};
+    uint64_t cookie = make_cookie(playerAddr, get_time() / COOKIE_WINDOW);
+    /* Pack cookie into NEW_GAME datagram */
+    datagram.command.version = VERSION;
+    datagram.command.command = NEW_GAME;
+    memcpy(datagram.cookie, &cookie, COOKIE_SIZE);
+    /* Send the cookie to the remote player */
+    printf("Sent a handshake cookie to player at %s (port %d)\n", inet_ntoa(playerAddr->sin_addr), playerAddr->sin_port);
+    if (transport->send(transport, &datagram, sizeof(datagram), playerAddr) < 0) {
+        print_error("send_cookie", errno, 0);
+    }
+}
+
+/**
+ * @brief Benchmarks issuing and checking handshake cookies for a range of player addresses.
+ */
+void bench_cookie(void) {
+    int i, valid = 0;
+    double start, made, checked;
+    struct sockaddr_in playerAddr = {0};
+    static unsigned char cookies[BENCH_ITERATIONS][COOKIE_SIZE];
+    getrandom(cookieKey, sizeof(cookieKey), 0);
+    /* Time issuing a cookie for each address */
+    start = get_time();
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        uint64_t cookie;
+        playerAddr.sin_addr.s_addr = i;
+        cookie = make_cookie(&playerAddr, get_time() / COOKIE_WINDOW);
+        memcpy(cookies[i], &cookie, COOKIE_SIZE);
+    }
+    made = get_time();
+    /* Time checking the cookie echoed by each address */
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        playerAddr.sin_addr.s_addr = i;
+        valid += check_cookie(&playerAddr, cookies[i], sizeof(struct Cookie_Buffer));
+    }
+    checked = get_time();
+    printf("cookie: %d cookies, issue %.1f ns/op, check %.1f ns/op, %d valid\n", BENCH_ITERATIONS,
+        (made - start) * 1e9 / BENCH_ITERATIONS, (checked - made) * 1e9 / BENCH_ITERATIONS, valid);
+}
+
+/**
+ * @brief Initializes the starting state of the game board that both players start with.
+ * 
+ * @param game The current game of TicTacToe being played.
+ */
+void init_shared_state(struct TTT_Game *game) {    
+    /* Initializes the shared state (aka the board)  */
+    ttt_init(game->board);
+    ultimate_init(&game->ultimate);
+}
+
+/**
+ * @brief Resets the current game for a new player.
+ * 
+ * @param game The current game of TicTacToe being played.
+ */
+void reset_game(struct TTT_Game *game) {
+    struct sockaddr_in blankAddr = {0};
+    struct Buffer blankCommand = {0};
+    if (game->gameNum > 0) printf("Game #%d has ended. Resetting game for new player\n", game->gameNum);
+    /* Record the game in the game history if it was played */
+    if (game->seqNum > 0) record_game(&history, game);
+    /* Hand back the search tree of an Ultimate TicTacToe game (unless a search still holds it) */
+    if (game->type == GAME_ULTIMATE && game->gameNum >= 1 && game->gameNum <= MAX_GAMES && !searchPool.pending[game->gameNum-1]) {
+        mcts_release(&mctsTrees[game->gameNum-1]);
+    }
+    /* Reset game attributes */
+    game->seqNum = 0;
+    game->timeout = GAME_TIMEOUT;
+    game->resends = MAX_RESENDS;
+    game->p2Address = blankAddr;
+    game->winner = -1;
+    game->lastSent = blankCommand;
+    game->type = GAME_CLASSIC;
+    game->numMoves = game->numResends = game->numTimeouts = 0;
+    /* Reset game board */
+    init_shared_state(game);
+}
+
+/**
+ * @brief Initializes the starting state of each game of TicTacToe in the current game roster.
+ * 
+ * @param roster The array of playable TicTacToe games.
+ */
+void init_game_roster(struct TTT_Game roster[MAX_GAMES]) {
+    int i;
+    printf("[+]Initializing shared game states.\n");
+    /* Iterates over all games */
+    for (i = 0;  i < MAX_GAMES; i++) {
+        struct TTT_Game *game = &roster[i];
+        /* Initialize current game attributes to default values */
+        reset_game(game);
+        /* Set current game number */
+        game->gameNum = i+1;
+    }
+}
+
+/**
+ * @brief Computes the checksum of a game record (FNV-1a over every byte preceding the checksum
+ * field) so that records torn by a crash mid-update can be detected when the roster is remapped.
+ * 
+ * @param game The current game of TicTacToe being played.
+ * @return The checksum of the game record.
+ */
+uint32_t checksum_game(const struct TTT_Game *game) {
+    size_t i;
+    uint32_t hash = 2166136261u;
+    const unsigned char *bytes = (const unsigned char *)game;
+    /* Hash each byte of the record up to the checksum itself */
+    for (i = 0; i < offsetof(struct TTT_Game, checksum); i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Seals every game record in the roster by updating its checksum to match its current
+ * contents. Called once all changes from a command or timeout have been written in place.
+ * 
+ * @param roster The array of playable TicTacToe games.
+ */
+void seal_game_roster(struct TTT_Game roster[MAX_GAMES]) {
+    int i;
+    /* Iterates over all games */
+    for (i = 0; i < MAX_GAMES; i++) {
+        struct TTT_Game *game = &roster[i];
+        uint32_t checksum = checksum_game(game);
+        /* Only touch the record (and its page) if it has changed */
+        if (game->checksum != checksum) game->checksum = checksum;
+    }
+}
+
+/**
+ * @brief Checks the consistency of each game record in a remapped roster. Records that were torn
+ * by a crash (bad checksum or game number) are reset, all other games are resumed as they were.
+ * 
+ * @param roster The array of playable TicTacToe games.
+ * @return The number of games in progress that were resumed.
+ */
+int check_game_roster(struct TTT_Game roster[MAX_GAMES]) {
+    int i, numResumed = 0;
+    /* Iterates over all games */
+    for (i = 0; i < MAX_GAMES; i++) {
+        struct TTT_Game *game = &roster[i];
+        /* Check if the record was torn while it was being written */
+        if (game->checksum != checksum_game(game) || game->gameNum != i+1) {
+            printf("[+]Game #%d record is torn. Resetting game\n", i+1);
+            /* Nothing in a torn record can be trusted, so it isn't logged to the game history */
+            game->gameNum = game->seqNum = 0;
+            reset_game(game);
+            game->gameNum = i+1;
+        } else if (game->seqNum > 0) {
+            numResumed++;
+        }
+    }
+    /* Reseal the reset records */
+    seal_game_roster(roster);
+    return numResumed;
+}
+
+/**
+ * @brief Maps the game roster into memory. If a file is given, the roster is stored in that file
+ * and written in place as games change, so a restarted server resumes every active game. A file
+ * with a missing or mismatched header is (re)initialized, otherwise each record is checked for
+ * consistency. If no file is given, the roster lives in anonymous memory. If any errors are found,
+ * the function terminates the process.
+ * 
+ * @param path The path of the file backing the roster, or NULL if games aren't persisted.
+ * @return The array of playable TicTacToe games.
+ */
+struct TTT_Game *map_game_roster(const char *path) {
+    int fd = -1, valid = 0;
+    struct stat fileInfo;
+    struct Game_Roster *roster;
+    /* Open (or create) the roster file and make sure it's large enough to hold the roster */
+    if (path != NULL) {
+        if ((fd = open(path, O_RDWR | O_CREAT, 0644)) == -1) {
+            print_error("map_game_roster: open", errno, 1);
+        }
+        if (fstat(fd, &fileInfo) == -1) print_error("map_game_roster: fstat", errno, 1);
+        valid = (fileInfo.st_size == sizeof(struct Game_Roster));
+        if (!valid && ftruncate(fd, sizeof(struct Game_Roster)) == -1) {
+            print_error("map_game_roster: ftruncate", errno, 1);
+        }
+    }
+    /* Map the roster into memory */
+    roster = mmap(NULL, sizeof(struct Game_Roster), PROT_READ | PROT_WRITE, (fd == -1) ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED, fd, 0);
+    if (roster == MAP_FAILED) print_error("map_game_roster: mmap", errno, 1);
+    if (fd != -1) close(fd);
+    /* Check that an existing roster has the same layout as this server */
+    if (valid) {
+        struct Roster_Header *header = &roster->header;
+        valid = memcmp(header->magic, ROSTER_MAGIC, sizeof(header->magic)) == 0 && header->version == ROSTER_VERSION
+            && header->numGames == MAX_GAMES && header->gameSize == sizeof(struct TTT_Game);
+        if (!valid) printf("[+]Roster file %s has a different layout. Discarding saved games.\n", path);
+    }
+    if (valid) {
+        /* Resume the saved games */
+        printf("[+]Resumed %d game(s) from roster file %s.\n", check_game_roster(roster->games), path);
+    } else {
+        /* Initialize a fresh roster, writing the header last so a partial initialization is redone */
+        memset(roster, 0, sizeof(struct Game_Roster));
+        init_game_roster(roster->games);
+        seal_game_roster(roster->games);
+        roster->header.version = ROSTER_VERSION;
+        roster->header.numGames = MAX_GAMES;
+        roster->header.gameSize = sizeof(struct TTT_Game);
+        memcpy(roster->header.magic, ROSTER_MAGIC, sizeof(roster->header.magic));
+    }
+    return roster->games;
+}
+
+/**
+ * @brief Updates the timeout clock of each ongoing game and the grace period of each tombstone.
+ * 
+ * @param roster The array of playable TicTacToe games.
+ * @param elapsed The number of seconds elapsed since the clocks were last updated.
+ */
+void update_game_clocks(struct TTT_Game roster[MAX_GAMES], double elapsed) {
+    int i;
+    /* Searches over all games */
+    for (i = 0; i < MAX_GAMES; i++) {
+        struct TTT_Game *game = &roster[i];
+        /* Update timeout clock if game is ongoing */
+        if (game->seqNum > 0) game->timeout -= elapsed;
+    }
+    /* Clear tombstones who's grace period has ended */
+    age_tombstones(elapsed);
+}
+
+/**
+ * @brief Determines how many games are currently being played.
+ * 
+ * @param numWaiting The number of game to return that are finished and are waiting out their
+ * grace period as tombstones.
+ * @param roster The array of playable TicTacToe games.
+ * @return The number of games currently being played (including those that are waiting). 
+ */
+int games_in_progress(int *numWaiting, struct TTT_Game roster[MAX_GAMES]) {
+    int i, count = 0;
+    *numWaiting = 0;
+    /* Searches over all games */
+    for (i = 0; i < MAX_GAMES; i++) {
+        /* Check if current game still in default state or has been started */
+        if (roster[i].seqNum > 0) count++;
+    }
+    /* Searches over all tombstones */
+    for (i = 0; i < MAX_TOMBSTONES; i++) {
+        /* Check if tombstone is in use */
+        if (tombstones[i].gameOver.command == GAME_OVER) (*numWaiting)++;
+    }
+    return count + *numWaiting;
+}
+
+/**
+ * @brief Finds an open game of TicTacToe to play if one is available.
  * 
  * @param roster The array of playable TicTacToe games.
  * @return The index of an open game if one is available, otherwise an error code is returned.
  */
-int find_open_game(struct TTT_Game roster[MAX_GAMES]) {
-    int i, gameIndex = ERROR_CODE;
-    /* Searches over all games */
-    for (i = 0; i < MAX_GAMES; i++) {
-        struct TTT_Game *game = &roster[i];
-        /* Check if current game is being played */
-        if (game->seqNum == 0) {
-            gameIndex = i;
-            break;
+int find_open_game(struct TTT_Game roster[MAX_GAMES]) {
+    int i, gameIndex = ERROR_CODE;
+    /* Searches over all games */
+    for (i = 0; i < MAX_GAMES; i++) {
+        struct TTT_Game *game = &roster[i];
+        /* Check if current game is being played (or still has a search in flight) */
+        if (game->seqNum == 0 && !searchPool.pending[i]) {
+            gameIndex = i;
+            break;
+        }
+    }
+    return gameIndex;
+}
+
+/**
+ * @brief Gets a command from the remote player and attempts to validate the data and syntax
+ * based on the current protocol.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param playerAddr The address of the remote player.
+ * @param datagram The datagram to store the command that the remote player sends.
+ * @param cookie The buffer to store the handshake cookie that may follow a NEW_GAME command.
+ * @return The number of bytes received for the command, or an error code if an error occured. 
+ */
+int get_command(struct Transport *transport, struct sockaddr_in *playerAddr, struct Buffer *datagram, unsigned char cookie[COOKIE_SIZE]) {
+    int rv;
+    struct iovec iov[2] = {{datagram, sizeof(struct Buffer)}, {cookie, COOKIE_SIZE}};
+    union {char buf[RECV_CONTROL_SIZE]; struct cmsghdr align;} control;
+    struct msghdr msg = {0};
+    msg.msg_name = playerAddr;
+    msg.msg_namelen = sizeof(struct sockaddr_in);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    /* Receive and validate command (and cookie, if any) from remote player */
+    if ((rv = transport->receive(transport, &msg)) <= 0) {
+        /* Check for error receiving command */
+        if (rv == 0) {
+            stats.dropped++;
+            print_error("get_command: Received empty datagram. Datagram discarded", 0, 0);
+        } else {
+            /* Check for server timeout */
+            if (errno == EAGAIN || errno == EWOULDBLOCK){
+                return 0;
+            } else if (errno != EINTR) {    // interrupted by a request for the server stats
+                print_error("get_command", errno, 0);
+            }
+        }
+        return ERROR_CODE;
+    }
+    stats.received++;
+    receiveDelay = account_datagram(transport->sd, &msg);
+    /* Validate the command, unless that was done before it reached the transport */
+    if (!transport->validated && !validate_command(datagram)) {
+        stats.dropped++;
+        return ERROR_CODE;
+    }
+    return rv;
+}
+
+/**
+ * @brief Validates the data and syntax of a received command based on the current protocol. The
+ * caller counts the command as dropped if it is invalid.
+ * 
+ * @param datagram The datagram containing the command that the remote player sent.
+ * @return True if the command is valid, false if it should be discarded.
+ */
+int validate_command(const struct Buffer *datagram) {
+    if (datagram->version != VERSION) {  // check for correct version
+        print_error("get_command: Protocol version not supported. Datagram discarded", 0, 0);
+        return 0;
+    } else if (datagram->seqNum < 0) {  // check for valid sequence number
+        print_error("get_command: Invalid sequence number. Datagram discarded", 0, 0);
+        return 0;
+    } else if (datagram->command < NEW_GAME || datagram->command > GAME_OVER) {  // check for valid command
+        print_error("get_command: Invalid command. Datagram discarded", 0, 0);
+        return 0;
+    } else if (datagram->command != NEW_GAME && (datagram->gameNum < 1 || datagram->gameNum > MAX_GAMES)) { // check for valid game number
+        print_error("get_command: Invalid game number. Datagram discarded", 0, 0);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Checks whether any received commands are waiting in the command scheduler.
+ * 
+ * @return True if a command is waiting to be handled.
+ */
+int commands_scheduled(void) {
+    int i;
+    for (i = 0; i < NUM_PRIORITIES; i++) {
+        if (schedule[i].count > 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Finds the priority class of a received command. Commands for games already being played
+ * (and NEW_GAME resends from a player who already has a game, which are answered from that game)
+ * come before the NEW_GAME commands that would start a game and search its first move.
+ * 
+ * @param roster The array of playable TicTacToe games.
+ * @param command The received command.
+ * @return The priority class of the command.
+ */
+int classify_command(struct TTT_Game roster[MAX_GAMES], const struct Scheduled_Command *command) {
+    int i;
+    if (command->datagram.command != NEW_GAME) return PRIORITY_LIVE;
+    for (i = 0; i < MAX_GAMES; i++) {
+        if (roster[i].seqNum > 0 && same_address(&command->playerAddr, &roster[i].p2Address)) return PRIORITY_LIVE;
+    }
+    return PRIORITY_ADMISSION;
+}
+
+/**
+ * @brief Adds a received command to the queue of its priority class. A NEW_GAME that finds its
+ * queue full is shed.
+ * 
+ * @param roster The array of playable TicTacToe games.
+ * @param command The received command (with its length and arrival time).
+ * @return True if the command was queued.
+ */
+int schedule_command(struct TTT_Game roster[MAX_GAMES], const struct Scheduled_Command *command) {
+    int class = classify_command(roster, command);
+    struct Command_Queue *queue = &schedule[class];
+    if (queue->count == SCHEDULE_QUEUE_SIZE) {
+        if (class == PRIORITY_ADMISSION) stats.shed++;
+        return 0;
+    }
+    queue->commands[(queue->head + queue->count++) % SCHEDULE_QUEUE_SIZE] = *command;
+    if (queue->count > stats.scheduledMax[class]) stats.scheduledMax[class] = queue->count;
+    return 1;
+}
+
+/**
+ * @brief Receives a command from the remote players and adds it to the command scheduler. The
+ * arrival time of the command includes the time it waited in the socket queue, if known.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param roster The array of playable TicTacToe games.
+ * @return The number of bytes received for the command, 0 if the server timed out, or an error
+ * code if an error occured.
+ */
+int receive_command(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]) {
+    struct Scheduled_Command command = {{0}};
+    if ((command.length = get_command(transport, &command.playerAddr, &command.datagram, command.cookie)) > 0) {
+        command.arrived = get_time() - receiveDelay;
+        schedule_command(roster, &command);
+    }
+    return command.length;
+}
+
+/**
+ * @brief Moves every command that can be received without waiting into the command scheduler,
+ * until the transport runs dry or the queue for live games is full (the rest stay queued in the
+ * transport). Transports that can't tell whether a command is waiting are not drained.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param roster The array of playable TicTacToe games.
+ */
+void drain_commands(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]) {
+    if (transport->ready == NULL) return;
+    while (schedule[PRIORITY_LIVE].count < SCHEDULE_QUEUE_SIZE && transport->ready(transport)) {
+        if (receive_command(transport, roster) == 0) break;
+    }
+}
+
+/**
+ * @brief Takes the next command to handle from the command scheduler, after draining the commands
+ * waiting in the transport. Commands for live games go first, then NEW_GAME commands in the order
+ * they arrived, shedding any that waited longer than SHED_DELAY (the player resends them).
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param roster The array of playable TicTacToe games.
+ * @param command The command taken.
+ * @return The number of bytes in the command, or an error code if no command is left.
+ */
+int next_command(struct Transport *transport, struct TTT_Game roster[MAX_GAMES], struct Scheduled_Command *command) {
+    int i;
+    drain_commands(transport, roster);
+    for (i = 0; i < NUM_PRIORITIES; i++) {
+        struct Command_Queue *queue = &schedule[i];
+        while (queue->count > 0) {
+            *command = queue->commands[queue->head];
+            queue->head = (queue->head + 1) % SCHEDULE_QUEUE_SIZE;
+            queue->count--;
+            /* Shed new sessions that can no longer be started in time */
+            if (i == PRIORITY_ADMISSION && get_time() - command->arrived > SHED_DELAY) {
+                stats.shed++;
+                continue;
+            }
+            return command->length;
+        }
+    }
+    return ERROR_CODE;
+}
+
+/**
+ * @brief Handles the NEW_GAME command from the remote player. Initializes a new game, if
+ * available, and sends the first move to the remote player.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param playerAddr The address of the remote player.
+ * @param datagram The datagram containing the command that the remote player sends.
+ * @param game The current game of TicTacToe being played.
+ */
+void new_game(struct Transport *transport, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game) {
+    printf("Player at %s (port %d) issued a NEW_GAME command\n", inet_ntoa(playerAddr->sin_addr), playerAddr->sin_port);
+    /* Refuse Ultimate TicTacToe when its moves would be searched inline */
+    if (datagram->data == ULTIMATE_REQUEST && !options.ultimate) {
+        print_error("new_game: Ultimate TicTacToe needs search threads (-w)", 0, 0);
+        return;
+    }
+    /* Check that there was an open game to play */
+    if (game != NULL) {
+        /* Increment sequence number for next command to send to remote player */
+        game->seqNum++;
+        /* Register player address to game (ending any finished games they had) and initialize the board */
+        remove_tombstones(playerAddr);
+        game->p2Address = *playerAddr;
+        game->type = (datagram->data == ULTIMATE_REQUEST) ? GAME_ULTIMATE : GAME_CLASSIC;
+        init_shared_state(game);
+        game->started = get_wall_time();
+        game->lastMoved = get_time();
+        printf("Player assigned to Game #%d%s. Beginning game...\n", game->gameNum, (game->type == GAME_ULTIMATE) ? " (Ultimate TicTacToe)" : "");
+        /* Make the first move and send it to remote player */
+        request_p1_move(transport, game);
+    } else {
+        print_error("new_game: Unable to find an open game", 0, 0);
+    }
+}
+
+/**
+ * @brief Handles the MOVE command from the remote player. Receives and processes a move
+ * from the remote player and sends a move back. If the game has ended from a move, an
+ * appropriate message is printed. If the game ends from a move from the remote player,
+ * a GAME_OVER command is rent back in response.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param playerAddr The address of the remote player.
+ * @param datagram The datagram containing the command that the remote player sends.
+ * @param game The current game of TicTacToe being played.
+ */
+void move(struct Transport *transport, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game) {
+    /* Get move from remote player */
+    int move = decode_move(game, datagram->data);
+    printf("Player at %s (port %d) issued a MOVE command\n", inet_ntoa(playerAddr->sin_addr), playerAddr->sin_port);
+    printf("********  Game #%d  ********\n", game->gameNum);
+    /* Check that the command came from the player registered to the game */
+    if (same_address(playerAddr, &game->p2Address)) {
+        printf("Player 2 chose the move:  %d\n", move);
+        /* Check that the received move is valid */
+        if (validate_move(move, game)) {
+            /* Increment sequence number for next command to send to remote player */
+            game->seqNum++;
+            /* Update the board (for Player 2) and check if someone won */
+            mark_square(game, move, P2_MARK);
+            if (check_game_over(game)) {
+                /* If Player 2 won, send GAME_OVER command */
+                send_game_over(transport, game);
+                return;
+            }
+            /* If nobody won, make a move to send to the remote player */
+            request_p1_move(transport, game);
+        } else {
+            reset_game(game);
+        }
+    } else {
+        print_error("move: Player address does not match that registered to game", 0, 0);
+        printf("Game address: %s (port %d)\n", inet_ntoa(game->p2Address.sin_addr), game->p2Address.sin_port);
+    }
+}
+
+/**
+ * @brief Handles the GAME_OVER command from the remote player. Determines the reason for
+ * ending the game, prints the appropriate message, and resets the game.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param playerAddr The address of the remote player.
+ * @param datagram The datagram containing the command that the remote player sends.
+ * @param game The current game of TicTacToe being played.
+ */
+void game_over(struct Transport *transport, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game) {
+    printf("Player at %s (port %d) issued a GAME_OVER command\n", inet_ntoa(playerAddr->sin_addr), playerAddr->sin_port);
+    printf("********  Game #%d  ********\n", game->gameNum);
+    /* Check that the command came from the player registered to the game */
+    if (same_address(playerAddr, &game->p2Address)) {
+        printf("Player 2 has signaled that the game is over\n");
+        /* Check if the game is actually over */
+        if (game->winner < 0) {
+            /* If not over, player decided to leave prematurely */
+            print_error("game_over: Game is still in progress", 0, 0);
+            printf("Player 2 has decided to leave the game\n");
+        } else {
+            /* If over, print appropriate message for who won */
+            (game->winner == 0) ? printf("==>\a It's a draw\n") : printf("==>\a Player %d wins\n", game->winner);
+        }
+        /* Reset the game */
+        reset_game(game);
+    } else {
+        print_error("move: Player address does not match that registered to game", 0, 0);
+        printf("Game address: %s (port %d)\n", inet_ntoa(game->p2Address.sin_addr), game->p2Address.sin_port);
+    }
+}
+
+/**
+ * @brief Checks the sequence number of the received datagram with the corresponding game to make sure
+ * that the sequence number is valid.
+ * 
+ * @param playerAddr The address of the remote player.
+ * @param datagram The datagram containing the command that the remote player sends.
+ * @param game The current game of TicTacToe being played.
+ * @return A positive number if the sequence number for the current game is valid, 0 if it is a duplicate,
+ * an error code (-2) if it has already been processed, and an error code (-1) if it is invalid.
+ */
+int validate_sequence_num(const struct sockaddr_in *playerAddr, const struct Buffer *datagram, const struct TTT_Game *game) {
+    /* Number is automatically valid if no open games to play of player address doesn't match address registered to game */
+    if (game != NULL && same_address(playerAddr, &game->p2Address)) {
+        if (datagram->seqNum > game->seqNum) {  // received new sequence before previous one could be processed
+            printf("Game #%d received an invalid sequence number\n", game->gameNum);
+            return -1;
+        } else if (datagram->seqNum == game->seqNum-1) {    // received duplicate sequence
+            printf("Game #%d received a duplicate command\n", game->gameNum);
+            return 0;
+        } else if (datagram->seqNum < game->seqNum-1) {   // received sequence that has already been processed
+            printf("Game #%d received a command that has already been processed\n", game->gameNum);
+            return -2;
+        } else {
+            return 1;
+        }
+    } else {
+        return 1;
+    }
+}
+
+/**
+ * @brief Resends the previous command that was sent to the remote player.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param game The current game of TicTacToe being played.
+ */
+void resend_command(struct Transport *transport, struct TTT_Game *game) {
+    /* Checks that max resends has not been exceeded and decrements count */
+    if (game->resends-- > 0) {
+        /* Pack last sent command into a datagram to send */
+        struct Buffer datagram = game->lastSent;
+        /* Print the command being resent */
+        int v = datagram.version, sn = datagram.seqNum, cmd = datagram.command, pos = datagram.data, gn = datagram.gameNum;
+        printf("Game #%d: Resending the previous command... \n", game->gameNum);
+        game->numResends++;
+        printf("\tver: %d, seq#: %02d, command: %d, pos: %c (0x%2X), game#: %02d\n", v, sn, cmd, pos, datagram.data, gn);
+        /* Send previously sent command to remote player */
+        if (transport->send(transport, &datagram, sizeof(struct Buffer), &game->p2Address) < 0) {
+            /* Reset game if there was an error sending the command */
+            print_error("resend_command", errno, 0);
+            reset_game(game);
+        }
+    } else {
+        /* Exceeded max resends -> reset game */
+        print_error("resend_command: Exceeded maximum allowed resend attempts", 0, 0);
+        reset_game(game);
+    }
+}
+
+/**
+ * @brief Schedules a resend of the previous command sent in a game. The resend is delayed by a
+ * random jitter that doubles with each resend already made in the game, so games that timed out
+ * together don't stay in step. Transports that don't pace their resends send it right away.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param roster The array of playable TicTacToe games.
+ * @param gameIndx The index of the game to resend the command of.
+ * @param delay The number of seconds to delay the resend by (before jitter).
+ */
+void schedule_resend(struct Transport *transport, struct TTT_Game roster[MAX_GAMES], int gameIndx, double delay) {
+    struct TTT_Game *game = &roster[gameIndx];
+    int attempts = MAX_RESENDS - game->resends;
+    if (transport->pace) {
+        delay += (RESEND_JITTER * (1 << ((attempts > 0) ? attempts : 0))) * rand_r(&resends.seed) / ((double)RAND_MAX + 1);
+    } else {
+        delay = 0;
+    }
+    resends.due[gameIndx] = get_time() + delay;
+    resends.seqNum[gameIndx] = game->seqNum;
+}
+
+/**
+ * @brief Schedules a resend for every game in progress after the server times out. Instead of
+ * going out back to back, the resends are spread evenly across RESEND_SPREAD seconds (on top of
+ * their jitter). Games waiting on the server's own move, or with a resend already scheduled, are
+ * skipped.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param roster The array of playable TicTacToe games.
+ */
+void schedule_resends(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]) {
+    int i, k = 0, numGames = 0;
+    for (i = 0; i < MAX_GAMES; i++) {
+        numGames += (roster[i].seqNum > 0 && !searchPool.pending[i]);
+    }
+    for (i = 0; i < MAX_GAMES; i++) {
+        struct TTT_Game *game = &roster[i];
+        if (game->seqNum == 0 || searchPool.pending[i]) continue;
+        if (resends.due[i] == 0 || resends.seqNum[i] != game->seqNum) schedule_resend(transport, roster, i, RESEND_SPREAD * k / numGames);
+        k++;
+    }
+}
+
+/**
+ * @brief Gets the time the next scheduled resend is due.
+ * 
+ * @return The time the next resend is due, or 0 if none is scheduled.
+ */
+double next_resend_due(void) {
+    int i;
+    double due = 0;
+    for (i = 0; i < MAX_GAMES; i++) {
+        if (resends.due[i] > 0 && (due == 0 || resends.due[i] < due)) due = resends.due[i];
+    }
+    return due;
+}
+
+/**
+ * @brief Sends the scheduled resends that are due (or will be within RESEND_COALESCE seconds, so
+ * they go out together rather than each waking the server) as one batch of at most RESEND_BATCH,
+ * earliest first (transports that don't pace their resends send them all at once). A resend to
+ * an IP address that was sent a resend less than RESEND_GAP seconds ago is deferred until the gap
+ * has passed, and a resend for a game that has moved on (or ended) since it was scheduled is
+ * dropped.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param roster The array of playable TicTacToe games.
+ */
+void send_due_resends(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]) {
+    int order[MAX_GAMES], numDue = 0, batch = 0, i, j;
+    double now = get_time();
+    /* Find the resends that are due, earliest first */
+    for (i = 0; i < MAX_GAMES; i++) {
+        if (resends.due[i] == 0 || resends.due[i] > now + RESEND_COALESCE) continue;
+        for (j = numDue++; j > 0 && resends.due[order[j-1]] > resends.due[i]; j--) order[j] = order[j-1];
+        order[j] = i;
+    }
+    for (i = 0; i < numDue && (batch < RESEND_BATCH || !transport->pace); i++) {
+        int g = order[i];
+        struct TTT_Game *game = &roster[g];
+        double lastSent = 0;
+        /* Drop the resend if the game has moved on since it was scheduled */
+        if (game->seqNum == 0 || game->seqNum != resends.seqNum[g] || searchPool.pending[g]) {
+            resends.due[g] = 0;
+            continue;
+        }
+        /* Pace the resends to each destination (over a network, where bursts overflow buffers) */
+        for (j = 0; j < MAX_GAMES; j++) {
+            if (roster[j].p2Address.sin_addr.s_addr == game->p2Address.sin_addr.s_addr && resends.lastSent[j] > lastSent) lastSent = resends.lastSent[j];
+        }
+        if (transport->pace && lastSent > 0 && now - lastSent < RESEND_GAP) {
+            resends.due[g] = lastSent + RESEND_GAP;
+            stats.resendsDeferred++;
+            continue;
+        }
+        resends.due[g] = 0;
+        resends.lastSent[g] = now;
+        resend_command(transport, game);
+        batch++;
+    }
+    if (batch == 0) return;
+    /* Count the batch and the resend rate over one second windows */
+    stats.resends += batch;
+    stats.resendBatches++;
+    if (batch > stats.resendBurstMax) stats.resendBurstMax = batch;
+    if (now - resends.windowStart >= 1.0) {
+        resends.windowStart = now;
+        resends.windowCount = 0;
+    }
+    resends.windowCount += batch;
+    if (resends.windowCount > stats.resendRateMax) stats.resendRateMax = resends.windowCount;
+}
+
+/**
+ * @brief Determines whether a given move is legal (i.e. a square on the board) and valid (i.e. hasn't
+ * already been played) for the current game.
+ * 
+ * @param choice The player move to be validated.
+ * @param game The current game of TicTacToe being played.
+ * @return True if the given move if valid based on the current game, false otherwise. 
+ */
+int validate_move(int choice, const struct TTT_Game *game) {
+    /* Check to see if the choice is a move on the board */
+    if (choice < 1 || choice > ((game->type == GAME_ULTIMATE) ? ULTIMATE_SQUARES : ttt_SQUARES)) {
+        print_error("Invalid move: Must be a square on the board", 0, 0);
+        return 0;
+    }
+    /* Check to see if the square chosen has a digit in it, if */
+    /* square 8 has an '8' then it is a valid choice (Ultimate */
+    /* TicTacToe squares must also be on the board in play)    */
+    if ((game->type == GAME_ULTIMATE) ? !ultimate_legal(&game->ultimate, choice-1) : game->board[choice-1] != (choice + '0')) {
+        print_error("Invalid move: Square already taken", 0, 0);
+        return 0;
+    }
+    /* Check to see if the game has already ended */
+    if (game->winner > 0) {
+        print_error("Invalid move: Winning move has already been made", 0, 0);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Decodes the move carried by the data of a MOVE command: the square's digit for a classic
+ * game, or the square number itself for Ultimate TicTacToe (whose squares run past '9').
+ * 
+ * @param game The current game of TicTacToe being played.
+ * @param data The data of the MOVE command.
+ * @return The square (from 1) that was played.
+ */
+int decode_move(const struct TTT_Game *game, char data) {
+    return (game->type == GAME_ULTIMATE) ? (unsigned char)data : data - '0';
+}
+
+/**
+ * @brief Encodes a move into the data of a MOVE command, the reverse of decode_move().
+ * 
+ * @param game The current game of TicTacToe being played.
+ * @param move The square (from 1) being played.
+ * @return The data of the MOVE command.
+ */
+char encode_move(const struct TTT_Game *game, int move) {
+    return (game->type == GAME_ULTIMATE) ? move : move + '0';
+}
+
+/**
+ * @brief Places a player's mark on a square of the game board.
+ * 
+ * @param game The current game of TicTacToe being played.
+ * @param move The square (from 1) being played, already validated.
+ * @param mark The mark of the player making the move.
+ */
+void mark_square(struct TTT_Game *game, int move, char mark) {
+    if (game->type == GAME_ULTIMATE) {
+        ultimate_play(&game->ultimate, move-1);
+    } else {
+        game->board[move-1] = mark;
+    }
+    /* Add the move (and how long it took) to the moves of the game */
+    if (game->numMoves < HISTORY_MAX_MOVES) {
+        double now = get_time(), micros = (now - game->lastMoved) * 1e6;
+        game->moves[game->numMoves].square = move;
+        game->moves[game->numMoves].micros = (micros < UINT32_MAX) ? micros : UINT32_MAX;
+        game->numMoves++;
+        game->lastMoved = now;
+    }
+}
+
+/**
+ * @brief Builds the key a position is remembered under: both players' bitboards (mapped to their
+ * canonical symmetry unless the table stores positions as played) and the side to move.
+ * 
+ * @param table The table the position is looked up in.
+ * @param p1 The squares held by Player 1.
+ * @param p2 The squares held by Player 2.
+ * @param isMax Whether it is Player 1's turn.
+ * @param sym The symmetry mapping the position to its key.
+ * @return The key of the position (never 0).
+ */
+uint64_t position_key(const struct Position_Table *table, uint32_t p1, uint32_t p2, int isMax, int *sym) {
+    uint64_t key;
+    if (table->raw) {
+        *sym = 0;
+        key = (uint64_t)p2 << ttt_SQUARES | p1;
+    } else {
+        key = ttt_canonical(p1, p2, sym);
+    }
+    return key | (uint64_t)isMax << 62 | 1ull << 63;
+}
+
+/**
+ * @brief Finds the slot of a position in a table, probing a few slots past its hash.
+ * 
+ * @param table The table to search.
+ * @param key The key of the position.
+ * @return The slot holding the position, else an empty slot to remember it in, or NULL if the
+ * probed slots all hold other positions.
+ */
+struct Position_Entry *find_position(struct Position_Table *table, uint64_t key) {
+    unsigned i, slot = (key * 0x9E3779B97F4A7C15ull) >> 52;
+    for (i = 0; i < POSITION_PROBES; i++) {
+        struct Position_Entry *entry = &table->entries[(slot + i) & (POSITION_TABLE_SIZE-1)];
+        if (entry->key == key || entry->key == 0) return entry;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Looks a position up in a table, counting the lookup.
+ * 
+ * @param table The table to search (or the shared table it stands for).
+ * @param key The key of the position.
+ * @param value The remembered minimax value of the position.
+ * @param move The remembered best square (from 0), in the orientation of the key.
+ * @return True if the position was found.
+ */
+int recall_position(struct Position_Table *table, uint64_t key, int *value, int *move) {
+    table->lookups++;
+    if (table->shared != NULL) {
+        /* Read both words of the shared entry, checking that they belong together */
+        struct Shared_Position *entry = &table->shared[(key * 0x9E3779B97F4A7C15ull) >> 43 & (SHARED_TABLE_SIZE-1)];
+        uint64_t data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+        if ((__atomic_load_n(&entry->check, __ATOMIC_RELAXED) ^ data) != key) return 0;
+        *value = (int8_t)(data & 0xFF);
+        *move = (int8_t)(data >> 8 & 0xFF);
+    } else {
+        struct Position_Entry *entry = find_position(table, key);
+        if (entry == NULL || entry->key != key) return 0;
+        *value = entry->value;
+        *move = entry->move;
+    }
+    table->hits++;
+    return 1;
+}
+
+/**
+ * @brief Remembers the result of a position in a table. A shared table always replaces the entry
+ * in the position's slot, while a thread's own table keeps the first positions stored.
+ * 
+ * @param table The table to store the position in (or the shared table it stands for).
+ * @param key The key of the position.
+ * @param value The minimax value of the position.
+ * @param move The best square (from 0), in the orientation of the key.
+ */
+void remember_position(struct Position_Table *table, uint64_t key, int value, int move) {
+    if (table->shared != NULL) {
+        struct Shared_Position *entry = &table->shared[(key * 0x9E3779B97F4A7C15ull) >> 43 & (SHARED_TABLE_SIZE-1)];
+        uint64_t data = (uint8_t)value | (uint64_t)(uint8_t)move << 8;
+        __atomic_store_n(&entry->data, data, __ATOMIC_RELAXED);
+        __atomic_store_n(&entry->check, key ^ data, __ATOMIC_RELAXED);
+        table->stored++;
+    } else {
+        struct Position_Entry *entry = find_position(table, key);
+        if (entry == NULL) {
+            table->dropped++;
+            return;
+        }
+        entry->key = key;
+        entry->value = value;
+        entry->move = move;
+        table->stored++;
+    }
+}
+
+/**
+ * @brief Provides an optimal move for the maximizing player assuming that minimizing player
+ * is also playing optimally. The board is searched as a bitboard per player, and each position
+ * searched is remembered in a table, so positions reached again (by another move order, as a
+ * rotation or reflection of the board, or in a later game) are not searched again.
+ * 
+ * @param table The table of positions remembered by earlier searches.
+ * @param p1 The squares held by Player 1 (the maximizer).
+ * @param p2 The squares held by Player 2 (the minimizer).
+ * @param isMax Whether it is the maximizers turn or not.
+ * @param move The best square (from 0) for the side to move, or NULL if not needed.
+ * @return The best score achievable for the maximizer, shrinking by one for every move it takes
+ * to reach the end of the game.
+ */
+int minimax(struct Position_Table *table, uint32_t p1, uint32_t p2, int isMax, int *move) {
+    const int score = ttt_SQUARES + 1;
+    int i, sym, best, bestMove = -1, numMoves = 0, squares[ROWS*COLUMNS];
+    uint32_t after1[ROWS*COLUMNS], after2[ROWS*COLUMNS];
+    uint8_t states[ROWS*COLUMNS];
+    uint64_t key;
+    /* Check for base case */
+    if (ttt_win(p1)) {    // maximizer won
+        return score;
+    } else if (ttt_win(p2)) {    // minimizer won
+        return -score;
+    } else if (ttt_full(p1 | p2)) {  // nobody won
+        return 0;
+    }
+    /* Use the remembered result if the position (or one of its symmetries) was searched */
+    key = position_key(table, p1, p2, isMax, &sym);
+    if (recall_position(table, key, &best, &bestMove)) {
+        if (move != NULL) *move = ttt_unmap_square(sym, bestMove);
+        return best;
+    }
+    /* Classify the positions after every possible move (the open squares) in one batch */
+    for (i = 0; i < ttt_SQUARES; i++) {
+        if ((p1 | p2) >> i & 1) continue;
+        squares[numMoves] = i;
+        after1[numMoves] = (isMax) ? p1 | 1u << i : p1;
+        after2[numMoves++] = (isMax) ? p2 : p2 | 1u << i;
+    }
+    ttt_classify(after1, after2, numMoves, states);
+    /* A move winning right away is the best there is, so nothing else needs searching */
+    for (i = 0; i < numMoves && states[i] != ((isMax) ? BOARD_P1_WIN : BOARD_P2_WIN); i++);
+    if (i < numMoves) {
+        best = (isMax) ? score : -score;
+        bestMove = squares[i];
+    } else {
+        /* Initialize best score for maximizer/minimizer */
+        best = (isMax) ? INT32_MIN : INT16_MAX;
+        /* Searches over all possible moves, only recursing into the games still going */
+        for (i = 0; i < numMoves; i++) {
+            int value = (states[i] == BOARD_DRAW) ? 0 : minimax(table, after1[i], after2[i], !isMax, NULL);
+            /* Get best score for move and update best move if the score was better */
+            if ((isMax) ? value > best : value < best) {
+                best = value;
+                bestMove = squares[i];
+            }
+        }
+    }
+    /* The end of the game is one more move away from this position */
+    best -= (best > 0) - (best < 0);
+    /* Remember the result (with the move in the orientation of the key) */
+    remember_position(table, key, best, ttt_map_square(sym, bestMove));
+    if (move != NULL) *move = bestMove;
+    return best;
+}
+
+/**
+ * @brief Finds the optimal move to make to win the game based on the current state of
+ * the game board.
+ * 
+ * @param game The current game of TicTacToe being played.
+ * @return The optimal move to make in order to win. 
+ */
+int find_best_move(struct TTT_Game *game) {
+    int move = -1, sym;
+    uint32_t p1 = ttt_bits(game->board, P1_MARK), p2 = ttt_bits(game->board, P2_MARK);
+    uint64_t key;
+    /* Ultimate TicTacToe is too large to search fully, so its moves are found by playouts instead */
+    if (game->type == GAME_ULTIMATE) return mcts_best_move(game)+1;
+    /* Look the move up if the position is solved, or was searched before by any game or thread */
+    if (solvedPositions != NULL && (move = find_solved_move(p1, p2)) != -1) return move+1;
+    key = ttt_canonical(p1, p2, &sym);
+    if (!moveCache.disabled && (move = lookup_cached_move(key)) != -1) return ttt_unmap_square(sym, move)+1;
+    /* Otherwise search it and cache the move found */
+    if (parallel.numThreads > 1) {
+        move = parallel_best_move(p1, p2);
+    } else {
+        minimax(&positionTable, p1, p2, 1, &move);
+    }
+    if (!moveCache.disabled) cache_move(key, ttt_map_square(sym, move));
+    return move+1;
+}
+
+/**
+ * @brief Starts the helper threads that split each move search with the thread searching, and
+ * allocates the transposition table they share. If any errors are found, the function terminates
+ * the process.
+ * 
+ * @param numThreads The number of threads splitting each search, 1 to search on one thread.
+ */
+void start_parallel_search(int numThreads) {
+    int i;
+    sigset_t signals;
+    if (numThreads <= 1) return;
+    /* Allocate the shared table and each thread's view of it */
+    if ((parallel.shared = calloc(SHARED_TABLE_SIZE, sizeof(struct Shared_Position))) == NULL) print_error("start_parallel_search: calloc", errno, 1);
+    for (i = 0; i < numThreads; i++) {
+        if ((parallel.tables[i] = calloc(1, sizeof(struct Position_Table))) == NULL) print_error("start_parallel_search: calloc", errno, 1);
+        parallel.tables[i]->shared = parallel.shared;
+    }
+    /* Start the helpers with the stats signal blocked, so it interrupts the server thread */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    for (i = 1; i < numThreads; i++) {
+        if ((errno = pthread_create(&parallel.threads[i], NULL, parallel_search_helper, (void *)(intptr_t)i)) != 0) {
+            print_error("start_parallel_search: pthread_create", errno, 1);
+        }
+    }
+    pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+    parallel.numThreads = numThreads;
+    printf("[+]Splitting each move search across %d threads.\n", numThreads);
+}
+
+/**
+ * @brief Takes part in each parallel search as a helper thread, forever.
+ * 
+ * @param arg The index of the helper thread.
+ * @return Never returns.
+ */
+void *parallel_search_helper(void *arg) {
+    int thread = (intptr_t)arg, active;
+    unsigned seen = 0;
+    while (1) {
+        /* Wait for the next search to start (that this thread takes part in) */
+        pthread_mutex_lock(&parallel.lock);
+        while (parallel.generation == seen) pthread_cond_wait(&parallel.started, &parallel.lock);
+        seen = parallel.generation;
+        active = (thread < parallel.numThreads);
+        pthread_mutex_unlock(&parallel.lock);
+        if (!active) continue;
+        /* Do its share of the search, then report back */
+        parallel.work(thread);
+        pthread_mutex_lock(&parallel.lock);
+        if (--parallel.busy == 0) pthread_cond_signal(&parallel.finished);
+        pthread_mutex_unlock(&parallel.lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Takes the next task of the current search for a thread: the first of its own tasks, or
+ * else the last task of another thread that still has some.
+ * 
+ * @param thread The index of the thread.
+ * @return The index of the task, or -1 if no tasks are left.
+ */
+int take_search_task(int thread) {
+    int i;
+    for (i = 0; i < parallel.numThreads; i++) {
+        struct Search_Range *range = &parallel.ranges[(thread + i) % parallel.numThreads];
+        uint64_t seen = __atomic_load_n(&range->range, __ATOMIC_ACQUIRE);
+        while ((uint32_t)seen < (uint32_t)(seen >> 32)) {
+            uint32_t first = seen, last = seen >> 32;
+            /* Take from the front of its own range, or steal from the back of another's */
+            uint64_t left = (i == 0) ? (uint64_t)last << 32 | (first+1) : (uint64_t)(last-1) << 32 | first;
+            if (__atomic_compare_exchange_n(&range->range, &seen, left, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return (i == 0) ? first : last-1;
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Searches tasks of the current search until none are left.
+ * 
+ * @param thread The index of the thread.
+ */
+void run_search_tasks(int thread) {
+    int task;
+    while ((task = take_search_task(thread)) != -1) {
+        struct Search_Task *t = &parallel.tasks[task];
+        t->value = minimax(parallel.tables[thread], t->p1, t->p2, 1, NULL);
+    }
+}
+
+/**
+ * @brief Runs the current search on every parallel search thread, the calling thread taking part
+ * as thread 0, and waits for all of them to finish. The caller must hold the search lock.
+ * 
+ * @param work The function running a thread's share of the search.
+ * @param context The state of the search shared by its threads.
+ */
+void run_parallel(void (*work)(int thread), void *context) {
+    /* Start the helpers */
+    pthread_mutex_lock(&parallel.lock);
+    parallel.work = work;
+    parallel.context = context;
+    parallel.busy = parallel.numThreads - 1;
+    parallel.generation++;
+    pthread_cond_broadcast(&parallel.started);
+    pthread_mutex_unlock(&parallel.lock);
+    /* Work alongside the helpers, then wait for them to finish */
+    work(0);
+    pthread_mutex_lock(&parallel.lock);
+    while (parallel.busy > 0) pthread_cond_wait(&parallel.finished, &parallel.lock);
+    pthread_mutex_unlock(&parallel.lock);
+}
+
+/**
+ * @brief Finds Player 1's best move by splitting the search across the parallel search threads.
+ * The search is split into a task per move of Player 1 and reply of Player 2, so the threads
+ * balance their work by stealing tasks, and the results are combined as minimax would.
+ * 
+ * @param p1 The squares held by Player 1.
+ * @param p2 The squares held by Player 2.
+ * @return The best square (from 0) for Player 1.
+ */
+int parallel_best_move(uint32_t p1, uint32_t p2) {
+    const int score = ttt_SQUARES + 1;
+    int i, j, numTasks = 0, bestMove = -1, bestValue = INT32_MIN, moveValue[ROWS*COLUMNS];
+    pthread_mutex_lock(&parallel.searchLock);
+    /* Make a task for each move and reply (moves that win right away need no task) */
+    for (i = 0; i < ttt_SQUARES; i++) {
+        uint32_t after = p1 | 1u << i;
+        if ((p1 | p2) >> i & 1) continue;
+        moveValue[i] = ttt_win(after) ? score : ttt_full(after | p2) ? 0 : INT16_MAX;
+        if (moveValue[i] != INT16_MAX) continue;
+        for (j = 0; j < ttt_SQUARES; j++) {
+            if ((after | p2) >> j & 1) continue;
+            parallel.tasks[numTasks++] = (struct Search_Task){after, p2 | 1u << j, i, 0};
+        }
+    }
+    /* Deal the tasks out in contiguous ranges and start the helpers */
+    for (i = 0; i < parallel.numThreads; i++) {
+        uint64_t first = numTasks * i / parallel.numThreads, last = numTasks * (i+1) / parallel.numThreads;
+        __atomic_store_n(&parallel.ranges[i].range, last << 32 | first, __ATOMIC_RELEASE);
+    }
+    run_parallel(run_search_tasks, NULL);
+    /* Each move is worth its worst reply, one move further from the end of the game */
+    for (i = 0; i < numTasks; i++) {
+        struct Search_Task *t = &parallel.tasks[i];
+        if (t->value < moveValue[t->move]) moveValue[t->move] = t->value;
+    }
+    for (i = 0; i < ttt_SQUARES; i++) {
+        if ((p1 | p2) >> i & 1) continue;
+        if (moveValue[i] != score) moveValue[i] -= (moveValue[i] > 0) - (moveValue[i] < 0);
+        if (moveValue[i] > bestValue) {
+            bestValue = moveValue[i];
+            bestMove = i;
+        }
+    }
+    pthread_mutex_unlock(&parallel.searchLock);
+    return bestMove;
+}
+
+/**
+ * @brief Benchmarks splitting a search across threads by solving the empty board with 1 thread,
+ * then doubling the threads up to the number of CPUs (and at least 2), with a cleared shared table
+ * for each run, reporting the positions searched per second and the speedup over 1 thread. The
+ * board is the one the server was built for, so build with 'make SIDE=4' for a deep search.
+ */
+void bench_parallel(void) {
+    long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+    int numThreads, i, move, firstMove = -1;
+    double firstElapsed = 0;
+    start_parallel_search(MAX_SEARCH_THREADS);
+    for (numThreads = 1; numThreads <= MAX_SEARCH_THREADS; numThreads *= 2) {
+        unsigned long nodes = 0;
+        double start, elapsed;
+        /* Start from a cleared table */
+        memset(parallel.shared, 0, SHARED_TABLE_SIZE * sizeof(struct Shared_Position));
+        for (i = 0; i < MAX_SEARCH_THREADS; i++) parallel.tables[i]->lookups = 0;
+        parallel.numThreads = numThreads;
+        start = get_time();
+        move = parallel_best_move(0, 0);
+        elapsed = get_time() - start;
+        for (i = 0; i < numThreads; i++) nodes += parallel.tables[i]->lookups;
+        if (numThreads == 1) {
+            firstMove = move;
+            firstElapsed = elapsed;
+        }
+        printf("parallel: %2d thread(s) %9lu positions in %7.3f s (%6.2f M/s), %.2fx speedup, best move %d%s\n", numThreads, nodes,
+            elapsed, nodes / elapsed / 1e6, firstElapsed / elapsed, move+1, (move == firstMove) ? "" : " (differs)");
+        if (numThreads >= numCPUs && numThreads >= 2) break;
+    }
+}
+
+/**
+ * @brief Maps a solved-position database (written by tictactoeSolve) read-only, so every server on
+ * the host shares its pages. If the file can't be mapped or wasn't solved for this server's board,
+ * the function terminates the process.
+ * 
+ * @param path The database file.
+ */
+void map_solved_positions(const char *path) {
+    int fd;
+    struct stat fileInfo;
+    const struct Solved_Header *header;
+    /* Map the whole file */
+    if ((fd = open(path, O_RDONLY)) == -1) print_error("map_solved_positions: open", errno, 1);
+    if (fstat(fd, &fileInfo) == -1) print_error("map_solved_positions: fstat", errno, 1);
+    if (fileInfo.st_size < sizeof(struct Solved_Header)) print_error("map_solved_positions: File is not a solved-position database", 0, 1);
+    header = mmap(NULL, fileInfo.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) print_error("map_solved_positions: mmap", errno, 1);
+    close(fd);
+    /* Check that the database is complete (with an empty slot to end lookups) and solves this board */
+    if (memcmp(header->magic, SOLVED_MAGIC, sizeof(header->magic)) != 0 || header->size == 0 || (header->size & (header->size-1)) != 0
+        || header->positions >= header->size || fileInfo.st_size != sizeof(struct Solved_Header) + (off_t)header->size * sizeof(struct Solved_Entry)) {
+        print_error("map_solved_positions: File is not a solved-position database", 0, 1);
+    }
+    if (header->rows != ROWS || header->columns != COLUMNS || header->inARow != IN_A_ROW) {
+        print_error("map_solved_positions: Database was solved for a different board (build with 'make SIDE=...')", 0, 1);
+    }
+    solvedPositions = header;
+    printf("[+]Mapped %u solved positions (%dx%d, %d in a row) from %s.\n", header->positions, ROWS, COLUMNS, IN_A_ROW, path);
+}
+
+/**
+ * @brief Looks Player 1's best move up in the solved-position database.
+ * 
+ * @param p1 The squares held by Player 1.
+ * @param p2 The squares held by Player 2.
+ * @return The best square (from 0) for Player 1, or -1 if the position isn't in the database.
+ */
+int find_solved_move(uint32_t p1, uint32_t p2) {
+    const struct Solved_Entry *entry;
+    int sym;
+    uint32_t key = (uint32_t)ttt_canonical(p1, p2, &sym);
+    /* Find the canonical position and map its move back to this board's orientation */
+    entry = solved_find((const struct Solved_Entry *)(solvedPositions + 1), solvedPositions->size, key);
+    if (entry->key != key) {
+        __atomic_fetch_add(&stats.solvedMisses, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    __atomic_fetch_add(&stats.solvedMoves, 1, __ATOMIC_RELAXED);
+    return ttt_unmap_square(sym, entry->move);
+}
+
+/**
+ * @brief Finds the bucket of the move cache a position is kept in.
+ * 
+ * @param key The canonical key of the position.
+ * @return The index of the first slot of the bucket.
+ */
+unsigned move_cache_bucket(uint64_t key) {
+    return ((key * 0x9E3779B97F4A7C15ull) >> 32) & (MOVE_CACHE_SIZE - MOVE_CACHE_WAYS);
+}
+
+/**
+ * @brief Looks a position up in the move cache shared by every game and thread, marking it as
+ * recently used if it is there.
+ * 
+ * @param key The canonical key of the position.
+ * @return The best square (from 0) for Player 1 in the orientation of the key, or -1 if the
+ * position isn't cached.
+ */
+int lookup_cached_move(uint64_t key) {
+    uint64_t *bucket = &moveCache.slots[move_cache_bucket(key)];
+    int i;
+    for (i = 0; i < MOVE_CACHE_WAYS; i++) {
+        uint64_t slot = __atomic_load_n(&bucket[i], __ATOMIC_RELAXED);
+        if (slot != 0 && CACHE_KEY(slot) == key) {
+            /* Give the slot a second chance against eviction (only writing it if it lost its last one) */
+            if (!(slot & CACHE_REFERENCED)) __atomic_fetch_or(&bucket[i], CACHE_REFERENCED, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&moveCache.hits, 1, __ATOMIC_RELAXED);
+            return CACHE_MOVE(slot);
+        }
+    }
+    __atomic_fetch_add(&moveCache.misses, 1, __ATOMIC_RELAXED);
+    return -1;
+}
+
+/**
+ * @brief Adds a searched position to the move cache shared by every game and thread. The position
+ * takes an empty slot of its bucket if there is one, otherwise the bucket's clock hand sweeps its
+ * slots, clearing the reference bit of each recently used slot it passes and replacing the first
+ * slot found without one. Every slot is a single word changed with a CAS, so no locks are taken.
+ * 
+ * @param key The canonical key of the position.
+ * @param move The best square (from 0) for Player 1 in the orientation of the key.
+ */
+void cache_move(uint64_t key, int move) {
+    unsigned first = move_cache_bucket(key);
+    uint64_t *bucket = &moveCache.slots[first], entry = CACHE_SLOT(key, move), seen;
+    unsigned char *hand = &moveCache.hands[first / MOVE_CACHE_WAYS];
+    int i;
+    /* Take an empty slot, unless another thread cached the position meanwhile */
+    for (i = 0; i < MOVE_CACHE_WAYS; i++) {
+        seen = __atomic_load_n(&bucket[i], __ATOMIC_RELAXED);
+        if (seen != 0 && CACHE_KEY(seen) == key) return;
+        if (seen == 0 && __atomic_compare_exchange_n(&bucket[i], &seen, entry, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            __atomic_fetch_add(&moveCache.stored, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    /* Otherwise evict the first slot the clock hand finds that wasn't used since it last came round */
+    for (i = 0; i < 2 * MOVE_CACHE_WAYS; i++) {
+        int way = __atomic_fetch_add(hand, 1, __ATOMIC_RELAXED) % MOVE_CACHE_WAYS;
+        seen = __atomic_load_n(&bucket[way], __ATOMIC_RELAXED);
+        if (seen & CACHE_REFERENCED) {
+            __atomic_compare_exchange_n(&bucket[way], &seen, seen & ~CACHE_REFERENCED, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        } else if (__atomic_compare_exchange_n(&bucket[way], &seen, entry, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            __atomic_fetch_add(&moveCache.evicted, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Plays games against random moves on one thread of the move cache benchmark, searching
+ * each of the server's moves with find_best_move().
+ * 
+ * @param arg The seed of the thread's random moves.
+ * @return The number of moves searched.
+ */
+void *bench_cache_player(void *arg) {
+    struct TTT_Game game = {0};
+    unsigned seed = (uintptr_t)arg;
+    uintptr_t moves = 0;
+    int g;
+    game.gameNum = 1;
+    for (g = 0; g < BENCH_GAMES; g++) {
+        uint32_t p1, p2;
+        init_shared_state(&game);
+        while (1) {
+            int move, i, numOpen;
+            /* Play the server's move */
+            move = find_best_move(&game);
+            game.board[move-1] = P1_MARK;
+            moves++;
+            p1 = ttt_bits(game.board, P1_MARK);
+            p2 = ttt_bits(game.board, P2_MARK);
+            if (ttt_win(p1) || ttt_full(p1 | p2)) break;
+            /* Answer with a random open square */
+            numOpen = ttt_SQUARES - __builtin_popcount(p1 | p2);
+            for (move = 0, i = rand_r(&seed) % numOpen; ((p1 | p2) >> move & 1) || i-- > 0; move++);
+            game.board[move] = P2_MARK;
+            if (ttt_win(p2 | 1u << move) || ttt_full(p1 | p2 | 1u << move)) break;
+        }
+    }
+    return (void *)moves;
+}
+
+/**
+ * @brief Benchmarks the move cache by playing games against random moves on 1 thread and then
+ * doubling the threads up to the number of CPUs (and at least 2), each run starting from an empty
+ * cache, and once more on 1 thread with the cache bypassed. Reports the moves per second, the hit
+ * rate and the positions cached and evicted for each run.
+ */
+void bench_cache(void) {
+    long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t threads[MAX_SEARCH_THREADS];
+    int numThreads, i, enabled;
+    for (enabled = 0; enabled <= 1; enabled++) {
+        for (numThreads = 1; numThreads <= MAX_SEARCH_THREADS; numThreads *= 2) {
+            unsigned long moves = 0, hits, misses;
+            double start, elapsed;
+            void *threadMoves;
+            /* Start from an empty cache (or none) */
+            memset(&moveCache, 0, sizeof(moveCache));
+            moveCache.disabled = !enabled;
+            start = get_time();
+            for (i = 0; i < numThreads; i++) {
+                if ((errno = pthread_create(&threads[i], NULL, bench_cache_player, (void *)(uintptr_t)(i+1))) != 0) print_error("bench_cache: pthread_create", errno, 1);
+            }
+            for (i = 0; i < numThreads; i++) {
+                pthread_join(threads[i], &threadMoves);
+                moves += (uintptr_t)threadMoves;
+            }
+            elapsed = get_time() - start;
+            hits = moveCache.hits;
+            misses = moveCache.misses;
+            printf("cache: %-8s %2d thread(s) %7lu moves in %6.3f s (%8.0f moves/s), %5.1f%% hit, %lu positions cached, %lu evicted\n",
+                enabled ? "shared" : "bypassed", numThreads, moves, elapsed, moves / elapsed, (hits + misses > 0) ? 100.0 * hits / (hits + misses) : 0.0,
+                moveCache.stored, moveCache.evicted);
+            if (!enabled || (numThreads >= numCPUs && numThreads >= 2)) break;
+        }
+    }
+}
+
+/**
+ * @brief Benchmarks remembering the positions searched under their canonical symmetry against
+ * remembering them as played, by searching the server's moves of games against a player making
+ * random legal moves with a fresh table each way, and reporting the positions each table holds,
+ * its memory and its hit rate.
+ */
+void bench_symmetry(void) {
+    int raw;
+    for (raw = 1; raw >= 0; raw--) {
+        struct Position_Table *table = calloc(1, sizeof(struct Position_Table));
+        unsigned seed = 1;
+        unsigned long moves = 0;
+        double start, elapsed;
+        int g;
+        if (table == NULL) print_error("bench_symmetry: calloc", errno, 1);
+        table->raw = raw;
+        start = get_time();
+        for (g = 0; g < BENCH_GAMES; g++) {
+            uint32_t p1 = 0, p2 = 0;
+            while (1) {
+                int move = -1, i, numOpen;
+                /* Play the server's move */
+                minimax(table, p1, p2, 1, &move);
+                p1 |= 1u << move;
+                moves++;
+                if (ttt_win(p1) || ttt_full(p1 | p2)) break;
+                /* Answer with a random open square */
+                numOpen = ttt_SQUARES - __builtin_popcount(p1 | p2);
+                for (move = 0, i = rand_r(&seed) % numOpen; ((p1 | p2) >> move & 1) || i-- > 0; move++);
+                p2 |= 1u << move;
+                if (ttt_win(p2) || ttt_full(p1 | p2)) break;
+            }
+        }
+        elapsed = get_time() - start;
+        printf("symmetry: %-9s %5lu positions (%6.1f KB), %lu not stored, %5.1f%% of %lu lookups hit, %.1f us/move over %d games\n",
+            raw ? "raw" : "canonical", table->stored, table->stored * sizeof(struct Position_Entry) / 1024.0, table->dropped,
+            100.0 * table->hits / table->lookups, table->lookups, elapsed * 1e6 / moves, BENCH_GAMES);
+        free(table);
+    }
+}
+
+/**
+ * @brief Benchmarks classifying boards in batches with the SIMD kernels against checking them one
+ * at a time with check_win() and check_draw(), over positions of games played with random moves,
+ * reporting the boards classified per second by each kernel the CPU supports (and checking that
+ * every kernel agrees with check_win()).
+ */
+void bench_classify(void) {
+    struct {
+        const char *name;
+        void (*classify)(const uint32_t *p1, const uint32_t *p2, int count, uint8_t *states);
+    } kernels[] = {{"scalar", ttt_classify_scalar},
+#if defined(__x86_64__) || defined(__i386__)
+        {"avx2", __builtin_cpu_supports("avx2") ? ttt_classify_avx2 : NULL},
+#endif
+    };
+    struct TTT_Game *games = calloc(BENCH_POSITIONS, sizeof(struct TTT_Game));
+    uint32_t p1[BENCH_POSITIONS], p2[BENCH_POSITIONS];
+    uint8_t expected[BENCH_POSITIONS], states[BENCH_POSITIONS];
+    unsigned seed = 1;
+    int i, k, batch, rep, mismatches;
+    double start, elapsed, reference;
+    if (games == NULL) print_error("bench_classify: calloc", errno, 1);
+    /* Play random moves from the empty board, stopping at a random point (or the end of the game) */
+    for (i = 0; i < BENCH_POSITIONS; i++) {
+        int length = rand_r(&seed) % (ttt_SQUARES + 1), move, n;
+        reset_game(&games[i]);
+        for (n = 0; n < length && !check_win(&games[i]) && !check_draw(&games[i]); n++) {
+            do {
+                move = rand_r(&seed) % ttt_SQUARES;
+            } while (games[i].board[move] != '1' + move);
+            games[i].board[move] = (n % 2 == 0) ? P1_MARK : P2_MARK;
+        }
+        p1[i] = ttt_bits(games[i].board, P1_MARK);
+        p2[i] = ttt_bits(games[i].board, P2_MARK);
+    }
+    /* Check the boards one at a time */
+    start = get_time();
+    for (rep = 0; rep < BENCH_REPEATS; rep++) {
+        for (i = 0; i < BENCH_POSITIONS; i++) {
+            int score = check_win(&games[i]);
+            expected[i] = (score > 0) ? BOARD_P1_WIN : (score < 0) ? BOARD_P2_WIN : check_draw(&games[i]) ? BOARD_DRAW : BOARD_OPEN;
+        }
+    }
+    reference = get_time() - start;
+    printf("classify: check_win           %7.1f M boards/s\n", (double)BENCH_POSITIONS * BENCH_REPEATS / reference / 1e6);
+    /* Classify them in batches with each kernel */
+    for (k = 0; k < sizeof(kernels)/sizeof(kernels[0]); k++) {
+        if (kernels[k].classify == NULL) {
+            printf("classify: %-9s           not supported by this CPU\n", kernels[k].name);
+            continue;
+        }
+        for (batch = 8; batch <= 32; batch *= 2) {
+            memset(states, 0xFF, sizeof(states));
+            start = get_time();
+            for (rep = 0; rep < BENCH_REPEATS; rep++) {
+                for (i = 0; i < BENCH_POSITIONS; i += batch) kernels[k].classify(p1 + i, p2 + i, batch, states + i);
+            }
+            elapsed = get_time() - start;
+            for (i = 0, mismatches = 0; i < BENCH_POSITIONS; i++) mismatches += (states[i] != expected[i]);
+            printf("classify: %-9s batch %2d  %7.1f M boards/s (%.2fx check_win)%s%s\n", kernels[k].name, batch,
+                (double)BENCH_POSITIONS * BENCH_REPEATS / elapsed / 1e6, reference / elapsed,
+                (kernels[k].classify == ttt_classify) ? ", selected" : "", mismatches ? ", MISMATCHES" : "");
+        }
+    }
+    free(games);
+}
+
+/**
+ * @brief Sends Player 1's move to the remote player.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param game The current game of TicTacToe being played.
+ * @param move The move to send.
+ * @return The move that was sent, or an error code if there was an issue. 
+ */
+int send_p1_move(struct Transport *transport, struct TTT_Game *game, int move) {
+    struct Buffer datagram = {0};
+    /* Pack move information into datagram */
+    datagram.version = VERSION;
+    datagram.seqNum = game->seqNum++;
+    datagram.command = MOVE;
+    datagram.data = encode_move(game, move);
+    datagram.gameNum = game->gameNum;
+    /* Send the move to the remote player */
+    printf("Server sent the move:  %d\n", move);
+    if (transport->send(transport, &datagram, sizeof(struct Buffer), &game->p2Address) < 0) {
+        print_error("send_p1_move", errno, 0);
+        return ERROR_CODE;
+    }
+    /* Update last sent command for game */
+    game->lastSent = datagram;
+    return decode_move(game, datagram.data);
+}
+
+/**
+ * @brief Sends Player 1's move to the remote player and plays it on the board, printing the
+ * board unless the move ended the game. If the move can't be sent, the game is reset.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param game The current game of TicTacToe being played.
+ * @param move The move to play.
+ * @return The move that was played, or an error code if there was an issue.
+ */
+int play_p1_move(struct Transport *transport, struct TTT_Game *game, int move) {
+    /* Send the move (resetting the game if there was an error sending it) */
+    if (send_p1_move(transport, game, move) == ERROR_CODE) {
+        reset_game(game);
+        return ERROR_CODE;
+    }
+    /* Update the board (for Player 1) and check if someone won */
+    mark_square(game, move, P1_MARK);
+    if (!check_game_over(game)) print_board(game);
+    return move;
+}
+
+/**
+ * @brief Makes Player 1's next move in a game. If the search thread pool is running, the search
+ * is queued and the move is played once a worker has found it, otherwise the move is searched
+ * for and played right away.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param game The current game of TicTacToe being played.
+ */
+void request_p1_move(struct Transport *transport, struct TTT_Game *game) {
+    int move;
+    /* Hand the search to the pool so the server can keep receiving commands */
+    if (searchPool.numThreads > 0) {
+        submit_search(game);
+        return;
+    }
+    /* Otherwise search for the move here */
+    move = find_best_move(game);
+    while (!validate_move(move, game)) move = find_best_move(game);
+    play_p1_move(transport, game, move);
+}
+
+/**
+ * @brief Starts the worker threads that search the server's moves. If any errors are found, the
+ * function terminates the process.
+ * 
+ * @param numThreads The number of worker threads, 0 to search moves inline.
+ */
+void start_search_pool(int numThreads) {
+    int i;
+    sigset_t signals;
+    if (numThreads <= 0) return;
+    /* Create the eventfd the workers wake the server through */
+    if ((searchPool.event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) print_error("start_search_pool: eventfd", errno, 1);
+    /* Start the workers with the stats signal blocked, so it interrupts the server thread */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    for (i = 0; i < numThreads; i++) {
+        if ((errno = pthread_create(&searchPool.threads[i], NULL, search_worker, NULL)) != 0) print_error("start_search_pool: pthread_create", errno, 1);
+    }
+    pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+    searchPool.numThreads = numThreads;
+    printf("[+]Searching moves on %d worker thread(s).\n", numThreads);
+}
+
+/**
+ * @brief Searches the best move of each queued job and hands it back to the server, forever.
+ * 
+ * @param arg Unused.
+ * @return Never returns.
+ */
+void *search_worker(void *arg) {
+    uint64_t one = 1;
+    while (1) {
+        struct Search_Job job;
+        /* Wait for a search to be queued */
+        pthread_mutex_lock(&searchPool.lock);
+        while (searchPool.jobHead == searchPool.jobTail) pthread_cond_wait(&searchPool.jobReady, &searchPool.lock);
+        job = searchPool.jobs[searchPool.jobHead++ % SEARCH_QUEUE_SIZE];
+        pthread_mutex_unlock(&searchPool.lock);
+        /* Search the copy of the game */
+        job.waited = get_time() - job.submitted;
+        job.move = find_best_move(&job.game);
+        /* Hand the result back and wake the server */
+        pthread_mutex_lock(&searchPool.lock);
+        searchPool.results[searchPool.resultTail++ % SEARCH_QUEUE_SIZE] = job;
+        pthread_mutex_unlock(&searchPool.lock);
+        if (write(searchPool.event, &one, sizeof(one)) == -1) print_error("search_worker: write", errno, 0);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Queues the search of Player 1's next move in a game for the search thread pool.
+ * 
+ * @param game The current game of TicTacToe being played.
+ */
+void submit_search(const struct TTT_Game *game) {
+    struct Search_Job *job;
+    int depth;
+    /* Queue a copy of the game, since the game itself can change while it is being searched */
+    pthread_mutex_lock(&searchPool.lock);
+    job = &searchPool.jobs[searchPool.jobTail++ % SEARCH_QUEUE_SIZE];
+    job->game = *game;
+    job->submitted = get_time();
+    depth = searchPool.jobTail - searchPool.jobHead;
+    pthread_cond_signal(&searchPool.jobReady);
+    pthread_mutex_unlock(&searchPool.lock);
+    /* Mark the search as in flight and track the queue depth */
+    searchPool.pending[game->gameNum-1] = 1;
+    if (depth > stats.searchQueueMax) stats.searchQueueMax = depth;
+}
+
+/**
+ * @brief Plays the moves found by the search thread pool, sending each to its remote player. A
+ * move is dropped if its game was reset or reassigned while it was being searched.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param roster The array of playable TicTacToe games.
+ */
+void collect_searches(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]) {
+    uint64_t count;
+    /* Clear the wakeup before taking the results, so a search finishing meanwhile wakes the server again */
+    if (read(searchPool.event, &count, sizeof(count)) == -1 && errno != EAGAIN) print_error("collect_searches: read", errno, 0);
+    while (1) {
+        struct Search_Job job;
+        struct TTT_Game *game;
+        /* Take the next result (if any) */
+        pthread_mutex_lock(&searchPool.lock);
+        if (searchPool.resultHead == searchPool.resultTail) {
+            pthread_mutex_unlock(&searchPool.lock);
+            break;
+        }
+        job = searchPool.results[searchPool.resultHead++ % SEARCH_QUEUE_SIZE];
+        pthread_mutex_unlock(&searchPool.lock);
+        game = &roster[job.game.gameNum-1];
+        searchPool.pending[job.game.gameNum-1] = 0;
+        stats.searches++;
+        stats.searchWait += job.waited;
+        if (job.waited > stats.searchWaitMax) stats.searchWaitMax = job.waited;
+        /* Check that the game is still where it was when the search was requested */
+        if (game->seqNum != job.game.seqNum || !same_address(&game->p2Address, &job.game.p2Address)
+            || memcmp(game->board, job.game.board, sizeof(game->board)) != 0 || !ultimate_same(&game->ultimate, &job.game.ultimate)) {
+            printf("Game #%d changed while its move was searched. Move discarded\n", game->gameNum);
+            continue;
+        }
+        /* Play the move and restart the game timeout clock for the player's reply */
+        printf("********  Game #%d  ********\n", game->gameNum);
+        if (play_p1_move(transport, game, job.move) != ERROR_CODE && game->winner < 0) game->timeout = GAME_TIMEOUT;
+    }
+    /* Seal the changes made to the games so they survive a restart */
+    seal_game_roster(roster);
+}
+
+/**
+ * @brief Waits for every search in flight to finish and plays the moves found, so the games can
+ * be handed off to a new server binary.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param roster The array of playable TicTacToe games.
+ */
+void wait_for_searches(struct Transport *transport, struct TTT_Game roster[MAX_GAMES]) {
+    int i;
+    for (i = 0; i < MAX_GAMES; i++) {
+        while (searchPool.pending[i]) {
+            struct pollfd event = {searchPool.event, POLLIN, 0};
+            poll(&event, 1, -1);
+            collect_searches(transport, roster);
+        }
+    }
+}
+
+/**
+ * @brief Determines if someone has won the game yet or not.
+ * 
+ * @param game The current game of TicTacToe being played.
+ * @return True if a player has won the game and false if the game is still going on. 
+ */
+int check_win(const struct TTT_Game *game) {
+    const int score = sizeof(game->board) + 1;
+    /* Check each player's squares for a line. Return a +/- score if the */
+    /* game is 'over' or return 0 if game should go on.                  */
+    if (game->type == GAME_ULTIMATE) {
+        return (game->ultimate.result == 0) ? score : (game->ultimate.result == 1) ? -score : 0;
+    } else if (ttt_win(ttt_bits(game->board, P1_MARK))) {
+        return score;
+    } else if (ttt_win(ttt_bits(game->board, P2_MARK))) {
+        return -score;
+    } else {
+        return 0;  // return of 0 means keep playing
+    }
+}
+
+/**
+ * @brief Determines if there are moves left in the game to be made or not.
+ * 
+ * @param game The current game of TicTacToe being played.
+ * @return True if there are no moves left to be made, false otherwise. 
+ */
+int check_draw(const struct TTT_Game *game) {
+    /* Check if every board square has been played (or every small board closed without a winner) */
+    if (game->type == GAME_ULTIMATE) return game->ultimate.result == 2;
+    return ttt_full(ttt_bits(game->board, P1_MARK) | ttt_bits(game->board, P2_MARK));
+}
+
+/**
+ * @brief Prints out the current state of the game board nicely formatted.
+ * 
+ * @param game The current game of TicTacToe being played.
+ */
+void print_board(const struct TTT_Game *game) {
+    /* Print header info */
+    printf("\n\n\tTicTacToe Game #%d\n\n", game->gameNum);
+    printf("Player 1 (%c)  -  Player 2 (%c)\n\n\n", P1_MARK, P2_MARK);
+    /* Print current state of board */
+    (game->type == GAME_ULTIMATE) ? print_ultimate(&game->ultimate) : ttt_print(game->board);
+}
+
+/**
+ * @brief Checks if the current game has ended and prints the appropriate message.
+ * 
+ * @param game The current game of TicTacToe being played.
+ * @return True if the game has ended, false otherwise. 
+ */
+int check_game_over(struct TTT_Game *game) {
+    int score;
+    /* Check if somebody won the game */
+    if ((score = check_win(game))) {
+        game->winner = (score > 0) ? 1 : 2;
+    } else if (check_draw(game)) {
+        game->winner = 0;
+    } else {
+        return 0;
+    }
+    /* Print final game board and winning player */
+    print_board(game);
+    (game->winner == 0) ? printf("==>\a It's a draw\n") : printf("==>\a Player %d wins\n", game->winner);
+    return 1;
+}
+
+/**
+ * @brief Sends GAME_OVER command to the remote player and moves the current game into a
+ * tombstone to listen for any commands from the remote player that may need to be processed
+ * to end the game. The game itself is freed for a new player right away.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param game The current game of TicTacToe being played.
+ */
+void send_game_over(struct Transport *transport, struct TTT_Game *game) {
+    struct Buffer datagram = {0};
+    /* Pack command information into datagram */
+    datagram.version = VERSION;
+    datagram.seqNum = game->seqNum;
+    datagram.command = GAME_OVER;
+    datagram.gameNum = game->gameNum;
+    /* Update last sent command for game */
+    game->lastSent = datagram;
+    /* Send the command to the remote player */
+    printf("Server sent the GAME_OVER command to Player 2\n");
+    if (transport->send(transport, &datagram, sizeof(struct Buffer), &game->p2Address) < 0) {
+        print_error("send_game_over", errno, 0);
+        reset_game(game);
+        return;
+    }
+    /* Wait out the grace period in a tombstone and free the game */
+    bury_game(game);
+}
+
+/**
+ * @brief Moves a finished game into a tombstone holding only what is needed to answer the remote
+ * player during the grace period, and resets the game for a new player. If every tombstone is in
+ * use, the one closest to the end of its grace period is reused.
+ * 
+ * @param game The current game of TicTacToe being played.
+ */
+void bury_game(struct TTT_Game *game) {
+    int i;
+    struct TTT_Tombstone *tombstone = &tombstones[0];
+    /* Find a free tombstone, or the one with the least time left */
+    for (i = 0; i < MAX_TOMBSTONES && tombstone->gameOver.command == GAME_OVER; i++) {
+        if (tombstones[i].gameOver.command != GAME_OVER || tombstones[i].timeout < tombstone->timeout) tombstone = &tombstones[i];
+    }
+    /* Move the finished game into the tombstone for the grace period */
+    tombstone->p2Address = game->p2Address;
+    tombstone->winner = game->winner;
+    tombstone->timeout = 2 * GAME_TIMEOUT;
+    tombstone->gameOver = game->lastSent;
+    reset_game(game);
+}
+
+/**
+ * @brief Finds the tombstone of the finished game that a command from the remote player is for.
+ * 
+ * @param playerAddr The address of the remote player.
+ * @param datagram The datagram containing the command that the remote player sends.
+ * @return The tombstone of the finished game, or NULL if the command is not for a finished game.
+ */
+struct TTT_Tombstone *find_tombstone(const struct sockaddr_in *playerAddr, const struct Buffer *datagram) {
+    int i;
+    /* NEW_GAME commands are never for a finished game */
+    if (datagram->command == NEW_GAME) return NULL;
+    /* Searches over all tombstones */
+    for (i = 0; i < MAX_TOMBSTONES; i++) {
+        struct TTT_Tombstone *tombstone = &tombstones[i];
+        /* Check if the tombstone is for the player and game number of the command */
+        if (tombstone->gameOver.command == GAME_OVER && tombstone->gameOver.gameNum == datagram->gameNum
+            && same_address(playerAddr, &tombstone->p2Address)) return tombstone;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Handles a command from the remote player for a finished game. A GAME_OVER command ends
+ * the grace period, while a duplicate of the final move means the GAME_OVER command got lost and
+ * it is resent. Any other command is ignored.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param playerAddr The address of the remote player.
+ * @param datagram The datagram containing the command that the remote player sends.
+ * @param tombstone The tombstone of the finished game.
+ */
+void answer_tombstone(struct Transport *transport, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Tombstone *tombstone) {
+    struct sockaddr_in blankAddr = {0};
+    struct Buffer blankCommand = {0};
+    printf("********  Game #%d (finished)  ********\n", tombstone->gameOver.gameNum);
+    if (datagram->command == GAME_OVER) {
+        /* Remote player acknowledged the end of the game -> clear the tombstone */
+        printf("Player 2 has signaled that the game is over\n");
+        (tombstone->winner == 0) ? printf("==>\a It's a draw\n") : printf("==>\a Player %d wins\n", tombstone->winner);
+        tombstone->p2Address = blankAddr;
+        tombstone->gameOver = blankCommand;
+    } else if (datagram->seqNum == tombstone->gameOver.seqNum-1) {
+        /* Remote player resent the final move -> resend the GAME_OVER command */
+        printf("Game #%d received a duplicate command. Resending the GAME_OVER command...\n", tombstone->gameOver.gameNum);
+        if (transport->send(transport, &tombstone->gameOver, sizeof(struct Buffer), playerAddr) < 0) {
+            print_error("answer_tombstone", errno, 0);
+        }
+    } else {
+        printf("Game #%d received a command that has already been processed\n", tombstone->gameOver.gameNum);
+    }
+}
+
+/**
+ * @brief Clears the tombstones of a remote player, who has moved on to a new game.
+ * 
+ * @param playerAddr The address of the remote player.
+ */
+void remove_tombstones(const struct sockaddr_in *playerAddr) {
+    int i;
+    struct sockaddr_in blankAddr = {0};
+    struct Buffer blankCommand = {0};
+    /* Searches over all tombstones */
+    for (i = 0; i < MAX_TOMBSTONES; i++) {
+        struct TTT_Tombstone *tombstone = &tombstones[i];
+        if (tombstone->gameOver.command == GAME_OVER && same_address(playerAddr, &tombstone->p2Address)) {
+            tombstone->p2Address = blankAddr;
+            tombstone->gameOver = blankCommand;
         }
     }
-    return gameIndex;
 }
 
 /**
- * @brief Gets a command from the remote player and attempts to validate the data and syntax
- * based on the current protocol.
+ * @brief Updates the grace period of each tombstone and clears those that have run out.
  * 
- * @param sd The socket descriptor of the server comminication endpoint.
+ * @param elapsed The number of seconds elapsed since the tombstones were last updated.
+ * @return The number of tombstones still waiting out their grace period.
+ */
+int age_tombstones(double elapsed) {
+    int i, count = 0;
+    struct sockaddr_in blankAddr = {0};
+    struct Buffer blankCommand = {0};
+    /* Searches over all tombstones */
+    for (i = 0; i < MAX_TOMBSTONES; i++) {
+        struct TTT_Tombstone *tombstone = &tombstones[i];
+        if (tombstone->gameOver.command != GAME_OVER) continue;
+        /* Grace period over -> clear the tombstone */
+        if ((tombstone->timeout -= elapsed) <= 0) {
+            printf("Haven't heard back after sending GAME_OVER command for Game #%d\n", tombstone->gameOver.gameNum);
+            tombstone->p2Address = blankAddr;
+            tombstone->gameOver = blankCommand;
+        } else {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Handles a command received from a remote player, replying through the transport. The
+ * command is checked against the rate limiter (and the handshake cookie if required), answered
+ * from a tombstone if it belongs to a finished game, and otherwise dispatched to its game.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param roster The array of playable TicTacToe games.
  * @param playerAddr The address of the remote player.
- * @param datagram The datagram to store the command that the remote player sends.
- * @return The number of bytes received for the command, or an error code if an error occured. 
+ * @param datagram The datagram containing the command that the remote player sent.
+ * @param cookie The handshake cookie received after the command, if any.
+ * @param length The number of bytes received.
+ * @return The index of the game the command was dispatched to, or an error code if it wasn't.
  */
-int get_command(int sd, struct sockaddr_in *playerAddr, struct Buffer *datagram) {
-    int rv;
-    socklen_t fromLength = sizeof(struct sockaddr_in);
-    /* Receive and validate command from remote player */
-    if ((rv = recvfrom(sd, datagram, sizeof(struct Buffer), 0, (struct sockaddr *)playerAddr, &fromLength)) <= 0) {
-        /* Check for error receiving command */
-        if (rv == 0) {
-            print_error("get_command: Received empty datagram. Datagram discarded", 0, 0);
+int handle_command(struct Transport *transport, struct TTT_Game roster[MAX_GAMES], const struct sockaddr_in *playerAddr,
+        const struct Buffer *datagram, const unsigned char cookie[COOKIE_SIZE], int length) {
+    int rv, gameIndx = ERROR_CODE;
+    struct TTT_Tombstone *tombstone;
+    command_handler commands[] = {new_game, move, game_over};
+    /* Check that the player is within their command budget before handling the command */
+    if (!admit_command(playerAddr, datagram)) {
+        /* Over budget -> drop the command */
+    } else if (options.cookies && datagram->command == NEW_GAME && !check_cookie(playerAddr, cookie, length)) {
+        /* No valid cookie -> send one to the player instead of allocating a game */
+        send_cookie(transport, playerAddr);
+    } else if ((tombstone = find_tombstone(playerAddr, datagram)) != NULL) {
+        /* Command for a finished game -> answer it from the tombstone */
+        answer_tombstone(transport, playerAddr, datagram, tombstone);
+    } else {
+        /* Get game corresponding to received command */
+        struct TTT_Game *currentGame;
+        gameIndx = (datagram->command == NEW_GAME) ? find_open_game(roster) : datagram->gameNum-1;
+        currentGame = (gameIndx < 0) ? NULL : &roster[gameIndx];
+        /* Validate the sequence number of the command and handle possible duplicates */
+        if ((rv = validate_sequence_num(playerAddr, datagram, currentGame)) > 0) {
+            /* Valid sequence number -> process received command for current game and resent resend counter */
+            commands[(int)datagram->command](transport, playerAddr, datagram, currentGame);
+            if (currentGame != NULL) currentGame->resends = MAX_RESENDS;
+        } else if (rv == 0 && searchPool.pending[gameIndx]) {
+            /* Duplicate sequence number while the reply is being searched -> it is sent once found */
+        } else if (rv == 0) {
+            /* Duplicate sequence number -> resent previously sent command */
+            resend_command(transport, currentGame);
+        } else if (rv == -1) {
+            /* Invalid sequence number -> reset game */
+            print_error("handle_command: Unable to process out of order command", 0, 0);
+            reset_game(currentGame);
+        }
+    }
+    return gameIndx;
+}
+
+/**
+ * @brief Plays multiple games of TicTacToe with remoye players that end when either
+ * someone wins, there is a draw, or the remote player leaves the game.
+ * 
+ * @param transport The transport carrying commands to and from the remote players.
+ * @param upgradeSd The socket descriptor listening for upgrade requests, or -1 if disabled.
+ * @param gameRoster The array of playable TicTacToe games.
+ */
+void tictactoe(struct Transport *transport, int upgradeSd, struct TTT_Game gameRoster[MAX_GAMES]) {
+    int waitPrompt = 1;
+
+    /* Set server timeout time, or set up the socket to be busy-polled (transports without a socket time out on their own) */
+    if (transport->sd != -1) (options.busyPoll) ? set_busy_poll(transport->sd) : set_timeout(transport->sd, SERVER_TIMEOUT);
+    /* Play all the games */
+    while (1) {
+        int rv;
+        double start, stop;
+        struct Scheduled_Command command;
+        /* Start clock for elapsed time from last command */
+        if (waitPrompt && !commands_scheduled()) printf("[+]Waiting for another player to issue a command...\n");
+        start = get_time();
+        /* Wait for a command to be received unless some are already scheduled (handing off the server if a new binary asks for it) */
+        if (commands_scheduled()) {
+            if (searchPool.numThreads > 0) collect_searches(transport, gameRoster);
+            rv = 1;
+        } else if (options.busyPoll) {
+            rv = busy_wait_for_command(transport, upgradeSd, gameRoster, &start) ? receive_command(transport, gameRoster) : 0;
         } else {
-            /* Check for server timeout */
-            if (errno == EAGAIN || errno == EWOULDBLOCK){
-                return 0;
+            rv = ((upgradeSd == -1 && searchPool.numThreads == 0 && next_resend_due() == 0) || wait_for_command(transport, upgradeSd, gameRoster)) ? receive_command(transport, gameRoster) : 0;
+        }
+        /* Take the most urgent command (live games first, shedding stale NEW_GAME commands) */
+        if (rv > 0) rv = next_command(transport, gameRoster, &command);
+        if (rv > 0) {
+            /* Handle the received command */
+            int gameIndx = handle_command(transport, gameRoster, &command.playerAddr, &command.datagram, command.cookie, rv);
+            /* Stop clock for elapsed time from last command and update timeout clock for each ongoing game */
+            stop = get_time();
+            update_game_clocks(gameRoster, stop - start);
+            /* Reset timout clock for the game that just received the command if not over */
+            if (gameIndx >= 0 && gameRoster[gameIndx].seqNum > 0 && gameRoster[gameIndx].winner < 0) gameRoster[gameIndx].timeout = GAME_TIMEOUT;
+            /* Resend previous command for any game that has timed out */
+            check_timeout(transport, gameRoster);
+            waitPrompt = 1;
+        } else if (rv == 0) {   // server has timed out
+            int numInProgress, numWaiting;
+            /* Stop clock for elapsed time from last command and update game timeout clocks */
+            stop = get_time();
+            update_game_clocks(gameRoster, stop - start);
+            /* Check if any games are currently being played */
+            if ((numInProgress = games_in_progress(&numWaiting, gameRoster))) {
+                waitPrompt = (numWaiting < numInProgress) ? 1 : 0;
+                if (waitPrompt) {
+                    print_error("tictactoe: Nobody has responded in a while. Server has timed out", 0, 0);
+                    print_server_stats();
+                }
+                /* Resent previously sent command for each ongoing game, paced across the next few seconds */
+                schedule_resends(transport, gameRoster);
             } else {
-                print_error("get_command", errno, 0);
+                waitPrompt = 0;
             }
         }
-        return ERROR_CODE;
-    } else if (datagram->version != VERSION) {  // check for correct version
-        print_error("get_command: Protocol version not supported. Datagram discarded", 0, 0);
-        return ERROR_CODE;
-    } else if (datagram->seqNum < 0) {  // check for valid sequence number
-        print_error("get_command: Invalid sequence number. Datagram discarded", 0, 0);
-        return ERROR_CODE;
-    } else if (datagram->command < NEW_GAME || datagram->command > GAME_OVER) {  // check for valid command
-        print_error("get_command: Invalid command. Datagram discarded", 0, 0);
-        return ERROR_CODE;
-    } else if (datagram->command != NEW_GAME && (datagram->gameNum < 1 || datagram->gameNum > MAX_GAMES)) { // check for valid game number
-        print_error("get_command: Invalid game number. Datagram discarded", 0, 0);
-        return ERROR_CODE;
+        /* Send the resends that have come due */
+        send_due_resends(transport, gameRoster);
+        /* Seal the changes made to the games so they survive a restart */
+        seal_game_roster(gameRoster);
+        /* Print the server statistics if they were requested */
+        if (statsRequested) print_server_stats();
     }
-    return rv;
 }
 
 /**
- * @brief Handles the NEW_GAME command from the remote player. Initializes a new game, if
- * available, and sends the first move to the remote player.
+ * @brief Initializes the state of a game of Ultimate TicTacToe: every board empty and open, with
+ * Player 1 to move anywhere.
  * 
- * @param sd The socket descriptor of the server comminication endpoint.
- * @param playerAddr The address of the remote player.
- * @param datagram The datagram containing the command that the remote player sends.
- * @param game The current game of TicTacToe being played.
+ * @param state The state to initialize.
  */
-void new_game(int sd, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game) {
-    int move;
-    printf("Player at %s (port %d) issued a NEW_GAME command\n", inet_ntoa(playerAddr->sin_addr), playerAddr->sin_port);
-    /* Check that there was an open game to play */
-    if (game != NULL) {
-        /* Increment sequence number for next command to send to remote player */
-        game->seqNum++;
-        /* Register player address to game and initialize the board */
-        game->p2Address = *playerAddr;
-        init_shared_state(game);
-        printf("Player assigned to Game #%d. Beginning game...\n", game->gameNum);
-        /* Get first move to send to remote player */
-        if ((move = send_p1_move(sd, game)) == ERROR_CODE) {
-            /* Reset game if there was an error sending the move */
-            reset_game(game);
-            return;
+void ultimate_init(struct Ultimate_State *state) {
+    memset(state, 0, sizeof(struct Ultimate_State));
+    state->next = -1;
+    state->result = -1;
+}
+
+/**
+ * @brief Determines whether a square can be played in a game of Ultimate TicTacToe: the game isn't
+ * over, the square is open, and its small board is open and the one the last move sent the player
+ * to (if that board was open).
+ * 
+ * @param state The state of the game.
+ * @param square The square (from 0).
+ * @return True if the square can be played, false otherwise.
+ */
+int ultimate_legal(const struct Ultimate_State *state, int square) {
+    int board = square / 9, cell = square % 9;
+    if (state->result >= 0 || (state->closed >> board & 1) || (state->next >= 0 && state->next != board)) return 0;
+    return !((state->squares[0][board] | state->squares[1][board]) >> cell & 1);
+}
+
+/**
+ * @brief Plays a square for the player to move in a game of Ultimate TicTacToe, closing its small
+ * board if the move won or filled it, and ending the game once a player holds a line of small
+ * boards (or every small board is closed without one).
+ * 
+ * @param state The state of the game.
+ * @param square The square (from 0), already checked with ultimate_legal().
+ */
+void ultimate_play(struct Ultimate_State *state, int square) {
+    int board = square / 9, cell = square % 9, player = state->toMove;
+    state->squares[player][board] |= 1u << cell;
+    /* Close the small board if the move won or filled it */
+    if (utt_win(state->squares[player][board])) {
+        state->won[player] |= 1u << board;
+        state->closed |= 1u << board;
+    } else if (utt_full(state->squares[0][board] | state->squares[1][board])) {
+        state->closed |= 1u << board;
+    }
+    /* Check if the move ended the game */
+    if (utt_win(state->won[player])) {
+        state->result = player;
+    } else if (state->closed == utt_FULL) {
+        state->result = 2;
+    }
+    /* Send the other player to the small board matching the square, or anywhere if it is closed */
+    state->next = (state->closed >> cell & 1) ? -1 : cell;
+    state->toMove ^= 1;
+}
+
+/**
+ * @brief Lists the squares that can be played in a game of Ultimate TicTacToe.
+ * 
+ * @param state The state of the game.
+ * @param moves The array the squares (from 0) are listed in.
+ * @return The number of squares listed, 0 if the game is over.
+ */
+int ultimate_moves(const struct Ultimate_State *state, uint8_t moves[ULTIMATE_SQUARES]) {
+    int board, numMoves = 0;
+    if (state->result >= 0) return 0;
+    for (board = 0; board < 9; board++) {
+        uint32_t open;
+        if ((state->closed >> board & 1) || (state->next >= 0 && state->next != board)) continue;
+        /* Add each open square of the board */
+        for (open = ~(state->squares[0][board] | state->squares[1][board]) & utt_FULL; open != 0; open &= open-1) {
+            moves[numMoves++] = board*9 + __builtin_ctz(open);
+        }
+    }
+    return numMoves;
+}
+
+/**
+ * @brief Determines whether two states of a game of Ultimate TicTacToe are the same position (the
+ * rest of the state follows from the squares held and the board in play).
+ * 
+ * @param state1 The first state.
+ * @param state2 The second state.
+ * @return True if the states are the same position, false otherwise.
+ */
+int ultimate_same(const struct Ultimate_State *state1, const struct Ultimate_State *state2) {
+    return state1->next == state2->next && memcmp(state1->squares, state2->squares, sizeof(state1->squares)) == 0;
+}
+
+/**
+ * @brief Plays a game of Ultimate TicTacToe out to the end with random moves for both players.
+ * 
+ * @param state The state of the game, played out in place.
+ * @param seed The state of the xorshift random number generator used.
+ * @return The result of the game: the winning player (0 or 1), or 2 for a draw.
+ */
+int ultimate_rollout(struct Ultimate_State *state, uint32_t *seed) {
+    uint8_t moves[ULTIMATE_SQUARES];
+    int numMoves;
+    while ((numMoves = ultimate_moves(state, moves)) > 0) {
+        *seed ^= *seed << 13;
+        *seed ^= *seed >> 17;
+        *seed ^= *seed << 5;
+        ultimate_play(state, moves[(uint64_t)*seed * numMoves >> 32]);
+    }
+    return state->result;
+}
+
+/**
+ * @brief Prints out a game of Ultimate TicTacToe as a 9x9 grid of its small boards, showing the
+ * squares that can be played by their number.
+ * 
+ * @param state The state of the game.
+ */
+void print_ultimate(const struct Ultimate_State *state) {
+    int r, c;
+    for (r = 0; r < 9; r++) {
+        for (c = 0; c < 9; c++) {
+            int square = ((r/3)*3 + c/3)*9 + (r%3)*3 + c%3;
+            if (state->squares[0][square/9] >> (square%9) & 1) {
+                printf("  %c", P1_MARK);
+            } else if (state->squares[1][square/9] >> (square%9) & 1) {
+                printf("  %c", P2_MARK);
+            } else if (ultimate_legal(state, square)) {
+                printf(" %2d", square + 1);
+            } else {
+                printf("  .");
+            }
+            printf("%s", (c == 2 || c == 5) ? "  |" : (c == 8) ? "\n" : "");
         }
-        /* Update and print game board */
-        game->board[move-1] = P1_MARK;
-        print_board(game);
+        if (r == 2 || r == 5) printf("-----------+-----------+---------\n");
+    }
+    printf("\nSmall boards won: %d by Player 1, %d by Player 2\n\n", __builtin_popcount(state->won[0]), __builtin_popcount(state->won[1]));
+}
+
+/**
+ * @brief Takes a node from the pool of a Monte Carlo search tree.
+ * 
+ * @param tree The tree.
+ * @return The cleared node, or 0 if the pool is used up.
+ */
+uint32_t mcts_alloc(struct Mcts_Tree *tree) {
+    uint32_t node = tree->freeList;
+    /* Reuse a node returned to the pool, else take one never used */
+    if (node != 0) {
+        tree->freeList = tree->nodes[node].sibling;
+    } else if (tree->unused < MCTS_NODES) {
+        node = tree->unused++;
     } else {
-        print_error("new_game: Unable to find an open game", 0, 0);
+        return 0;
     }
+    memset(&tree->nodes[node], 0, sizeof(struct Mcts_Node));
+    return node;
 }
 
 /**
- * @brief Handles the MOVE command from the remote player. Receives and processes a move
- * from the remote player and sends a move back. If the game has ended from a move, an
- * appropriate message is printed. If the game ends from a move from the remote player,
- * a GAME_OVER command is rent back in response.
+ * @brief Returns a node and everything below it to the pool of a Monte Carlo search tree.
+ * 
+ * @param tree The tree.
+ * @param node The node (already unlinked from its parent, if any).
+ */
+void mcts_free(struct Mcts_Tree *tree, uint32_t node) {
+    uint32_t child = tree->nodes[node].child, next;
+    for (; child != 0; child = next) {
+        next = tree->nodes[child].sibling;
+        mcts_free(tree, child);
+    }
+    tree->nodes[node].sibling = tree->freeList;
+    tree->freeList = node;
+}
+
+/**
+ * @brief Frees the pool of nodes of a Monte Carlo search tree once its game is over, so that
+ * finished games don't each keep a pool allocated. The next search allocates a new one.
+ * 
+ * @param tree The tree.
+ */
+void mcts_release(struct Mcts_Tree *tree) {
+    pthread_mutex_lock(&tree->lock);
+    free(tree->nodes);
+    tree->nodes = NULL;
+    tree->root = tree->freeList = tree->unused = 0;
+    pthread_mutex_unlock(&tree->lock);
+}
+
+/**
+ * @brief Moves the root of a Monte Carlo search tree to the position about to be searched. If the
+ * position is a move or a move and reply below the root (the server's last move and the player's
+ * answer), its subtree and the playouts run through it are kept, and the rest of the tree goes
+ * back to the pool. Otherwise the tree starts over from the position.
+ * 
+ * @param tree The tree.
+ * @param state The state of the game to search.
+ */
+void mcts_reuse(struct Mcts_Tree *tree, const struct Ultimate_State *state) {
+    uint32_t *link, *replyLink, keep = 0;
+    if (tree->root != 0 && !ultimate_same(&tree->rootState, state)) {
+        /* Look for the position among the moves and replies below the root, unlinking it if found */
+        for (link = &tree->nodes[tree->root].child; keep == 0 && *link != 0; link = &tree->nodes[*link].sibling) {
+            struct Ultimate_State after = tree->rootState;
+            ultimate_play(&after, tree->nodes[*link].move);
+            if (ultimate_same(&after, state)) {
+                keep = *link;
+                *link = tree->nodes[keep].sibling;
+                break;
+            }
+            for (replyLink = &tree->nodes[*link].child; *replyLink != 0; replyLink = &tree->nodes[*replyLink].sibling) {
+                struct Ultimate_State reply = after;
+                ultimate_play(&reply, tree->nodes[*replyLink].move);
+                if (ultimate_same(&reply, state)) {
+                    keep = *replyLink;
+                    *replyLink = tree->nodes[keep].sibling;
+                    break;
+                }
+            }
+        }
+        /* Return the rest of the tree to the pool */
+        mcts_free(tree, tree->root);
+        tree->root = keep;
+        if (keep != 0) tree->nodes[keep].sibling = 0;
+    }
+    /* Start over if the position wasn't found */
+    if (tree->root == 0) tree->root = mcts_alloc(tree);
+    tree->rootState = *state;
+}
+
+/**
+ * @brief Adds the moves from a leaf of a Monte Carlo search tree as its children. A leaf whose
+ * moves don't all fit in the pool is left a leaf, so its playouts carry on from it.
+ * 
+ * @param tree The tree.
+ * @param node The leaf.
+ * @param state The state of the game at the leaf.
+ * @return True if the moves were added, false otherwise.
+ */
+int mcts_expand(struct Mcts_Tree *tree, uint32_t node, const struct Ultimate_State *state) {
+    uint8_t moves[ULTIMATE_SQUARES];
+    int numMoves = ultimate_moves(state, moves), i;
+    uint32_t child, next;
+    for (i = numMoves-1; i >= 0; i--) {
+        /* Give back the children added so far if the pool is used up */
+        if ((child = mcts_alloc(tree)) == 0) {
+            for (child = tree->nodes[node].child; child != 0; child = next) {
+                next = tree->nodes[child].sibling;
+                mcts_free(tree, child);
+            }
+            tree->nodes[node].child = 0;
+            return 0;
+        }
+        tree->nodes[child].move = moves[i];
+        tree->nodes[child].sibling = tree->nodes[node].child;
+        tree->nodes[node].child = child;
+    }
+    return numMoves > 0;
+}
+
+/**
+ * @brief Selects the child of a node of a Monte Carlo search tree to run the next playout through,
+ * by the upper confidence bound of its win rate (UCT). Moves never tried are tried first.
+ * 
+ * @param tree The tree.
+ * @param node The node, which has children.
+ * @return The child selected.
+ */
+uint32_t mcts_select(struct Mcts_Tree *tree, uint32_t node) {
+    double logVisits = log(tree->nodes[node].visits), bestValue = -1;
+    uint32_t child, best = 0;
+    for (child = tree->nodes[node].child; child != 0; child = tree->nodes[child].sibling) {
+        const struct Mcts_Node *n = &tree->nodes[child];
+        double value;
+        if (n->visits == 0) return child;
+        value = n->reward / (2.0 * n->visits) + MCTS_EXPLORATION * sqrt(logVisits / n->visits);
+        if (value > bestValue) {
+            bestValue = value;
+            best = child;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Runs playouts of a Monte Carlo search until its time budget (or playout limit) runs out.
+ * Each playout walks down the tree under its lock, counting itself against each node on the way
+ * before its result is known (a virtual loss) so that the threads searching at once spread over
+ * different moves, then plays the game out at random without the lock and credits the result to
+ * the nodes it went through.
+ * 
+ * @param search The search.
+ * @param thread The index of the thread running the playouts.
+ */
+void mcts_search(struct Mcts_Search *search, int thread) {
+    struct Mcts_Tree *tree = search->tree;
+    uint32_t path[ULTIMATE_SQUARES+1], node, seed = (0x9E3779B9u * (thread+1)) ^ (uint32_t)(get_time() * 1e6);
+    unsigned long done = 0;
+    int depth, i;
+    if (seed == 0) seed = 1;
+    while (__atomic_fetch_add(&search->playouts, 1, __ATOMIC_RELAXED) < MCTS_MAX_PLAYOUTS) {
+        struct Ultimate_State state;
+        int result;
+        /* Check the clock now and then */
+        if (done % MCTS_CHECK_INTERVAL == 0 && get_time() >= search->deadline) break;
+        /* Walk down to a leaf, adding its moves to the tree once it has been through enough playouts */
+        pthread_mutex_lock(&tree->lock);
+        state = tree->rootState;
+        node = tree->root;
+        tree->nodes[node].visits++;
+        path[0] = node;
+        for (depth = 1; ; depth++) {
+            if (tree->nodes[node].child == 0 && (state.result >= 0 || tree->nodes[node].visits < MCTS_EXPAND_VISITS
+                || !mcts_expand(tree, node, &state))) break;
+            node = mcts_select(tree, node);
+            tree->nodes[node].visits++;
+            ultimate_play(&state, tree->nodes[node].move);
+            path[depth] = node;
+        }
+        pthread_mutex_unlock(&tree->lock);
+        /* Play the rest of the game out at random */
+        result = ultimate_rollout(&state, &seed);
+        /* Credit the result to the player making the move into each node on the way */
+        pthread_mutex_lock(&tree->lock);
+        for (i = 1; i < depth; i++) {
+            int mover = (tree->rootState.toMove + i - 1) & 1;
+            tree->nodes[path[i]].reward += (result == mover) ? 2 : (result == 2) ? 1 : 0;
+        }
+        pthread_mutex_unlock(&tree->lock);
+        done++;
+    }
+    __atomic_fetch_add(&stats.ultimatePlayouts, done, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Runs a parallel search thread's share of the current Monte Carlo search.
+ * 
+ * @param thread The index of the thread.
+ */
+void mcts_parallel_search(int thread) {
+    mcts_search(parallel.context, thread);
+}
+
+/**
+ * @brief Finds Player 1's move in a game of Ultimate TicTacToe with a Monte Carlo tree search
+ * bounded by the move time budget (-T), run on every parallel search thread (-t). The game's tree
+ * is kept between its moves, so the search carries on from the playouts of earlier moves.
  * 
- * @param sd The socket descriptor of the server comminication endpoint.
- * @param playerAddr The address of the remote player.
- * @param datagram The datagram containing the command that the remote player sends.
  * @param game The current game of TicTacToe being played.
+ * @return The square (from 0) tried in the most playouts.
  */
-void move(int sd, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game) {
-    /* Get move from remote player */
-    int move = datagram->data - '0';
-    printf("Player at %s (port %d) issued a MOVE command\n", inet_ntoa(playerAddr->sin_addr), playerAddr->sin_port);
-    printf("********  Game #%d  ********\n", game->gameNum);
-    /* Check that the command came from the player registered to the game */
-    if (same_address(playerAddr, &game->p2Address)) {
-        printf("Player 2 chose the move:  %c\n", datagram->data);
-        /* Check that the received move is valid */
-        if (validate_move(move, game)) {
-            /* Increment sequence number for next command to send to remote player */
-            game->seqNum++;
-            /* Update the board (for Player 2) and check if someone won */
-            game->board[move-1] = P2_MARK;
-            if (check_game_over(game)) {
-                /* If Player 2 won, send GAME_OVER command */
-                send_game_over(sd, game);
-                return;
+int mcts_best_move(const struct TTT_Game *game) {
+    struct Mcts_Tree *tree = &mctsTrees[game->gameNum-1];
+    struct Mcts_Search search = {tree, get_time() + options.moveBudget, 0};
+    uint8_t moves[ULTIMATE_SQUARES];
+    uint32_t child, best = 0;
+    int move;
+    /* A forced move needs no search */
+    if (ultimate_moves(&game->ultimate, moves) == 1) return moves[0];
+    /* Allocate the game's pool of nodes on its first search, and move the root to the game's position */
+    pthread_mutex_lock(&tree->lock);
+    if (tree->nodes == NULL) {
+        if ((tree->nodes = calloc(MCTS_NODES, sizeof(struct Mcts_Node))) == NULL) print_error("mcts_best_move: calloc", errno, 1);
+        tree->unused = 1;
+    }
+    mcts_reuse(tree, &game->ultimate);
+    __atomic_fetch_add(&stats.ultimateReused, tree->nodes[tree->root].visits, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&tree->lock);
+    /* Run playouts until the budget runs out, on every parallel search thread if there are several */
+    if (parallel.numThreads > 1) {
+        pthread_mutex_lock(&parallel.searchLock);
+        run_parallel(mcts_parallel_search, &search);
+        pthread_mutex_unlock(&parallel.searchLock);
+    } else {
+        mcts_search(&search, 0);
+    }
+    /* Play the move tried in the most playouts */
+    pthread_mutex_lock(&tree->lock);
+    for (child = tree->nodes[tree->root].child; child != 0; child = tree->nodes[child].sibling) {
+        if (best == 0 || tree->nodes[child].visits > tree->nodes[best].visits) best = child;
+    }
+    move = (best != 0) ? tree->nodes[best].move : moves[0];
+    pthread_mutex_unlock(&tree->lock);
+    __atomic_fetch_add(&stats.ultimateMoves, 1, __ATOMIC_RELAXED);
+    return move;
+}
+
+/**
+ * @brief Benchmarks the Ultimate TicTacToe engine by playing games through an in-memory transport
+ * against a scripted player answering each of the server's moves with a random legal move, with
+ * the move time budget (-T) and threads (-t) given on the command line. Reports the server's
+ * results, the latency of its moves against the budget, and the playouts run per second. The
+ * server output is discarded while the games are played.
+ */
+void bench_ultimate(void) {
+    int g, stdoutFd, numSamples = 0, results[3] = {0};
+    uint32_t seed = 1;
+    double start, elapsed, samples[BENCH_ULTIMATE_GAMES * ULTIMATE_SQUARES];
+    struct Memory_Transport *memory = calloc(1, sizeof(struct Memory_Transport));
+    struct TTT_Game *roster = map_game_roster(NULL), board = {0};
+    struct Transport transport;
+    if (memory == NULL) print_error("bench_ultimate: calloc", errno, 1);
+    init_memory_transport(&transport, memory);
+    start_parallel_search(options.splitThreads);
+    /* Discard the server output */
+    fflush(stdout);
+    stdoutFd = dup(STDOUT_FILENO);
+    if (freopen("/dev/null", "w", stdout) == NULL) print_error("bench_ultimate: freopen", errno, 1);
+    start = get_time();
+    for (g = 0; g < BENCH_ULTIMATE_GAMES; g++) {
+        struct sockaddr_in playerAddr = {0};
+        struct Buffer command = {VERSION, 0, NEW_GAME, ULTIMATE_REQUEST, 0};
+        struct Memory_Datagram reply;
+        /* Each game is played from its own address so the rate limiter stays out of the way */
+        playerAddr.sin_family = AF_INET;
+        playerAddr.sin_addr.s_addr = htonl((10u << 24) | (g+1));
+        playerAddr.sin_port = htons(4444);
+        reset_game(&board);
+        board.type = GAME_ULTIMATE;
+        while (1) {
+            struct sockaddr_in fromAddr;
+            struct Buffer datagram;
+            unsigned char cookie[COOKIE_SIZE];
+            uint8_t moves[ULTIMATE_SQUARES];
+            int rv, numMoves;
+            double sent = get_time();
+            /* Hand the player's command to the server and time its reply */
+            memory_push(memory, &playerAddr, &command, sizeof(command));
+            if ((rv = get_command(&transport, &fromAddr, &datagram, cookie)) > 0) handle_command(&transport, roster, &fromAddr, &datagram, cookie, rv);
+            if (command.command == GAME_OVER || !memory_pop(memory, &reply) || reply.datagram.command.command != MOVE) break;
+            samples[numSamples++] = get_time() - sent;
+            /* Play the server's move, ending the game with GAME_OVER if it is over */
+            command = reply.datagram.command;
+            command.seqNum++;
+            mark_square(&board, decode_move(&board, command.data), P1_MARK);
+            if (board.ultimate.result >= 0) {
+                command.command = GAME_OVER;
+                continue;
+            }
+            /* Otherwise answer with a random legal square (the server ends the game if it wins) */
+            numMoves = ultimate_moves(&board.ultimate, moves);
+            command.data = encode_move(&board, moves[rand_r(&seed) % numMoves] + 1);
+            mark_square(&board, decode_move(&board, command.data), P2_MARK);
+        }
+        results[board.ultimate.result]++;
+    }
+    elapsed = get_time() - start;
+    /* Restore the server output */
+    fflush(stdout);
+    dup2(stdoutFd, STDOUT_FILENO);
+    close(stdoutFd);
+    qsort(samples, numSamples, sizeof(double), compare_doubles);
+    printf("ultimate: %d games against a random player: %d won, %d drawn, %d lost in %.3f s on %d thread(s)\n",
+        BENCH_ULTIMATE_GAMES, results[0], results[2], results[1], elapsed, parallel.numThreads);
+    printf("ultimate: %d moves, latency p50 %.1f ms, p99 %.1f ms, max %.1f ms (budget %.1f ms), %.0f playouts/s, %.0f playouts/move kept\n",
+        numSamples, samples[numSamples/2] * 1e3, samples[numSamples*99/100] * 1e3, samples[numSamples-1] * 1e3, options.moveBudget * 1e3,
+        stats.ultimatePlayouts / elapsed, (stats.ultimateMoves > 0) ? (double)stats.ultimateReused / stats.ultimateMoves : 0.0);
+    free(memory);
+}
+
+/**
+ * @brief Starts the next segment of a game history log, finishing the segment being written
+ * first. The segment is created under the first number not already in the directory, so the
+ * segments of earlier servers are kept, and mapped at its full size to be appended to.
+ * 
+ * @param log The game history log.
+ * @param dir The directory the segments are written in.
+ * @return 0 if the segment was started, -1 if there was an error (games are no longer recorded).
+ */
+int open_history(struct History_Log *log, const char *dir) {
+    char path[PATH_MAX];
+    struct History_Segment *header;
+    int fd;
+    /* Finish the segment being written */
+    close_history(log);
+    log->dir = dir;
+    /* Create the next unused segment */
+    do {
+        snprintf(path, sizeof(path), "%s/" HISTORY_SEGMENT_NAME, dir, ++log->number);
+    } while ((fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644)) == -1 && errno == EEXIST);
+    if (fd == -1) {
+        print_error("open_history: open", errno, 0);
+        return -1;
+    }
+    /* Size the segment (unwritten bytes read as zeros and take no disk space) and map it */
+    if (ftruncate(fd, HISTORY_SEGMENT_SIZE) == -1
+        || (log->segment = mmap(NULL, HISTORY_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        print_error("open_history", errno, 0);
+        log->segment = NULL;
+        close(fd);
+        return -1;
+    }
+    /* Write the header describing the classic board of the records */
+    header = (struct History_Segment *)log->segment;
+    memcpy(header->magic, HISTORY_MAGIC, sizeof(header->magic));
+    header->rows = ROWS;
+    header->columns = COLUMNS;
+    header->inARow = IN_A_ROW;
+    log->fd = fd;
+    log->used = sizeof(struct History_Segment);
+    log->segments++;
+    printf("[+]Recording finished games to %s.\n", path);
+    return 0;
+}
+
+/**
+ * @brief Finishes the segment of a game history log being written, cutting it to the records
+ * written. The segment is left for the kernel to write back rather than synced.
+ * 
+ * @param log The game history log.
+ */
+void close_history(struct History_Log *log) {
+    if (log->segment == NULL) return;
+    munmap(log->segment, HISTORY_SEGMENT_SIZE);
+    if (ftruncate(log->fd, log->used) == -1) print_error("close_history: ftruncate", errno, 0);
+    close(log->fd);
+    log->segment = NULL;
+    log->fd = -1;
+}
+
+/**
+ * @brief Appends a game that has ended to a game history log, starting the next segment if the
+ * record doesn't fit in the one being written. Nothing is recorded if the log isn't open.
+ * 
+ * @param log The game history log.
+ * @param game The game of TicTacToe that has ended (before it is reset).
+ */
+void record_game(struct History_Log *log, const struct TTT_Game *game) {
+    struct History_Record *record;
+    int numMoves = (game->numMoves < HISTORY_MAX_MOVES) ? game->numMoves : HISTORY_MAX_MOVES;
+    uint32_t length = sizeof(struct History_Record) + numMoves * sizeof(struct History_Move);
+    if (log->segment == NULL) return;
+    if (log->used + length > HISTORY_SEGMENT_SIZE && open_history(log, log->dir) == -1) return;
+    /* Fill the record in place at the end of the segment */
+    record = (struct History_Record *)(log->segment + log->used);
+    record->type = (game->type == GAME_ULTIMATE) ? HISTORY_ULTIMATE : HISTORY_CLASSIC;
+    record->outcome = (game->winner >= 0) ? game->winner : HISTORY_ABANDONED;
+    record->numMoves = numMoves;
+    record->resends = (game->numResends < UINT8_MAX) ? game->numResends : UINT8_MAX;
+    record->address = game->p2Address.sin_addr.s_addr;
+    record->port = game->p2Address.sin_port;
+    record->timeouts = (game->numTimeouts < UINT16_MAX) ? game->numTimeouts : UINT16_MAX;
+    record->start = game->started;
+    record->end = get_wall_time();
+    memcpy(record + 1, game->moves, numMoves * sizeof(struct History_Move));
+    /* Publish the record by writing its length last, so readers of the live segment never see half of it */
+    __atomic_store_n(&record->length, length, __ATOMIC_RELEASE);
+    log->used += length;
+    log->records++;
+    log->bytes += length;
+}
+
+/**
+ * @brief Benchmarks recording games to a game history log in a temporary directory, appending
+ * classic and Ultimate TicTacToe games with every move played, and reporting the time taken to
+ * record each game (segment rotations included) and the bytes written.
+ */
+void bench_history(void) {
+    char dir[] = "/tmp/tttHistoryXXXXXX", path[PATH_MAX];
+    int type;
+    if (mkdtemp(dir) == NULL) print_error("bench_history: mkdtemp", errno, 1);
+    for (type = GAME_CLASSIC; type <= GAME_ULTIMATE; type++) {
+        struct History_Log log = {.fd = -1};
+        struct TTT_Game game = {.seqNum = 1, .winner = 1, .type = type};
+        double start, elapsed;
+        unsigned n;
+        int i;
+        /* Play out a full game to record */
+        game.numMoves = (type == GAME_ULTIMATE) ? HISTORY_MAX_MOVES : ROWS*COLUMNS;
+        for (i = 0; i < game.numMoves; i++) {
+            game.moves[i].square = i+1;
+            game.moves[i].micros = i;
+        }
+        inet_aton("192.168.1.2", &game.p2Address.sin_addr);
+        game.started = get_wall_time();
+        if (open_history(&log, dir) == -1) exit(EXIT_FAILURE);
+        /* Record the game over and over */
+        start = get_time();
+        for (i = 0; i < BENCH_ITERATIONS; i++) {
+            record_game(&log, &game);
+        }
+        elapsed = get_time() - start;
+        printf("history: %-8s %lu games of %d moves in %.3f s (%.1f ns/game), %.1f MB in %u segment(s) (%.0f MB/s)\n",
+            (type == GAME_ULTIMATE) ? "ultimate" : "classic", log.records, game.numMoves, elapsed, elapsed * 1e9 / log.records,
+            log.bytes / 1e6, log.segments, log.bytes / 1e6 / elapsed);
+        /* Remove the segments written */
+        close_history(&log);
+        for (n = 1; n <= log.number; n++) {
+            snprintf(path, sizeof(path), "%s/" HISTORY_SEGMENT_NAME, dir, n);
+            unlink(path);
+        }
+    }
+    rmdir(dir);
+}
+
+/**
+ * @brief Runs the self-play mode and terminates the process. Each of the -w threads plays its games
+ * against the chosen opponent through the same command handlers as a remote player's commands,
+ * over a null transport, with the server output discarded. Reports the results, the games and
+ * moves played per second and the percentiles of the time taken to answer each command.
+ */
+void run_self_play(void) {
+    const char *opponents[] = {NULL, "random", "scripted", "self"};
+    int maxAnswers = options.selfPlayUltimate ? ULTIMATE_SQUARES/2 + 1 : ttt_SQUARES/2 + 1, stdoutFd, i, j;
+    struct Self_Player *players = calloc(options.selfPlayThreads, sizeof(struct Self_Player));
+    unsigned long games = (unsigned long)options.selfPlayGames * options.selfPlayThreads, moves = 0, results[4] = {0};
+    double start, elapsed, *latencies;
+    int numLatencies = 0;
+    if (players == NULL) print_error("run_self_play: calloc", errno, 1);
+    printf("[+]Playing %d %s game(s) on each of %d thread(s) against the %s opponent.\n", options.selfPlayGames,
+        options.selfPlayUltimate ? "Ultimate TicTacToe" : "TicTacToe", options.selfPlayThreads, opponents[options.selfPlay]);
+    /* Discard the server output */
+    fflush(stdout);
+    stdoutFd = dup(STDOUT_FILENO);
+    if (freopen("/dev/null", "w", stdout) == NULL) print_error("run_self_play: freopen", errno, 1);
+    /* Play the games on every thread at once */
+    start = get_time();
+    for (i = 0; i < options.selfPlayThreads; i++) {
+        players[i].index = i;
+        players[i].seed = i+1;
+        if ((players[i].latencies = malloc((size_t)options.selfPlayGames * maxAnswers * sizeof(double))) == NULL) print_error("run_self_play: malloc", errno, 1);
+        if ((errno = pthread_create(&players[i].thread, NULL, self_play_thread, &players[i])) != 0) print_error("run_self_play: pthread_create", errno, 1);
+    }
+    for (i = 0; i < options.selfPlayThreads; i++) pthread_join(players[i].thread, NULL);
+    elapsed = get_time() - start;
+    /* Restore the server output */
+    fflush(stdout);
+    dup2(stdoutFd, STDOUT_FILENO);
+    close(stdoutFd);
+    /* Gather the counters and answer times of every thread */
+    if ((latencies = malloc(games * maxAnswers * sizeof(double))) == NULL) print_error("run_self_play: malloc", errno, 1);
+    for (i = 0; i < options.selfPlayThreads; i++) {
+        moves += players[i].moves;
+        for (j = 0; j < 4; j++) results[j] += players[i].results[j];
+        memcpy(&latencies[numLatencies], players[i].latencies, players[i].numLatencies * sizeof(double));
+        numLatencies += players[i].numLatencies;
+        free(players[i].latencies);
+    }
+    qsort(latencies, numLatencies, sizeof(double), compare_doubles);
+    printf("[+]Results: %lu Player 1 wins, %lu draws, %lu Player 2 wins, %lu abandoned\n",
+        results[1], results[0], results[2], results[3]);
+    printf("[+]Throughput: %lu games, %lu moves in %.3f s (%.0f games/s, %.0f moves/s)\n", games, moves, elapsed, games / elapsed, moves / elapsed);
+    printf("[+]Answer time (us): p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f over %d commands\n",
+        latencies[numLatencies/2] * 1e6, latencies[numLatencies*9/10] * 1e6, latencies[numLatencies*99/100] * 1e6,
+        latencies[numLatencies*999/1000] * 1e6, latencies[numLatencies-1] * 1e6, numLatencies);
+    if (moveCache.hits + moveCache.misses > 0) {
+        printf("[+]Move cache stats: %lu hits, %lu misses (%.1f%% hit)\n", moveCache.hits, moveCache.misses,
+            100.0 * moveCache.hits / (moveCache.hits + moveCache.misses));
+    }
+    free(latencies);
+    free(players);
+    exit(EXIT_SUCCESS);
+}
+
+/**
+ * @brief Plays the games of a self-play thread. The opponent's NEW_GAME and MOVE commands are
+ * handed to new_game() and move() as if they had arrived from a remote player (each timed until
+ * the server's answer is sent), and a game won or drawn by the server's move is ended with a
+ * GAME_OVER command handed to game_over().
+ * 
+ * @param arg The self-play thread.
+ * @return NULL.
+ */
+void *self_play_thread(void *arg) {
+    struct Self_Player *player = arg;
+    struct TTT_Game *game = &player->game;
+    struct sockaddr_in playerAddr = {0};
+    struct Transport transport;
+    double start;
+    int g;
+    init_null_transport(&transport);
+    /* Each thread plays from its own address with its own game (and search tree) */
+    playerAddr.sin_family = AF_INET;
+    playerAddr.sin_addr.s_addr = htonl((10u << 24) | (player->index+1));
+    playerAddr.sin_port = htons(4444);
+    game->gameNum = player->index+1;
+    player->mirror.gameNum = player->index+1 + MAX_GAMES/2;
+    reset_game(game);
+    for (g = 0; g < options.selfPlayGames; g++) {
+        struct Buffer command = {VERSION, 1, NEW_GAME, options.selfPlayUltimate ? ULTIMATE_REQUEST : 0, 0};
+        /* Start the game (the server answers with its first move) */
+        start = get_time();
+        new_game(&transport, &playerAddr, &command, game);
+        player->latencies[player->numLatencies++] = get_time() - start;
+        player->moves++;
+        while (1) {
+            struct TTT_Game before;
+            int square;
+            /* End a game won or drawn by the server's move */
+            if (game->winner >= 0) {
+                player->results[game->winner]++;
+                command = game->lastSent;
+                command.seqNum++;
+                command.command = GAME_OVER;
+                game_over(&transport, &playerAddr, &command, game);
+                break;
             }
-            /* If nobody won, make a move to send to the remote player */
-            if ((move = send_p1_move(sd, game)) == ERROR_CODE) {
-                /* Reset game if there was an error sending the move */
-                reset_game(game);    
-                return;
+            /* Otherwise answer the server's move (the server answers with its next move) */
+            square = opponent_move(player);
+            command = game->lastSent;
+            command.seqNum++;
+            command.data = encode_move(game, square);
+            before = *game;
+            start = get_time();
+            move(&transport, &playerAddr, &command, game);
+            player->latencies[player->numLatencies++] = get_time() - start;
+            player->moves++;
+            /* A game ended by the opponent's move has been answered with GAME_OVER and reset */
+            if (game->seqNum == 0) {
+                mark_square(&before, square, P2_MARK);
+                player->results[check_game_over(&before) ? before.winner : HISTORY_ABANDONED]++;
+                break;
             }
-            /* Update the board (for Player 1) and check if someone won after the exchange */
-            game->board[move-1] = P1_MARK;
-            if (!check_game_over(game)) print_board(game);
-        } else {
-            reset_game(game);
+            player->moves++;
         }
-    } else {
-        print_error("move: Player address does not match that registered to game", 0, 0);
-        printf("Game address: %s (port %d)\n", inet_ntoa(game->p2Address.sin_addr), game->p2Address.sin_port);
     }
+    return NULL;
 }
 
 /**
- * @brief Handles the GAME_OVER command from the remote player. Determines the reason for
- * ending the game, prints the appropriate message, and resets the game.
+ * @brief Chooses the self-play opponent's move in a game.
  * 
- * @param sd The socket descriptor of the server comminication endpoint.
- * @param playerAddr The address of the remote player.
- * @param datagram The datagram containing the command that the remote player sends.
- * @param game The current game of TicTacToe being played.
+ * @param player The self-play thread.
+ * @return The square (from 1) played by the opponent.
  */
-void game_over(int sd, const struct sockaddr_in *playerAddr, const struct Buffer *datagram, struct TTT_Game *game) {
-    printf("Player at %s (port %d) issued a GAME_OVER command\n", inet_ntoa(playerAddr->sin_addr), playerAddr->sin_port);
-    printf("********  Game #%d  ********\n", game->gameNum);
-    /* Check that the command came from the player registered to the game */
-    if (same_address(playerAddr, &game->p2Address)) {
-        printf("Player 2 has signaled that the game is over\n");
-        /* Check if the game is actually over */
-        if (game->winner < 0) {
-            /* If not over, player decided to leave prematurely */
-            print_error("game_over: Game is still in progress", 0, 0);
-            printf("Player 2 has decided to leave the game\n");
-        } else {
-            /* If over, print appropriate message for who won */
-            (game->winner == 0) ? printf("==>\a It's a draw\n") : printf("==>\a Player %d wins\n", game->winner);
+int opponent_move(struct Self_Player *player) {
+    const struct TTT_Game *game = &player->game;
+    uint8_t moves[ULTIMATE_SQUARES];
+    int numMoves = 0, i;
+    /* The self opponent searches the game from its side, with the marks swapped, like the server does */
+    if (options.selfPlay == SELF_PLAY_SELF) {
+        struct TTT_Game *mirror = &player->mirror;
+        mirror->type = game->type;
+        mirror->ultimate = game->ultimate;
+        for (i = 0; i < ROWS*COLUMNS; i++) {
+            mirror->board[i] = (game->board[i] == P1_MARK) ? P2_MARK : (game->board[i] == P2_MARK) ? P1_MARK : game->board[i];
         }
-        /* Reset the game */
-        reset_game(game);
+        return find_best_move(mirror);
+    }
+    /* Otherwise list the legal squares */
+    if (game->type == GAME_ULTIMATE) {
+        numMoves = ultimate_moves(&game->ultimate, moves);
+        for (i = 0; i < numMoves; i++) moves[i]++;
     } else {
-        print_error("move: Player address does not match that registered to game", 0, 0);
-        printf("Game address: %s (port %d)\n", inet_ntoa(game->p2Address.sin_addr), game->p2Address.sin_port);
+        uint32_t open = ~(ttt_bits(game->board, P1_MARK) | ttt_bits(game->board, P2_MARK)) & ttt_FULL;
+        for (i = 0; i < ttt_SQUARES; i++) {
+            if (open >> i & 1) moves[numMoves++] = i+1;
+        }
     }
+    /* The scripted opponent plays the first of them and the random one any of them */
+    return (options.selfPlay == SELF_PLAY_SCRIPTED) ? moves[0] : moves[rand_r(&player->seed) % numMoves];
 }
 
+#ifdef SIMULATION
 /**
- * @brief Checks the sequence number of the received datagram with the corresponding game to make sure
- * that the sequence number is valid.
+ * @brief Runs the server against simulated players over a simulated network, on a virtual clock,
+ * and terminates the process once all the games have been played. Datagrams are lost, duplicated
+ * and reordered at random with the given probabilities, using a seeded random number generator,
+ * so every run with the same settings plays out exactly the same way.
  * 
- * @param playerAddr The address of the remote player.
- * @param datagram The datagram containing the command that the remote player sends.
- * @param game The current game of TicTacToe being played.
- * @return A positive number if the sequence number for the current game is valid, 0 if it is a duplicate,
- * an error code (-2) if it has already been processed, and an error code (-1) if it is invalid.
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
  */
-int validate_sequence_num(const struct sockaddr_in *playerAddr, const struct Buffer *datagram, const struct TTT_Game *game) {
-    /* Number is automatically valid if no open games to play of player address doesn't match address registered to game */
-    if (game != NULL && same_address(playerAddr, &game->p2Address)) {
-        if (datagram->seqNum > game->seqNum) {  // received new sequence before previous one could be processed
-            printf("Game #%d received an invalid sequence number\n", game->gameNum);
-            return -1;
-        } else if (datagram->seqNum == game->seqNum-1) {    // received duplicate sequence
-            printf("Game #%d received a duplicate command\n", game->gameNum);
-            return 0;
-        } else if (datagram->seqNum < game->seqNum-1) {   // received sequence that has already been processed
-            printf("Game #%d received a command that has already been processed\n", game->gameNum);
-            return -2;
-        } else {
-            return 1;
+void run_simulation(int argc, char *argv[]) {
+    int opt, i;
+    struct timespec wallStart;
+    struct Transport transport = {"simulation", -1, 0, 0, NULL, sim_send, sim_receive, NULL, NULL};
+    /* Default settings */
+    sim.games = 10000;
+    sim.numPlayers = SIM_PLAYERS;
+    sim.seed = 1;
+    /* Extract the simulation settings */
+    while ((opt = getopt(argc, argv, "n:p:s:l:d:r:cv")) != -1) {
+        switch (opt) {
+            case 'n': sim.games = strtoul(optarg, NULL, 10); break;      // number of games
+            case 'p': sim.numPlayers = strtol(optarg, NULL, 10); break;  // number of simultaneous players
+            case 's': sim.seed = strtoul(optarg, NULL, 10); break;       // random seed
+            case 'l': sim.loss = strtod(optarg, NULL); break;            // loss probability
+            case 'd': sim.duplicate = strtod(optarg, NULL); break;       // duplication probability
+            case 'r': sim.reorder = strtod(optarg, NULL); break;         // reordering probability
+            case 'c': options.cookies = 1; break;                       // require handshake cookies
+            case 'v': sim.verbose = 1; break;                           // print the server output
+            default:
+                sim.verbose = 1;
+                printf("Usage is: tictactoeSim [-n games] [-p players] [-s seed] [-l loss] [-d duplicate] [-r reorder] [-c] [-v]\n");
+                exit(EXIT_FAILURE);
         }
-    } else {
-        return 1;
     }
+    if (sim.numPlayers < 1) sim.numPlayers = 1;
+    /* Seed the random number generator (and derive the cookie key from it) */
+    sim.random = sim.seed * 0x9E3779B97F4A7C15ull + 1;
+    for (i = 0; i < sizeof(cookieKey); i++) cookieKey[i] = sim_uniform() * 256;
+    /* Create the players, starting their first games at random times */
+    if ((sim.players = calloc(sim.numPlayers, sizeof(struct Sim_Player))) == NULL) print_error("run_simulation: calloc", errno, 1);
+    for (i = 0; i < sim.numPlayers; i++) {
+        sim.players[i].address.sin_family = AF_INET;
+        sim.players[i].address.sin_port = htons(SIM_PORT_BASE + i);
+        sim_arm_timer(i, sim_uniform() * SIM_THINK_TIME);
+    }
+    /* Play all the games (print_simulation() terminates the process when they are done) */
+    clock_gettime(CLOCK_MONOTONIC, &wallStart);
+    sim.wallStart = wallStart.tv_sec + wallStart.tv_nsec / 1e9;
+    tictactoe(&transport, -1, map_game_roster(NULL));
 }
 
 /**
- * @brief Resends the previous command that was sent to the remote player.
+ * @brief Prints the results of the simulation and terminates the process, signaling unsuccessful
+ * termination if any game broke the protocol or was won by the remote player.
+ */
+void print_simulation(void) {
+    struct timespec wallStop;
+    double wallTime;
+    clock_gettime(CLOCK_MONOTONIC, &wallStop);
+    wallTime = wallStop.tv_sec + wallStop.tv_nsec / 1e9 - sim.wallStart;
+    sim.verbose = 1;
+    printf("[+]Simulation (seed %lu, loss %.3f, duplicate %.3f, reorder %.3f): %lu games by %d players\n",
+        sim.seed, sim.loss, sim.duplicate, sim.reorder, sim.started, sim.numPlayers);
+    printf("[+]Results: %lu finished (%lu Player 1 wins, %lu draws, %lu Player 2 wins), %lu abandoned, %lu protocol errors\n",
+        sim.finished, sim.results[1], sim.results[0], sim.results[2], sim.abandoned, sim.errors);
+    printf("[+]Network: %lu datagrams sent, %lu lost, %lu duplicated, %lu reordered, %lu player timeouts\n",
+        sim.sent, sim.lost, sim.duplicated, sim.reordered, sim.timeouts);
+    printf("[+]Time: %.0f virtual s (%.2f s per finished game), %.2f wall s (%.0f games/s)\n",
+        sim.clock, (sim.finished > 0) ? sim.gameTime / sim.finished : 0.0, wallTime, sim.started / wallTime);
+    print_server_stats();
+    exit((sim.errors > 0 || sim.results[2] > 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * @brief Prints server output while a simulation is being traced, discarding it otherwise so the
+ * simulation isn't slowed down by it.
  * 
- * @param sd The socket descriptor of the server comminication endpoint.
- * @param game The current game of TicTacToe being played.
+ * @param format The printf() format string.
+ * @return The number of characters printed.
  */
-void resend_command(int sd, struct TTT_Game *game) {
-    /* Checks that max resends has not been exceeded and decrements count */
-    if (game->resends-- > 0) {
-        /* Pack last sent command into a datagram to send */
-        struct Buffer datagram = game->lastSent;
-        /* Print the command being resent */
-        int v = datagram.version, sn = datagram.seqNum, cmd = datagram.command, pos = datagram.data, gn = datagram.gameNum;
-        printf("Game #%d: Resending the previous command... \n", game->gameNum);
-        printf("\tver: %d, seq#: %02d, command: %d, pos: %c (0x%2X), game#: %02d\n", v, sn, cmd, pos, datagram.data, gn);
-        /* Send previously sent command to remote player */
-        if (sendto(sd, &datagram, sizeof(struct Buffer), 0, (struct sockaddr *)&game->p2Address, sizeof(struct sockaddr_in)) < 0) {
-            /* Reset game if there was an error sending the command */
-            print_error("resend_command", errno, 0);
-            reset_game(game);
-        }
-    } else {
-        /* Exceeded max resends -> reset game */
-        print_error("resend_command: Exceeded maximum allowed resend attempts", 0, 0);
-        reset_game(game);
+int sim_printf(const char *format, ...) {
+    int rv = 0;
+    va_list args;
+    if (sim.verbose) {
+        va_start(args, format);
+        rv = vprintf(format, args);
+        va_end(args);
     }
+    return rv;
 }
 
 /**
- * @brief Determines whether a given move is legal (i.e. number 1-9) and valid (i.e. hasn't
- * already been played) for the current game.
+ * @brief Draws the next number from the seeded random number generator (xorshift64*).
  * 
- * @param choice The player move to be validated.
- * @param game The current game of TicTacToe being played.
- * @return True if the given move if valid based on the current game, false otherwise. 
+ * @return A number uniformly distributed in [0, 1).
  */
-int validate_move(int choice, const struct TTT_Game *game) {
-    /* Check to see if the choice is a move on the board */
-    if (choice < 1 || choice > 9) {
-        print_error("Invalid move: Must be a number [1-9]", 0, 0);
-        return 0;
-    }
-    /* Check to see if the square chosen has a digit in it, if */
-    /* square 8 has an '8' then it is a valid choice */
-    if (game->board[choice-1] != (choice + '0')) {
-        print_error("Invalid move: Square already taken", 0, 0);
-        return 0;
+double sim_uniform(void) {
+    sim.random ^= sim.random >> 12;
+    sim.random ^= sim.random << 25;
+    sim.random ^= sim.random >> 27;
+    return ((sim.random * 0x2545F4914F6CDD1Dull) >> 11) / 9007199254740992.0;
+}
+
+/**
+ * @brief Adds an event to the simulation, growing the event heap if it is full.
+ * 
+ * @param event The event to schedule (its order is assigned here).
+ */
+void sim_schedule(struct Sim_Event *event) {
+    size_t i;
+    /* Grow the heap if needed */
+    if (sim.numEvents == sim.maxEvents) {
+        sim.maxEvents = (sim.maxEvents > 0) ? 2 * sim.maxEvents : 1024;
+        if ((sim.events = realloc(sim.events, sim.maxEvents * sizeof(struct Sim_Event))) == NULL) print_error("sim_schedule: realloc", errno, 1);
     }
-    /* Check to see if the game has already ended */
-    if (game->winner > 0) {
-        print_error("Invalid move: Winning move has already been made", 0, 0);
-        return 0;
+    /* Sift the event up to its place in the heap */
+    event->order = sim.order++;
+    for (i = sim.numEvents++; i > 0; i = (i-1)/2) {
+        struct Sim_Event *parent = &sim.events[(i-1)/2];
+        if (parent->time < event->time || (parent->time == event->time && parent->order < event->order)) break;
+        sim.events[i] = *parent;
     }
-    return 1;
+    sim.events[i] = *event;
 }
 
 /**
- * @brief Provides an optimal move for the maximizing player assuming that minimizing player
- * is also playing optimally.
+ * @brief Removes the earliest event from the simulation (the heap must not be empty).
  * 
- * @param game The current game of TicTacToe being played.
- * @param depth The current depth in game tree.
- * @param isMax Whether it is the maximizers turn or not.
- * @return The best score achievable for the maximizer based on the current state of the game.
+ * @return The earliest event.
  */
-int minimax(struct TTT_Game *game, int depth, int isMax) {
-    /* Get score for current turn */
-    int score = check_win(game);
-    /* Check for base case */
-    if (score > 0) {    // maximizer won
-        return score - depth;
-    } else if (score < 0) {    // minimizer won
-        return score + depth;
-    } else if (check_draw(game)) {  // nobody won
-        return 0;
-    } else {
-        /* Initialize best score for maximizer/minimizer */
-        int i, best = (isMax) ? INT32_MIN : INT16_MAX;
-        if (isMax) {    // maximizers turn
-            /* Searches over all possible moves */
-            for (i = 0; i < sizeof(game->board); i++) {
-                /* Checks that current move is valid based on the current board */
-                if (game->board[i] == (i+1)+'0') {
-                    int value;
-                    /* Make the move */
-                    game->board[i] = P1_MARK;
-                    /* Get best score for move and update best move if the score was better */
-                    if ((value = minimax(game, depth+1, !isMax)) > best) best = value;
-                    /* Undo previous move */
-                    game->board[i] = (i+1)+'0';
-                }
-            }
-            return best;
-        } else {    // minimizers turn
-            /* Searches over all possible moves */
-            for (i = 0; i < sizeof(game->board); i++) {
-                /* Checks that current move is valid based on the current board */
-                if (game->board[i] == (i+1)+'0') {
-                    int value;
-                    /* Make the move */
-                    game->board[i] = P2_MARK;
-                    /* Get best score for move and update best move if the score was better */
-                    if ((value = minimax(game, depth+1, !isMax)) < best) best = value;
-                    /* Undo previous move */
-                    game->board[i] = (i+1)+'0';
-                }
-            }
-            return best;
-        }
+struct Sim_Event sim_next_event(void) {
+    struct Sim_Event next = sim.events[0], last = sim.events[--sim.numEvents];
+    size_t i = 0, child;
+    /* Sift the last event down from the top of the heap */
+    while ((child = 2*i + 1) < sim.numEvents) {
+        struct Sim_Event *c = &sim.events[child];
+        if (child+1 < sim.numEvents && (c[1].time < c[0].time || (c[1].time == c[0].time && c[1].order < c[0].order))) c++, child++;
+        if (last.time < c->time || (last.time == c->time && last.order < c->order)) break;
+        sim.events[i] = *c;
+        i = child;
     }
+    sim.events[i] = last;
+    return next;
 }
 
 /**
- * @brief Finds the optimal move to make to win the game based on the current state of
- * the game board.
+ * @brief Sends a datagram over the simulated network, which may lose it, duplicate it, or hold
+ * it back so that it arrives after datagrams sent later.
  * 
- * @param game The current game of TicTacToe being played.
- * @return The optimal move to make in order to win. 
+ * @param type SIM_TO_SERVER or SIM_TO_PLAYER.
+ * @param player The index of the simulated player sending or receiving the datagram.
+ * @param address The address of that player.
+ * @param data The datagram to send.
+ * @param length The number of bytes in the datagram.
  */
-int find_best_move(struct TTT_Game *game) {
-    int i, bestMove = -1, bestValue = INT32_MIN;
-    /* Searches over all possible moves */
-    for (i = 0; i < sizeof(game->board); i++) {
-        /* Checks that current move is valid based on the current board */
-        if (game->board[i] == (i+1)+'0') {
-            int moveValue;
-            /* Make the move */
-            game->board[i] = P1_MARK;
-            /* Get the move score */
-            moveValue = minimax(game, 0, 0);
-            /* Undo previous move */
-            game->board[i] = (i+1)+'0';
-            /* Update the best move if the current score was better */
-            if (moveValue > bestValue) {
-                bestValue = moveValue;
-                bestMove = i+1;
-            }
+void sim_transmit(int type, int player, const struct sockaddr_in *address, const void *data, size_t length) {
+    int copies = 1;
+    struct Sim_Event event = {0};
+    sim.sent++;
+    /* Lose or duplicate the datagram */
+    if (sim_uniform() < sim.loss) {
+        sim.lost++;
+        return;
+    }
+    if (sim_uniform() < sim.duplicate) {
+        sim.duplicated++;
+        copies++;
+    }
+    /* Schedule the delivery of each copy */
+    event.type = type;
+    event.player = player;
+    event.address = *address;
+    event.length = (length < sizeof(event.datagram)) ? length : sizeof(event.datagram);
+    memcpy(&event.datagram, data, event.length);
+    while (copies--) {
+        event.time = sim.clock + SIM_LATENCY + sim_uniform() * SIM_JITTER;
+        if (sim_uniform() < sim.reorder) {
+            sim.reordered++;
+            event.time += sim_uniform() * SIM_REORDER_DELAY;
         }
+        sim_schedule(&event);
     }
-    return bestMove;
 }
 
 /**
- * @brief Sends Player 1's move to the remote player.
+ * @brief Sends a datagram from the server to a simulated player (the send function of the
+ * simulation transport).
  * 
- * @param sd The socket descriptor of the server comminication endpoint.
- * @param game The current game of TicTacToe being played.
- * @return The move that was sent, or an error code if there was an issue. 
+ * @param transport The simulation transport.
+ * @param data The datagram to send.
+ * @param length The number of bytes in the datagram.
+ * @param dest The address of the player.
+ * @return The number of bytes sent.
  */
-int send_p1_move(int sd, struct TTT_Game *game) {
-    struct Buffer datagram = {0};
-    /* Get move to send to remote player */
-    int move = find_best_move(game);
-    while (!validate_move(move, game)) move = find_best_move(game);
-    /* Pack move information into datagram */
-    datagram.version = VERSION;
-    datagram.seqNum = game->seqNum++;
-    datagram.command = MOVE;
-    datagram.data = move + '0';
-    datagram.gameNum = game->gameNum;
-    /* Send the move to the remote player */
-    printf("Server sent the move:  %c\n", datagram.data);
-    if (sendto(sd, &datagram, sizeof(struct Buffer), 0, (struct sockaddr *)&game->p2Address, sizeof(struct sockaddr_in)) < 0) {
-        print_error("send_p1_move", errno, 0);
-        return ERROR_CODE;
-    }
-    /* Update last sent command for game */
-    game->lastSent = datagram;
-    return (datagram.data - '0');
+int sim_send(struct Transport *transport, const void *data, size_t length, const struct sockaddr_in *dest) {
+    int player = ntohs(dest->sin_port) - SIM_PORT_BASE;
+    /* Datagrams to addresses that no player has are sent into the void */
+    if (player >= 0 && player < sim.numPlayers) sim_transmit(SIM_TO_PLAYER, player, dest, data, length);
+    return length;
 }
 
 /**
- * @brief Determines if someone has won the game yet or not.
+ * @brief Receives the next datagram sent to the server (the receive function of the simulation
+ * transport). The virtual clock is advanced through the player timers and deliveries until a
+ * datagram reaches the server or the server times out. Once every player has played its share of the games, the results are printed
+ * and the process terminates.
  * 
- * @param game The current game of TicTacToe being played.
- * @return True if a player has won the game and false if the game is still going on. 
+ * @param transport The simulation transport.
+ * @param msg The message header to store the sender address and (scattered) datagram in.
+ * @return The number of bytes received, or -1 if the server timed out (errno is EAGAIN).
  */
-int check_win(const struct TTT_Game *game) {
-    const int score = sizeof(game->board) + 1;
-    /***********************************************************************/
-    /* Brute force check to see if someone won. Return a +/- score if the  */
-    /* game is 'over' or return 0 if game should go on.                    */
-    /***********************************************************************/
-    if (game->board[0] == game->board[1] && game->board[1] == game->board[2]) { // row matches
-        return (game->board[0] == P1_MARK) ? score : -score;
-    } else if (game->board[3] == game->board[4] && game->board[4] == game->board[5]) { // row matches
-        return (game->board[3] == P1_MARK) ? score : -score;
-    } else if (game->board[6] == game->board[7] && game->board[7] == game->board[8]) { // row matches
-        return (game->board[6] == P1_MARK) ? score : -score;
-    } else if (game->board[0] == game->board[3] && game->board[3] == game->board[6]) { // column matches
-        return (game->board[0] == P1_MARK) ? score : -score;
-    } else if (game->board[1] == game->board[4] && game->board[4] == game->board[7]) { // column matches
-        return (game->board[1] == P1_MARK) ? score : -score;
-    } else if (game->board[2] == game->board[5] && game->board[5] == game->board[8]) { // column matches
-        return (game->board[2] == P1_MARK) ? score : -score;
-    } else if (game->board[0] == game->board[4] && game->board[4] == game->board[8]) { // diagonal matches
-        return (game->board[0] == P1_MARK) ? score : -score;
-    } else if (game->board[2] == game->board[4] && game->board[4] == game->board[6]) { // diagonal matches
-        return (game->board[2] == P1_MARK) ? score : -score;
-    } else {
-        return 0;  // return of 0 means keep playing
+int sim_receive(struct Transport *transport, struct msghdr *msg) {
+    double deadline = sim.clock + SERVER_TIMEOUT;
+    while (1) {
+        struct Sim_Event event;
+        struct Sim_Player *player;
+        if (sim.retired == sim.numPlayers) print_simulation();
+        /* Time out if nothing happens before the deadline */
+        if (sim.numEvents == 0 || sim.events[0].time > deadline) {
+            sim.clock = deadline;
+            errno = EAGAIN;
+            return -1;
+        }
+        event = sim_next_event();
+        sim.clock = event.time;
+        player = &sim.players[event.player];
+        if (event.type == SIM_TO_SERVER) {
+            /* Deliver the datagram to the server like recvmsg() */
+            int i;
+            size_t copied = 0;
+            memcpy(msg->msg_name, &event.address, sizeof(struct sockaddr_in));
+            for (i = 0; i < msg->msg_iovlen && copied < event.length; i++) {
+                size_t part = (event.length - copied < msg->msg_iov[i].iov_len) ? event.length - copied : msg->msg_iov[i].iov_len;
+                memcpy(msg->msg_iov[i].iov_base, (char *)&event.datagram + copied, part);
+                copied += part;
+            }
+            msg->msg_controllen = 0;
+            return copied;
+        } else if (event.type == SIM_TO_PLAYER) {
+            /* Deliver the datagram to the player if it is still at that address */
+            if (player->state != SIM_IDLE && player->state != SIM_RETIRED && same_address(&event.address, &player->address)) {
+                sim_player_receive(event.player, &event.datagram, event.length);
+            }
+        } else if (event.timer == player->timer) {
+            /* Player timer expired (and hasn't been rearmed since) */
+            sim_player_timeout(event.player);
+        }
     }
 }
 
 /**
- * @brief Determines if there are moves left in the game to be made or not.
+ * @brief Arms the timer of a simulated player, disarming the previous one.
  * 
- * @param game The current game of TicTacToe being played.
- * @return True if there are no moves left to be made, false otherwise. 
+ * @param player The index of the simulated player.
+ * @param seconds The number of virtual seconds until the timer expires.
  */
-int check_draw(const struct TTT_Game *game) {
-    int i;
-    /* Check each board square */
-    for (i = 0; i < sizeof(game->board); i++) {
-        /* Check if current square has been played */
-        if (game->board[i] == (i+1)+'0') return 0;
-    }
-    return 1;
+void sim_arm_timer(int player, double seconds) {
+    struct Sim_Event event = {0};
+    event.time = sim.clock + seconds;
+    event.type = SIM_TIMER;
+    event.player = player;
+    event.timer = ++sim.players[player].timer;
+    sim_schedule(&event);
 }
 
 /**
- * @brief Prints out the current state of the game board nicely formatted.
+ * @brief Sends the last datagram of a simulated player to the server (again).
  * 
- * @param game The current game of TicTacToe being played.
+ * @param player The index of the simulated player.
  */
-void print_board(const struct TTT_Game *game) {
-    /*****************************************************************/
-    /* Brute force print out the board and all the squares/values    */
-    /*****************************************************************/
-    /* Print header info */
-    printf("\n\n\tTicTacToe Game #%d\n\n", game->gameNum);
-    printf("Player 1 (%c)  -  Player 2 (%c)\n\n\n", P1_MARK, P2_MARK);
-    /* Print current state of board */
-    printf("     |     |     \n");
-    printf("  %c  |  %c  |  %c \n", game->board[0], game->board[1], game->board[2]);
-    printf("_____|_____|_____\n");
-    printf("     |     |     \n");
-    printf("  %c  |  %c  |  %c \n", game->board[3], game->board[4], game->board[5]);
-    printf("_____|_____|_____\n");
-    printf("     |     |     \n");
-    printf("  %c  |  %c  |  %c \n", game->board[6], game->board[7], game->board[8]);
-    printf("     |     |     \n\n");
+void sim_player_send(int player) {
+    struct Sim_Player *p = &sim.players[player];
+    sim_transmit(SIM_TO_SERVER, player, &p->address, &p->lastSent, p->lastLength);
 }
 
 /**
- * @brief Checks if the current game has ended and prints the appropriate message.
+ * @brief Starts a new game for a simulated player from a fresh address by sending NEW_GAME.
  * 
- * @param game The current game of TicTacToe being played.
- * @return True if the game has ended, false otherwise. 
+ * @param player The index of the simulated player.
  */
-int check_game_over(struct TTT_Game *game) {
-    int score;
-    /* Check if somebody won the game */
-    if ((score = check_win(game))) {
-        game->winner = (score > 0) ? 1 : 2;
-    } else if (check_draw(game)) {
-        game->winner = 0;
-    } else {
-        return 0;
-    }
-    /* Print final game board and winning player */
-    print_board(game);
-    (game->winner == 0) ? printf("==>\a It's a draw\n") : printf("==>\a Player %d wins\n", game->winner);
-    return 1;
+void sim_start_game(int player) {
+    struct Sim_Player *p = &sim.players[player];
+    struct Buffer newGame = {VERSION, 0, NEW_GAME, 0, 0};
+    sim.started++;
+    /* Each game is played from a new address in 10.0.0.0/8 */
+    p->address.sin_addr.s_addr = htonl((10u << 24) | (++sim.nextHost & 0xFFFFFF));
+    p->state = SIM_AWAIT_MOVE;
+    p->tries = 0;
+    p->seqNum = 0;
+    p->gameNum = 0;
+    p->result = -1;
+    p->started = sim.clock;
+    init_shared_state(&p->game);
+    p->lastSent.command = newGame;
+    p->lastLength = sizeof(struct Buffer);
+    sim_player_send(player);
+    sim_arm_timer(player, SIM_MOVE_TIMEOUT);
 }
 
 /**
- * @brief Sends GAME_OVER command to the remote player and puts the current game into a
- * waiting state to listen for any commands from the remote player that may need to be
- * processed to end the game.
+ * @brief Ends the game of a simulated player, and either starts its next game after a short
+ * pause or retires the player if all the games have been started.
  * 
- * @param sd The socket descriptor of the server comminication endpoint.
- * @param game The current game of TicTacToe being played.
+ * @param player The index of the simulated player.
+ * @param outcome The counter of the outcome of the game (sim.finished, sim.abandoned or sim.errors).
  */
-void send_game_over(int sd, struct TTT_Game *game) {
-    struct Buffer datagram = {0};
-    /* Pack command information into datagram */
-    datagram.version = VERSION;
-    datagram.seqNum = game->seqNum;
-    datagram.command = GAME_OVER;
-    datagram.gameNum = game->gameNum;
-    /* Update last sent command for game */
-    game->lastSent = datagram;
-    /* Update game timeout for grace period to listen for remote player */
-    game->timeout = 2 * GAME_TIMEOUT;
-    /* Send the command to the remote player */
-    printf("Server sent the GAME_OVER command to Player 2\n");
-    if (sendto(sd, &datagram, sizeof(struct Buffer), 0, (struct sockaddr *)&game->p2Address, sizeof(struct sockaddr_in)) < 0) {
-        print_error("send_game_over", errno, 0);
-        reset_game(game);
+void sim_end_game(int player, unsigned long *outcome) {
+    struct Sim_Player *p = &sim.players[player];
+    (*outcome)++;
+    if (outcome == &sim.finished) {
+        sim.results[p->result]++;
+        sim.gameTime += sim.clock - p->started;
+    }
+    if (sim.started < sim.games) {
+        p->state = SIM_IDLE;
+        sim_arm_timer(player, sim_uniform() * SIM_THINK_TIME);
+    } else {
+        sim_retire_player(player);
     }
 }
 
 /**
- * @brief Plays multiple games of TicTacToe with remoye players that end when either
- * someone wins, there is a draw, or the remote player leaves the game.
+ * @brief Retires a simulated player once all the games have been started, disarming its timer.
  * 
- * @param sd The socket descriptor of the server comminication endpoint.
+ * @param player The index of the simulated player.
  */
-void tictactoe(int sd) {
-    int waitPrompt = 1;
-    struct TTT_Game gameRoster[MAX_GAMES] = {{0}};
-    command_handler commands[] = {new_game, move, game_over};
+void sim_retire_player(int player) {
+    struct Sim_Player *p = &sim.players[player];
+    p->state = SIM_RETIRED;
+    p->timer++;
+    sim.retired++;
+}
 
-    /* Initialize all games and server timeout time */
-    init_game_roster(gameRoster);
-    set_timeout(sd, SERVER_TIMEOUT);
-    /* Play all the games */
-    while (1) {
-        int rv;
-        time_t start, stop;
-        struct sockaddr_in playerAddr = {0};
-        struct Buffer datagram = {0};
-        /* Start clock for elapsed time from last command */
-        if (waitPrompt) printf("[+]Waiting for another player to issue a command...\n");
-        start = time(NULL);
-        /* Wait for a command to be received */
-        if ((rv = get_command(sd, &playerAddr, &datagram)) > 0) {
-            /* Get game corresponding to received command */
-            int i, gameIndx = (datagram.command == NEW_GAME) ? find_open_game(gameRoster) : datagram.gameNum-1;
-            struct TTT_Game *currentGame = (gameIndx < 0) ? NULL : &gameRoster[gameIndx];
-            /* Validate the sequence number of the command and handle possible duplicates */
-            if ((rv = validate_sequence_num(&playerAddr, &datagram, currentGame)) > 0) {
-                /* Valid sequence number -> process received command for current game and resent resend counter */
-                commands[(int)datagram.command](sd, &playerAddr, &datagram, currentGame);
-                if (currentGame != NULL) currentGame->resends = MAX_RESENDS;
-            } else if (rv == 0) {
-                /* Duplicate sequence number -> resent previously sent command */
-                resend_command(sd, currentGame);
-            } else if (rv == -1) {
-                /* Invalid sequence number -> reset game */
-                print_error("tictactoe: Unable to process out of order command", 0, 0);
-                reset_game(currentGame);
-            }
-            /* Stop clock for elapsed time from last command and update timeout clock for each ongoing game */
-            stop = time(NULL);
-            for (i = 0; i < MAX_GAMES; i++) {
-                struct TTT_Game *game = &gameRoster[i];
-                /* Check if game is being played */
-                if (game->seqNum > 0) {
-                    /* Update timeout clock */
-                    game->timeout -= difftime(stop, start);
-                    /* Reset timout clock for the game that just received the command if not over */
-                    if (i == gameIndx && game->winner < 0) game->timeout = GAME_TIMEOUT;
-                }
-            }
-            /* Resend previous command for any game that has timed out, reset games who's grace period has ended */
-            check_timeout(sd, gameRoster);
-            waitPrompt = 1;
-        } else if (rv == 0) {   // server has timed out
-            int i, numInProgress, numWaiting;
-            /* Stop clock for elapsed time from last command */
-            stop = time(NULL);
-            /* Update game timeout clocks */
-            for (i = 0; i < MAX_GAMES; i++) {
-                struct TTT_Game *game = &gameRoster[i];
-                /* Update timeout clock if game is ongoing */
-                if (game->seqNum > 0) game->timeout -= difftime(stop, start);
-            }
-            /* Check if any games are currently being played */
-            if ((numInProgress = games_in_progress(&numWaiting, gameRoster))) {
-                waitPrompt = (numWaiting < numInProgress) ? 1 : 0;
-                if (waitPrompt) print_error("tictactoe: Nobody has responded in a while. Server has timed out", 0, 0);
-                /* Resent command or reset game */
-                for (i = 0; i < MAX_GAMES; i++) {
-                    struct TTT_Game *game = &gameRoster[i];
-                    /* Check if game is currently ongoing */
-                    if (game->seqNum > 0) {
-                        /* Check if game in waiting state after sending GAME_OVER command */
-                        if (game->lastSent.command != GAME_OVER) {
-                            /* Game not in waiting state -> resent previously sent command */
-                            resend_command(sd, game);
-                        } else if (game->timeout <= 0) {
-                            /* Grace period for waiting game has ended -> reset game */
-                            reset_game(game);
-                        }
-                    }
-                }
-            } else {
-                waitPrompt = 0;
+/**
+ * @brief Handles a datagram received by a simulated player, following the same steps as
+ * tictactoeClient: echoing handshake cookies, resending on unexpected sequence numbers, answering
+ * the server's move with a random legal move, and ending the game with GAME_OVER.
+ * 
+ * @param player The index of the simulated player.
+ * @param datagram The datagram received.
+ * @param length The number of bytes in the datagram.
+ */
+void sim_player_receive(int player, const struct Cookie_Buffer *datagram, size_t length) {
+    struct Sim_Player *p = &sim.players[player];
+    const struct Buffer *command = &datagram->command;
+    int move, i, numOpen = 0;
+    if (p->state == SIM_AWAIT_MOVE) {
+        if (length == sizeof(struct Cookie_Buffer) && command->command == NEW_GAME) {
+            /* Handshake cookie -> echo it back with NEW_GAME */
+            p->lastSent = *datagram;
+            p->lastSent.command.seqNum = 0;
+            p->lastLength = sizeof(struct Cookie_Buffer);
+            sim_player_send(player);
+        } else if (command->seqNum != p->seqNum+1 && command->seqNum != 0) {
+            /* Unexpected sequence number -> resend the last datagram */
+            sim_player_send(player);
+        } else if (command->version != VERSION || command->command != MOVE || (p->gameNum != 0 && command->gameNum != p->gameNum)
+                || !validate_move(command->data - '0', &p->game)) {
+            /* The client gives up on datagrams that break the protocol */
+            sim_end_game(player, &sim.errors);
+            return;
+        } else {
+            /* Play the server's move */
+            if (p->gameNum == 0) p->gameNum = command->gameNum;
+            p->seqNum = command->seqNum;
+            p->game.board[command->data - '1'] = P1_MARK;
+            p->tries = 0;
+            if ((p->result = sim_game_result(&p->game)) >= 0) {
+                /* Server ended the game -> send GAME_OVER */
+                p->lastSent.command = (struct Buffer){VERSION, ++p->seqNum, GAME_OVER, command->data, p->gameNum};
+                p->lastLength = sizeof(struct Buffer);
+                p->state = SIM_AWAIT_ACK;
+                p->tries = 1;
+                sim_player_send(player);
+                sim_arm_timer(player, SIM_GAME_OVER_TIMEOUT);
+                return;
             }
+            /* Pick a random open square to answer with */
+            for (i = 0; i < sizeof(p->game.board); i++) numOpen += validate_move(i+1, &p->game);
+            for (move = 1, i = sim_uniform() * numOpen; !validate_move(move, &p->game) || i-- > 0; move++);
+            p->game.board[move-1] = P2_MARK;
+            p->lastSent.command = (struct Buffer){VERSION, ++p->seqNum, MOVE, move + '0', p->gameNum};
+            p->lastLength = sizeof(struct Buffer);
+            sim_player_send(player);
+            if ((p->result = sim_game_result(&p->game)) >= 0) p->state = SIM_AWAIT_GAME_OVER;
+        }
+        sim_arm_timer(player, SIM_MOVE_TIMEOUT);
+    } else if (p->state == SIM_AWAIT_ACK) {
+        /* Server is still sending -> resend GAME_OVER until it has been sent enough times */
+        if (p->tries++ == SIM_MAX_TRIES) {
+            sim_end_game(player, &sim.finished);
+        } else {
+            sim_player_send(player);
+            sim_arm_timer(player, SIM_GAME_OVER_TIMEOUT);
+        }
+    } else if (p->state == SIM_AWAIT_GAME_OVER) {
+        /* Wait for GAME_OVER, resending the last move if the server is still sending moves */
+        if (command->command == GAME_OVER || ++p->tries > SIM_MAX_TRIES) {
+            sim_end_game(player, &sim.finished);
+        } else {
+            if (command->command == MOVE) sim_player_send(player);
+            sim_arm_timer(player, SIM_MOVE_TIMEOUT);
+        }
+    }
+}
+
+/**
+ * @brief Handles the timer of a simulated player expiring, following the same steps as
+ * tictactoeClient: resending the last command a few times before giving up, and assuming the
+ * server got GAME_OVER if it stays quiet.
+ * 
+ * @param player The index of the simulated player.
+ */
+void sim_player_timeout(int player) {
+    struct Sim_Player *p = &sim.players[player];
+    if (p->state == SIM_IDLE) {
+        /* Start the next game, unless the other players have started them all in the meantime */
+        if (sim.started < sim.games) sim_start_game(player);
+        else sim_retire_player(player);
+        return;
+    }
+    sim.timeouts++;
+    if (p->state == SIM_AWAIT_ACK) {
+        /* No response to GAME_OVER -> the server got it */
+        sim_end_game(player, &sim.finished);
+    } else if (p->tries++ == SIM_MAX_TRIES) {
+        /* Ran out of time -> give up on the game */
+        sim_end_game(player, &sim.abandoned);
+    } else {
+        /* Resend the last command (NEW_GAME without its cookie, like the client) */
+        if (p->seqNum == 0) {
+            p->lastSent.command = (struct Buffer){VERSION, 0, NEW_GAME, 0, 0};
+            p->lastLength = sizeof(struct Buffer);
         }
+        sim_player_send(player);
+        sim_arm_timer(player, SIM_MOVE_TIMEOUT);
     }
 }
+
+/**
+ * @brief Determines the result of a simulated player's game.
+ * 
+ * @param game The player's copy of the game.
+ * @return The player who won, 0 if the game is a draw, or -1 if the game is not over.
+ */
+int sim_game_result(const struct TTT_Game *game) {
+    int score = check_win(game);
+    if (score) return (score > 0) ? 1 : 2;
+    return check_draw(game) ? 0 : -1;
+}
+#endif
@@ -0,0 +1,140 @@
+/***********************************************************/
+/* Shared-memory channel between the TicTacToe server and  */
+/* a client running on the same host. Each channel is a    */
+/* pair of single-producer single-consumer rings of        */
+/* datagrams in a memfd region, with eventfd wakeups only  */
+/* when the consumer is asleep.                            */
+/***********************************************************/
+
+#ifndef TICTACTOE_SHM_H
+#define TICTACTOE_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+
+/* The number of datagrams each ring of a channel holds (must be a power of 2). */
+#define SHM_RING_SIZE 64
+/* The largest datagram carried by a channel (a NEW_GAME command with a handshake cookie). */
+#define SHM_DATAGRAM_SIZE 16
+/* The number of times a consumer checks an empty ring before going to sleep on its eventfd
+ * (spinning only pays off when the producer runs on another CPU). */
+#define SHM_SPINS 20000
+
+/* Structure for a datagram in a ring. */
+struct Shm_Slot {
+    uint32_t length;                        // number of bytes in the datagram
+    unsigned char data[SHM_DATAGRAM_SIZE];  // the datagram
+};
+
+/* Structure for a single-producer single-consumer ring of datagrams. The indices and the
+ * sleeping flag are kept on their own cache lines so the two sides don't share a line. */
+struct Shm_Ring {
+    _Alignas(64) uint32_t head;         // next slot to pop (only written by the consumer)
+    _Alignas(64) uint32_t tail;         // next slot to push (only written by the producer)
+    _Alignas(64) uint32_t sleeping;     // whether the consumer is (about to be) asleep on its eventfd
+    struct Shm_Slot slots[SHM_RING_SIZE];   // the datagrams
+};
+
+/* Structure for the shared memory of a channel. */
+struct Shm_Channel {
+    struct Shm_Ring toServer;   // commands from the client to the server
+    struct Shm_Ring toClient;   // replies from the server to the client
+};
+
+/**
+ * @brief Pushes a datagram into a ring, waking the consumer through its eventfd only if it is
+ * asleep.
+ *
+ * @param ring The ring to push into (the caller must be its only producer).
+ * @param eventFd The eventfd the consumer sleeps on.
+ * @param data The datagram to push.
+ * @param length The number of bytes in the datagram.
+ * @return The number of bytes pushed, or -1 if the ring is full or the datagram is too large.
+ */
+static inline int shm_push(struct Shm_Ring *ring, int eventFd, const void *data, size_t length) {
+    uint32_t tail = ring->tail;
+    struct Shm_Slot *slot;
+    if (length > SHM_DATAGRAM_SIZE || tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == SHM_RING_SIZE) return -1;
+    slot = &ring->slots[tail & (SHM_RING_SIZE-1)];
+    slot->length = length;
+    memcpy(slot->data, data, length);
+    __atomic_store_n(&ring->tail, tail+1, __ATOMIC_RELEASE);
+    /* Wake the consumer if it went to sleep before seeing the datagram */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->sleeping, __ATOMIC_RELAXED)) {
+        uint64_t one = 1;
+        if (write(eventFd, &one, sizeof(one)) < 0) return -1;
+    }
+    return length;
+}
+
+/**
+ * @brief Pops the oldest datagram from a ring.
+ *
+ * @param ring The ring to pop from (the caller must be its only consumer).
+ * @param data The buffer to store the datagram in.
+ * @param size The size of the buffer (longer datagrams are truncated).
+ * @return The number of bytes popped, or -1 if the ring is empty.
+ */
+static inline int shm_pop(struct Shm_Ring *ring, void *data, size_t size) {
+    uint32_t head = ring->head;
+    struct Shm_Slot *slot;
+    if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) return -1;
+    slot = &ring->slots[head & (SHM_RING_SIZE-1)];
+    if (size > slot->length) size = slot->length;
+    memcpy(data, slot->data, size);
+    __atomic_store_n(&ring->head, head+1, __ATOMIC_RELEASE);
+    return size;
+}
+
+/**
+ * @brief Marks the consumer of a ring as asleep (or awake). Going to sleep is followed by a full
+ * fence, so a producer either sees the flag or its datagram is seen by the consumer's next check.
+ *
+ * @param ring The ring being consumed.
+ * @param sleeping Whether the consumer is going to sleep.
+ */
+static inline void shm_set_sleeping(struct Shm_Ring *ring, int sleeping) {
+    __atomic_store_n(&ring->sleeping, sleeping, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Checks whether a ring has a datagram waiting.
+ *
+ * @param ring The ring being consumed.
+ * @return True if the ring is not empty.
+ */
+static inline int shm_ready(struct Shm_Ring *ring) {
+    return ring->head != __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Waits for a datagram to be pushed into a ring, spinning for a short while before going to
+ * sleep on the consumer's eventfd.
+ *
+ * @param ring The ring being consumed.
+ * @param eventFd The (non-blocking) eventfd the consumer sleeps on.
+ * @param spins The number of times to check the ring before sleeping (0 on a single CPU).
+ * @param timeout The number of milliseconds to sleep for at most, or -1 to sleep indefinitely.
+ * @return True if a datagram is waiting, false if the wait timed out.
+ */
+static inline int shm_wait(struct Shm_Ring *ring, int eventFd, int spins, int timeout) {
+    int i;
+    uint64_t count;
+    struct pollfd event = {eventFd, POLLIN, 0};
+    /* Spin while the producer is likely to answer soon */
+    for (i = 0; i < spins; i++) {
+        if (shm_ready(ring)) return 1;
+    }
+    /* Sleep until woken by the producer (checking the ring once the flag is visible) */
+    shm_set_sleeping(ring, 1);
+    if (!shm_ready(ring) && poll(&event, 1, timeout) > 0 && read(eventFd, &count, sizeof(count)) < 0) count = 0;
+    shm_set_sleeping(ring, 0);
+    return shm_ready(ring);
+}
+
+#endif
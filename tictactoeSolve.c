@@ -0,0 +1,349 @@
+/***********************************************************/
+/* This program solves every reachable position of a       */
+/* TicTacToe board and writes the positions with Player 1  */
+/* to move (each under its canonical symmetry, with its    */
+/* minimax value and best move) to a database that the     */
+/* server maps read-only with its -s option. Positions are */
+/* found layer by layer (one layer per number of marks on  */
+/* the board), then solved backwards from the last layer,  */
+/* with each layer split across worker threads.            */
+/***********************************************************/
+
+/* Standard Libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "tictactoeBoard.h"
+#include "tictactoeSolved.h"
+
+/* The number of command line arguments. */
+#define NUM_ARGS 2
+/* The optional command line settings. */
+#define OPTIONS "t:"
+/* The number of rows of the solved board (the geometry can be overridden when building). */
+#ifndef ROWS
+#define ROWS 4
+#endif
+/* The number of columns of the solved board. */
+#ifndef COLUMNS
+#define COLUMNS 4
+#endif
+/* The number of marks in a row needed to win. */
+#ifndef IN_A_ROW
+#define IN_A_ROW 4
+#endif
+/* The maximum number of worker threads. */
+#define MAX_THREADS 64
+
+/* Structure for the positions with a given number of marks on the board. */
+struct Layer {
+    struct Solved_Entry *entries;   // open-addressed slots (the layout of the database table)
+    uint32_t size;                  // number of slots (a power of 2)
+    uint32_t count;                 // number of positions stored
+};
+
+/* Structure for the share of a layer given to a worker thread. */
+struct Solve_Job {
+    int layer;      // number of marks on the boards of the layer
+    int thread;     // index of the worker thread
+    int expand;     // whether the layer is being expanded into the next one (or solved)
+};
+
+/* The board kernels for the solved board geometry (ttt_bits(), ttt_win(), ttt_full(), ...). */
+BOARD_KERNELS(ttt, ROWS, COLUMNS, IN_A_ROW)
+_Static_assert(ttt_SQUARES <= SOLVED_MAX_SQUARES, "board too large to solve");
+
+/* The positions with each number of marks on the board. */
+struct Layer layers[ttt_SQUARES + 1];
+/* The number of worker threads each layer is split across. */
+int numThreads = 0;
+
+void print_error(const char *msg, int errnum, int terminate);
+void handle_init_error(const char *msg, int errnum);
+void extract_args(int argc, char *argv[], const char **path);
+double get_time(void);
+uint32_t layer_size(int marks);
+int insert_position(struct Layer *layer, uint32_t key);
+int solve_position(uint32_t key, int marks, int *move);
+void *solve_layer(void *arg);
+void run_layer(int marks, int expand);
+void write_database(const char *path);
+
+int main(int argc, char *argv[]) {
+    const char *path;
+    double start;
+    int marks;
+    const struct Solved_Entry *empty;
+    /* Check the arguments and size the layers */
+    extract_args(argc, argv, &path);
+    for (marks = 0; marks <= ttt_SQUARES; marks++) {
+        layers[marks].size = layer_size(marks);
+        if ((layers[marks].entries = malloc(layers[marks].size * sizeof(struct Solved_Entry))) == NULL) print_error("main: malloc", errno, 1);
+        memset(layers[marks].entries, 0xFF, layers[marks].size * sizeof(struct Solved_Entry));
+    }
+    printf("[+]Solving the %dx%d board (%d in a row) on %d thread(s).\n", ROWS, COLUMNS, IN_A_ROW, numThreads);
+    start = get_time();
+    /* Find every reachable position, one layer at a time */
+    insert_position(&layers[0], 0);
+    for (marks = 0; marks < ttt_SQUARES; marks++) run_layer(marks, 1);
+    /* Solve the layers backwards, since each position only depends on the next layer */
+    for (marks = ttt_SQUARES; marks >= 0; marks--) {
+        run_layer(marks, 0);
+        printf("[+]Layer %2d: %u positions\n", marks, layers[marks].count);
+    }
+    empty = solved_find(layers[0].entries, layers[0].size, 0);
+    printf("[+]Solved in %.2f s: %s with best play.\n", get_time() - start,
+        (empty->value > 0) ? "Player 1 wins" : (empty->value < 0) ? "Player 2 wins" : "Draw");
+    /* Write the positions with Player 1 to move */
+    write_database(path);
+    return 0;
+}
+
+/**
+ * @brief Prints a string describing the conditions of an error and the provided error number
+ * (if nonzero), terminating the process if requested.
+ *
+ * @param msg The error description message to display.
+ * @param errnum This is the error number, usually errno.
+ * @param terminate Whether or not the process should be terminated.
+ */
+void print_error(const char *msg, int errnum, int terminate) {
+    /* Check for valid error code and generate error message */
+    if (errnum) {
+        printf("ERROR: %s: %s\n", msg, strerror(errnum));
+    } else {
+        printf("ERROR: %s\n", msg);
+    }
+    /* Exits the process if requested */
+    if (terminate) exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Prints a string describing the initialization error and provided error number (if
+ * nonzero), the correct command usage, and exits the process signaling unsuccessful termination.
+ *
+ * @param msg The error description message to display.
+ * @param errnum This is the error number, usually errno.
+ */
+void handle_init_error(const char *msg, int errnum) {
+    print_error(msg, errnum, 0);
+    printf("Usage is: tictactoeSolve [-t threads] <database-file>\n");
+    /* Exits the process signaling unsuccessful termination */
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Extracts the user provided arguments and performs validation on their formatting. If any
+ * errors are found, the function terminates the process.
+ *
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program.
+ * @param path The file the database is written to.
+ */
+void extract_args(int argc, char *argv[], const char **path) {
+    int opt;
+    /* Extract the optional settings */
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+            case 't':   // number of worker threads
+                numThreads = strtol(optarg, NULL, 10);
+                if (numThreads < 1 || numThreads > MAX_THREADS) handle_init_error("-t: Invalid number of threads", 0);
+                break;
+            default:
+                handle_init_error("Invalid command line option", 0);
+        }
+    }
+    /* Use a thread per CPU by default */
+    if (numThreads == 0) {
+        numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (numThreads < 1) numThreads = 1;
+        if (numThreads > MAX_THREADS) numThreads = MAX_THREADS;
+    }
+    /* Check that the positional arg count is correct */
+    if (argc - optind != NUM_ARGS - 1) handle_init_error("argc: Invalid number of command line arguments", 0);
+    *path = argv[optind];
+}
+
+/**
+ * @brief Gets the current time from a monotonic clock.
+ *
+ * @return The number of seconds elapsed since an arbitrary fixed point.
+ */
+double get_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Sizes the table of a layer from the number of boards with its marks, so the canonical
+ * positions (about one per symmetry class) fill at most half of it.
+ *
+ * @param marks The number of marks on the boards of the layer.
+ * @return The number of slots of the layer (a power of 2).
+ */
+uint32_t layer_size(int marks) {
+    double boards = 1;
+    int i, x = (marks + 1) / 2, o = marks / 2;
+    uint32_t size = 256;
+    /* Choose the squares of Player 1, then those of Player 2 among the rest */
+    for (i = 0; i < x; i++) boards = boards * (ttt_SQUARES - i) / (i + 1);
+    for (i = 0; i < o; i++) boards = boards * (ttt_SQUARES - x - i) / (i + 1);
+    while (size < 2 * boards / ttt_SYMMETRIES + 256) size *= 2;
+    return size;
+}
+
+/**
+ * @brief Adds a position to a layer unless it is already there. Worker threads can add positions
+ * to the same layer at once. If the layer fills up, the function terminates the process.
+ *
+ * @param layer The layer to add the position to.
+ * @param key The canonical key of the position.
+ * @return True if the position was added, false if it was already in the layer.
+ */
+int insert_position(struct Layer *layer, uint32_t key) {
+    uint32_t slot = ((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 32;
+    while (1) {
+        uint32_t *slotKey = &layer->entries[slot & (layer->size-1)].key;
+        uint32_t seen = __atomic_load_n(slotKey, __ATOMIC_ACQUIRE);
+        /* Claim the first empty slot, unless another thread claims it first */
+        if (seen == SOLVED_EMPTY && __atomic_compare_exchange_n(slotKey, &seen, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            if (__atomic_add_fetch(&layer->count, 1, __ATOMIC_RELAXED) > layer->size / 4 * 3) print_error("insert_position: Layer is full", 0, 1);
+            return 1;
+        }
+        if (seen == key) return 0;
+        if (seen != SOLVED_EMPTY) slot++;
+    }
+}
+
+/**
+ * @brief Solves a position from the solved positions of the next layer.
+ *
+ * @param key The canonical key of the position.
+ * @param marks The number of marks on the board.
+ * @param move The best square (from 0) for the side to move, -1 if the game is over.
+ * @return The minimax value of the position for Player 1, shrinking by one for every move to the
+ * end of the game.
+ */
+int solve_position(uint32_t key, int marks, int *move) {
+    const int score = ttt_SQUARES + 1;
+    uint32_t p1 = key & ttt_FULL, p2 = key >> ttt_SQUARES;
+    int i, isMax = (marks % 2 == 0), best = isMax ? -score-1 : score+1;
+    *move = -1;
+    /* Check for the end of the game */
+    if (ttt_win(p1)) return score;
+    if (ttt_win(p2)) return -score;
+    if (ttt_full(p1 | p2)) return 0;
+    /* Take the best of the moves (the open squares) */
+    for (i = 0; i < ttt_SQUARES; i++) {
+        int sym, value;
+        uint32_t child;
+        if ((p1 | p2) >> i & 1) continue;
+        child = (uint32_t)(isMax ? ttt_canonical(p1 | 1u << i, p2, &sym) : ttt_canonical(p1, p2 | 1u << i, &sym));
+        value = solved_find(layers[marks+1].entries, layers[marks+1].size, child)->value;
+        if (isMax ? value > best : value < best) {
+            best = value;
+            *move = i;
+        }
+    }
+    /* The end of the game is one more move away from this position */
+    return best - (best > 0) + (best < 0);
+}
+
+/**
+ * @brief Expands or solves a worker thread's share of the slots of a layer. Expanding adds the
+ * canonical position after each move from each unfinished position to the next layer, and solving
+ * stores the value and best move of each position.
+ *
+ * @param arg The job of the worker thread.
+ * @return NULL.
+ */
+void *solve_layer(void *arg) {
+    const struct Solve_Job *job = arg;
+    struct Layer *layer = &layers[job->layer];
+    uint32_t i, first = (uint64_t)layer->size * job->thread / numThreads, last = (uint64_t)layer->size * (job->thread+1) / numThreads;
+    for (i = first; i < last; i++) {
+        struct Solved_Entry *entry = &layer->entries[i];
+        uint32_t p1 = entry->key & ttt_FULL, p2 = entry->key >> ttt_SQUARES;
+        int square, sym, move;
+        if (entry->key == SOLVED_EMPTY) continue;
+        if (job->expand) {
+            /* Finished games have no moves */
+            if (ttt_win(p1) || ttt_win(p2)) continue;
+            for (square = 0; square < ttt_SQUARES; square++) {
+                if ((p1 | p2) >> square & 1) continue;
+                if (job->layer % 2 == 0) {
+                    insert_position(&layers[job->layer+1], (uint32_t)ttt_canonical(p1 | 1u << square, p2, &sym));
+                } else {
+                    insert_position(&layers[job->layer+1], (uint32_t)ttt_canonical(p1, p2 | 1u << square, &sym));
+                }
+            }
+        } else {
+            entry->value = solve_position(entry->key, job->layer, &move);
+            entry->move = move;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Expands or solves a layer, split across the worker threads. If any errors are found, the
+ * function terminates the process.
+ *
+ * @param marks The number of marks on the boards of the layer.
+ * @param expand Whether the layer is expanded into the next one (or solved).
+ */
+void run_layer(int marks, int expand) {
+    pthread_t threads[MAX_THREADS];
+    struct Solve_Job jobs[MAX_THREADS];
+    int i;
+    for (i = 0; i < numThreads; i++) {
+        jobs[i] = (struct Solve_Job){marks, i, expand};
+        if ((errno = pthread_create(&threads[i], NULL, solve_layer, &jobs[i])) != 0) print_error("run_layer: pthread_create", errno, 1);
+    }
+    for (i = 0; i < numThreads; i++) pthread_join(threads[i], NULL);
+}
+
+/**
+ * @brief Writes the unfinished positions with Player 1 to move to a database file, replacing the
+ * file only once the database is complete. If any errors are found, the function terminates the
+ * process.
+ *
+ * @param path The file to write the database to.
+ */
+void write_database(const char *path) {
+    struct Solved_Header header = {SOLVED_MAGIC, ROWS, COLUMNS, IN_A_ROW, 256, 0, 0};
+    struct Solved_Entry *table;
+    char tmpPath[4096];
+    uint32_t i;
+    int marks;
+    FILE *file;
+    /* Size the table so it is at most half full */
+    for (marks = 0; marks < ttt_SQUARES; marks += 2) {
+        for (i = 0; i < layers[marks].size; i++) header.positions += (layers[marks].entries[i].key != SOLVED_EMPTY && layers[marks].entries[i].move != -1);
+    }
+    while (header.size < 2 * header.positions) header.size *= 2;
+    if ((table = malloc(header.size * sizeof(struct Solved_Entry))) == NULL) print_error("write_database: malloc", errno, 1);
+    memset(table, 0xFF, header.size * sizeof(struct Solved_Entry));
+    /* Copy the positions into the table */
+    for (marks = 0; marks < ttt_SQUARES; marks += 2) {
+        for (i = 0; i < layers[marks].size; i++) {
+            const struct Solved_Entry *entry = &layers[marks].entries[i];
+            if (entry->key != SOLVED_EMPTY && entry->move != -1) *(struct Solved_Entry *)solved_find(table, header.size, entry->key) = *entry;
+        }
+    }
+    /* Write the database next to the file, then move it into place */
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    if ((file = fopen(tmpPath, "wb")) == NULL) print_error("write_database: fopen", errno, 1);
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(table, sizeof(struct Solved_Entry), header.size, file) != header.size || fclose(file) != 0) {
+        print_error("write_database: fwrite", errno, 1);
+    }
+    if (rename(tmpPath, path) == -1) print_error("write_database: rename", errno, 1);
+    printf("[+]Wrote %u positions with Player 1 to move (%.1f MB) to %s.\n", header.positions,
+        (sizeof(header) + header.size * sizeof(struct Solved_Entry)) / 1048576.0, path);
+    free(table);
+}
@@ -0,0 +1,57 @@
+/***********************************************************/
+/* Solved-position database written by tictactoeSolve and  */
+/* mapped read-only by the TicTacToe server. The file is a */
+/* header followed by an open-addressed hash table of      */
+/* every position reachable with Player 1 (X) to move,     */
+/* each stored once under its canonical symmetry with its  */
+/* minimax value and best move.                            */
+/***********************************************************/
+
+#ifndef TICTACTOE_SOLVED_H
+#define TICTACTOE_SOLVED_H
+
+#include <stdint.h>
+
+/* The magic number identifying a solved-position database. */
+#define SOLVED_MAGIC "TTTSOLV1"
+/* The key of an empty slot (no position has every square held by both players). */
+#define SOLVED_EMPTY 0xFFFFFFFFu
+/* The largest number of squares of a solved board (both players' squares must fit in a key). */
+#define SOLVED_MAX_SQUARES 16
+
+/* Structure for the header of a solved-position database. */
+struct Solved_Header {
+    char magic[8];          // SOLVED_MAGIC
+    uint32_t rows;          // number of rows of the solved board
+    uint32_t columns;       // number of columns of the solved board
+    uint32_t inARow;        // number of marks in a row needed to win
+    uint32_t size;          // number of slots in the table (a power of 2)
+    uint32_t positions;     // number of positions stored in the table
+    uint32_t reserved;      // unused (keeps the table 8-byte aligned)
+};
+
+/* Structure for a solved position. */
+struct Solved_Entry {
+    uint32_t key;       // canonical position (Player 2's squares above Player 1's), SOLVED_EMPTY if unused
+    int8_t value;       // minimax value for Player 1, shrinking by one for every move to the end of the game
+    int8_t move;        // best square (from 0) for Player 1, in the orientation of the key
+    uint16_t reserved;  // unused
+};
+
+/**
+ * @brief Finds the slot of a position in a solved-position table.
+ *
+ * @param entries The slots of the table.
+ * @param size The number of slots (a power of 2).
+ * @param key The canonical key of the position.
+ * @return The slot holding the position, else the empty slot it would be stored in (or, if the
+ * table has no empty slot, the last slot probed, which holds another position).
+ */
+static inline const struct Solved_Entry *solved_find(const struct Solved_Entry *entries, uint32_t size, uint32_t key) {
+    uint32_t slot = ((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 32, probes;
+    /* Probe each slot at most once, so a table damaged into having no empty slot still ends the search */
+    for (probes = 1; probes < size && entries[slot & (size-1)].key != key && entries[slot & (size-1)].key != SOLVED_EMPTY; probes++) slot++;
+    return &entries[slot & (size-1)];
+}
+
+#endif
@@ -0,0 +1,527 @@
+/***********************************************************/
+/* This program reads the game history log written by the  */
+/* TicTacToe server's -H option and reports the outcome    */
+/* rates, the most played openings, the distribution of    */
+/* move times and the resend and timeout rates of each     */
+/* client subnet (/24). Segments are mapped read-only and  */
+/* dealt out to worker threads, which each add the games   */
+/* they read to their own counters, merged at the end.     */
+/* The counters have a fixed size, so memory doesn't grow  */
+/* with the number of games read.                          */
+/***********************************************************/
+
+/* Standard Libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+#include "tictactoeHistory.h"
+
+/* The optional command line settings. */
+#define OPTIONS "t:n:"
+/* The maximum number of worker threads. */
+#define MAX_THREADS 64
+/* The most segments that can be read at once. */
+#define MAX_SEGMENTS 65536
+/* The number of openings counted for each type of game (the first two squares played, 0 if none). */
+#define OPENINGS ((HISTORY_MAX_MOVES + 1) * (HISTORY_MAX_MOVES + 1))
+/* The number of move times counted apart below a millisecond (one per microsecond). */
+#define MOVE_TIME_MICROS 1000
+/* The number of move times counted (one per microsecond below a millisecond, then one per millisecond up to 65535 ms). */
+#define MOVE_TIMES (MOVE_TIME_MICROS + 65535)
+/* The number of client subnets each thread counts apart (a slot per 16-bit hash). */
+#define SUBNET_TABLE_SIZE 65536
+/* The number of slots probed for a subnet before it is counted with the other subnets. */
+#define SUBNET_PROBES 16
+/* The number of openings and subnets reported by default. */
+#define DEFAULT_TOP 10
+/* The most openings and subnets that can be reported. */
+#define MAX_TOP 100
+
+/* Structure for the counters of a client subnet (/24). */
+struct Subnet_Stats {
+    uint32_t subnet;        // first 24 bits of the client addresses (host byte order)
+    uint32_t reserved;      // unused
+    uint64_t games;         // number of games played from the subnet, 0 if the slot is unused
+    uint64_t resends;       // number of commands the server resent in those games
+    uint64_t timeouts;      // number of times those games timed out
+    uint64_t abandoned;     // number of those games abandoned before they were over
+};
+
+/* Structure for the counters of the games read by a worker thread (and of all games, once merged). */
+struct Game_Stats {
+    uint64_t games[2][4];                   // games of each type by outcome
+    uint64_t moves[2];                      // moves played in the games of each type
+    uint64_t openings[2][OPENINGS][4];      // games of each type by their first two squares and outcome
+    uint64_t moveTimes[2][MOVE_TIMES];      // moves by the time taken (see MOVE_TIMES), for Player 1 and Player 2
+    struct Subnet_Stats subnets[SUBNET_TABLE_SIZE];     // the counters of each client subnet
+    struct Subnet_Stats otherSubnets;       // the counters of the subnets that didn't fit in the table
+    uint64_t segments;                      // number of segments read
+    uint64_t bytes;                         // number of bytes of records read
+    uint64_t damaged;                       // number of segments with a damaged record (read up to it)
+};
+
+/* The segments to read. */
+char *segments[MAX_SEGMENTS];
+/* The number of segments to read. */
+int numSegments = 0;
+/* The next segment to be read by a worker thread. */
+int nextSegment = 0;
+/* The number of worker threads reading the segments. */
+int numThreads = 0;
+/* The number of openings and subnets reported. */
+int numTop = DEFAULT_TOP;
+
+void print_error(const char *msg, int errnum, int terminate);
+void handle_init_error(const char *msg, int errnum);
+void extract_args(int argc, char *argv[]);
+void add_segments(const char *path);
+int compare_paths(const void *a, const void *b);
+double get_time(void);
+struct Subnet_Stats *find_subnet(struct Game_Stats *stats, uint32_t subnet);
+int move_time_slot(uint32_t micros);
+double move_time_millis(int slot);
+int add_game(struct Game_Stats *stats, const struct History_Record *record);
+void read_segment(struct Game_Stats *stats, const char *path);
+void *read_segments(void *arg);
+void merge_stats(struct Game_Stats *total, const struct Game_Stats *stats);
+void print_move_times(const char *player, const uint64_t moveTimes[MOVE_TIMES]);
+void print_stats(const struct Game_Stats *stats, double elapsed);
+
+int main(int argc, char *argv[]) {
+    pthread_t threads[MAX_THREADS];
+    struct Game_Stats *stats[MAX_THREADS];
+    double start;
+    int i;
+    /* Check the arguments and find the segments to read */
+    extract_args(argc, argv);
+    if (numThreads > numSegments) numThreads = numSegments;
+    printf("[+]Reading %d segment(s) on %d thread(s).\n", numSegments, numThreads);
+    start = get_time();
+    /* Read the segments on the worker threads, each counting the games it reads */
+    for (i = 0; i < numThreads; i++) {
+        if ((stats[i] = calloc(1, sizeof(struct Game_Stats))) == NULL) print_error("main: calloc", errno, 1);
+        if ((errno = pthread_create(&threads[i], NULL, read_segments, stats[i])) != 0) print_error("main: pthread_create", errno, 1);
+    }
+    for (i = 0; i < numThreads; i++) pthread_join(threads[i], NULL);
+    /* Merge the counters of every thread into the first */
+    for (i = 1; i < numThreads; i++) {
+        merge_stats(stats[0], stats[i]);
+        free(stats[i]);
+    }
+    print_stats(stats[0], get_time() - start);
+    free(stats[0]);
+    return 0;
+}
+
+/**
+ * @brief Prints a string describing the conditions of an error and the provided error number
+ * (if nonzero), terminating the process if requested.
+ *
+ * @param msg The error description message to display.
+ * @param errnum This is the error number, usually errno.
+ * @param terminate Whether or not the process should be terminated.
+ */
+void print_error(const char *msg, int errnum, int terminate) {
+    /* Check for valid error code and generate error message */
+    if (errnum) {
+        printf("ERROR: %s: %s\n", msg, strerror(errnum));
+    } else {
+        printf("ERROR: %s\n", msg);
+    }
+    /* Exits the process if requested */
+    if (terminate) exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Prints a string describing the initialization error and provided error number (if
+ * nonzero), the correct command usage, and exits the process signaling unsuccessful termination.
+ *
+ * @param msg The error description message to display.
+ * @param errnum This is the error number, usually errno.
+ */
+void handle_init_error(const char *msg, int errnum) {
+    print_error(msg, errnum, 0);
+    printf("Usage is: tictactoeStats [-t threads] [-n top] <history-dir | segment>...\n");
+    /* Exits the process signaling unsuccessful termination */
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Extracts the user provided arguments and finds the segments to read. If any errors are
+ * found, the function terminates the process.
+ *
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program.
+ */
+void extract_args(int argc, char *argv[]) {
+    int opt;
+    /* Extract the optional settings */
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+            case 't':   // number of worker threads
+                numThreads = strtol(optarg, NULL, 10);
+                if (numThreads < 1 || numThreads > MAX_THREADS) handle_init_error("-t: Invalid number of threads", 0);
+                break;
+            case 'n':   // number of openings and subnets reported
+                numTop = strtol(optarg, NULL, 10);
+                if (numTop < 1 || numTop > MAX_TOP) handle_init_error("-n: Invalid number of openings and subnets", 0);
+                break;
+            default:
+                handle_init_error("Invalid command line option", 0);
+        }
+    }
+    /* Use a thread per CPU by default */
+    if (numThreads == 0) {
+        numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (numThreads < 1) numThreads = 1;
+        if (numThreads > MAX_THREADS) numThreads = MAX_THREADS;
+    }
+    /* Check that there is something to read */
+    if (optind == argc) handle_init_error("argc: Invalid number of command line arguments", 0);
+    for (; optind < argc; optind++) add_segments(argv[optind]);
+    if (numSegments == 0) print_error("extract_args: No game history segments found", 0, 1);
+}
+
+/**
+ * @brief Adds a segment to the segments to read, or every segment in it (in order) if it is a
+ * directory. If any errors are found, the function terminates the process.
+ *
+ * @param path The segment or directory of segments.
+ */
+void add_segments(const char *path) {
+    char segment[PATH_MAX];
+    struct stat fileInfo;
+    struct dirent *entry;
+    unsigned number;
+    int first = numSegments;
+    DIR *dir;
+    if (stat(path, &fileInfo) == -1) print_error(path, errno, 1);
+    if (!S_ISDIR(fileInfo.st_mode)) {
+        if (numSegments == MAX_SEGMENTS) print_error("add_segments: Too many segments", 0, 1);
+        if ((segments[numSegments++] = strdup(path)) == NULL) print_error("add_segments: strdup", errno, 1);
+        return;
+    }
+    /* Add the files named like segments */
+    if ((dir = opendir(path)) == NULL) print_error(path, errno, 1);
+    while ((entry = readdir(dir)) != NULL) {
+        char name[NAME_MAX + 1];
+        if (sscanf(entry->d_name, HISTORY_SEGMENT_NAME, &number) != 1) continue;
+        snprintf(name, sizeof(name), HISTORY_SEGMENT_NAME, number);
+        if (strcmp(name, entry->d_name) != 0) continue;
+        if (numSegments == MAX_SEGMENTS) print_error("add_segments: Too many segments", 0, 1);
+        snprintf(segment, sizeof(segment), "%s/%s", path, entry->d_name);
+        if ((segments[numSegments++] = strdup(segment)) == NULL) print_error("add_segments: strdup", errno, 1);
+    }
+    closedir(dir);
+    /* Read the segments in the order they were written */
+    qsort(&segments[first], numSegments - first, sizeof(char *), compare_paths);
+}
+
+/**
+ * @brief Compares two segment paths, for sorting segments in the order they were written.
+ *
+ * @param a The first path.
+ * @param b The second path.
+ * @return A negative, zero or positive value as the first path sorts before, with or after the second.
+ */
+int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/**
+ * @brief Gets the current time from a monotonic clock.
+ *
+ * @return The number of seconds elapsed since an arbitrary fixed point.
+ */
+double get_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Finds the counters of a client subnet, claiming a slot for it if it has none. A subnet
+ * that finds no slot among the ones probed is counted with the other subnets.
+ *
+ * @param stats The counters the subnet is counted in.
+ * @param subnet The first 24 bits of the client address (host byte order).
+ * @return The counters of the subnet.
+ */
+struct Subnet_Stats *find_subnet(struct Game_Stats *stats, uint32_t subnet) {
+    uint32_t slot = (subnet * 0x9E3779B1u) >> 16, i;
+    for (i = 0; i < SUBNET_PROBES; i++) {
+        struct Subnet_Stats *entry = &stats->subnets[(slot + i) & (SUBNET_TABLE_SIZE-1)];
+        if (entry->games == 0) entry->subnet = subnet;
+        if (entry->subnet == subnet) return entry;
+    }
+    return &stats->otherSubnets;
+}
+
+/**
+ * @brief Finds the counter of a move time: one per microsecond below a millisecond, so the
+ * server's own moves are told apart, then one per millisecond (the last counting every longer time).
+ *
+ * @param micros The number of microseconds the move took.
+ * @return The index of the counter in the move times.
+ */
+int move_time_slot(uint32_t micros) {
+    if (micros < MOVE_TIME_MICROS) return micros;
+    return (micros / 1000 < MOVE_TIMES - MOVE_TIME_MICROS) ? MOVE_TIME_MICROS - 1 + micros / 1000 : MOVE_TIMES - 1;
+}
+
+/**
+ * @brief Finds the move time counted by a counter of the move times.
+ *
+ * @param slot The index of the counter in the move times.
+ * @return The (smallest) number of milliseconds counted by the counter.
+ */
+double move_time_millis(int slot) {
+    return (slot < MOVE_TIME_MICROS) ? slot / 1000.0 : slot - MOVE_TIME_MICROS + 1;
+}
+
+/**
+ * @brief Adds a recorded game to the counters.
+ *
+ * @param stats The counters the game is added to.
+ * @param record The record of the game.
+ * @return True if the game was added, false if the record is damaged.
+ */
+int add_game(struct Game_Stats *stats, const struct History_Record *record) {
+    const struct History_Move *moves = (const struct History_Move *)(record + 1);
+    struct Subnet_Stats *subnet;
+    int i, opening;
+    if (record->type > HISTORY_ULTIMATE || record->outcome > HISTORY_ABANDONED || record->numMoves > HISTORY_MAX_MOVES) return 0;
+    for (i = 0; i < record->numMoves; i++) {
+        if (moves[i].square < 1 || moves[i].square > HISTORY_MAX_MOVES) return 0;
+    }
+    /* Count the outcome, moves and opening of the game */
+    stats->games[record->type][record->outcome]++;
+    stats->moves[record->type] += record->numMoves;
+    opening = ((record->numMoves > 0) ? moves[0].square : 0) * (HISTORY_MAX_MOVES + 1) + ((record->numMoves > 1) ? moves[1].square : 0);
+    stats->openings[record->type][opening][record->outcome]++;
+    /* Count the time taken by each move, by the player making it */
+    for (i = 0; i < record->numMoves; i++) stats->moveTimes[i % 2][move_time_slot(moves[i].micros)]++;
+    /* Count the resends and timeouts of the client's subnet */
+    subnet = find_subnet(stats, ntohl(record->address) >> 8);
+    subnet->games++;
+    subnet->resends += record->resends;
+    subnet->timeouts += record->timeouts;
+    subnet->abandoned += (record->outcome == HISTORY_ABANDONED);
+    return 1;
+}
+
+/**
+ * @brief Adds every game of a segment to the counters, mapping the segment read-only for the
+ * duration. A segment that can't be read is reported and skipped.
+ *
+ * @param stats The counters the games are added to.
+ * @param path The segment.
+ */
+void read_segment(struct Game_Stats *stats, const char *path) {
+    const struct History_Segment *header;
+    const struct History_Record *record;
+    struct stat fileInfo;
+    size_t offset = sizeof(struct History_Segment);
+    char *segment;
+    int fd;
+    /* Map the whole segment */
+    if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &fileInfo) == -1) {
+        print_error(path, errno, 0);
+        if (fd != -1) close(fd);
+        return;
+    }
+    if (fileInfo.st_size < sizeof(struct History_Segment)
+        || (segment = mmap(NULL, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        printf("ERROR: %s: Not a game history segment\n", path);
+        close(fd);
+        return;
+    }
+    close(fd);
+    madvise(segment, fileInfo.st_size, MADV_SEQUENTIAL);
+    header = (const struct History_Segment *)segment;
+    if (memcmp(header->magic, HISTORY_MAGIC, sizeof(header->magic)) != 0) {
+        printf("ERROR: %s: Not a game history segment\n", path);
+        munmap(segment, fileInfo.st_size);
+        return;
+    }
+    /* Add the records up to the end of the segment (the zeros after the last one if it is still being written),
+       moving past each only once it is added so a damaged one is reported at its own offset */
+    while (1) {
+        size_t next = offset;
+        if ((record = history_next(segment, fileInfo.st_size, &next)) == NULL || !add_game(stats, record)) break;
+        stats->bytes += record->length;
+        offset = next;
+    }
+    if (offset + sizeof(uint32_t) <= fileInfo.st_size && *(const uint32_t *)(segment + offset) != 0) {
+        printf("ERROR: %s: Damaged record at offset %zu, skipping the rest of the segment\n", path, offset);
+        stats->damaged++;
+    }
+    stats->segments++;
+    munmap(segment, fileInfo.st_size);
+}
+
+/**
+ * @brief Reads segments until there are none left, taking the next one not taken by another
+ * worker thread each time.
+ *
+ * @param arg The counters of the worker thread.
+ * @return NULL.
+ */
+void *read_segments(void *arg) {
+    int i;
+    while ((i = __atomic_fetch_add(&nextSegment, 1, __ATOMIC_RELAXED)) < numSegments) {
+        read_segment(arg, segments[i]);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Adds the counters of a worker thread to the total.
+ *
+ * @param total The counters added to.
+ * @param stats The counters of the worker thread.
+ */
+void merge_stats(struct Game_Stats *total, const struct Game_Stats *stats) {
+    int type, i, outcome;
+    for (type = 0; type < 2; type++) {
+        for (outcome = 0; outcome < 4; outcome++) total->games[type][outcome] += stats->games[type][outcome];
+        total->moves[type] += stats->moves[type];
+        for (i = 0; i < OPENINGS; i++) {
+            for (outcome = 0; outcome < 4; outcome++) total->openings[type][i][outcome] += stats->openings[type][i][outcome];
+        }
+        for (i = 0; i < MOVE_TIMES; i++) total->moveTimes[type][i] += stats->moveTimes[type][i];
+    }
+    for (i = 0; i < SUBNET_TABLE_SIZE; i++) {
+        const struct Subnet_Stats *entry = &stats->subnets[i];
+        struct Subnet_Stats *sum;
+        if (entry->games == 0) continue;
+        sum = find_subnet(total, entry->subnet);
+        sum->games += entry->games;
+        sum->resends += entry->resends;
+        sum->timeouts += entry->timeouts;
+        sum->abandoned += entry->abandoned;
+    }
+    total->otherSubnets.games += stats->otherSubnets.games;
+    total->otherSubnets.resends += stats->otherSubnets.resends;
+    total->otherSubnets.timeouts += stats->otherSubnets.timeouts;
+    total->otherSubnets.abandoned += stats->otherSubnets.abandoned;
+    total->segments += stats->segments;
+    total->bytes += stats->bytes;
+    total->damaged += stats->damaged;
+}
+
+/**
+ * @brief Prints the distribution of the time taken by a player's moves.
+ *
+ * @param player The name of the player.
+ * @param moveTimes The number of moves counted by each counter of the move times (see move_time_slot()).
+ */
+void print_move_times(const char *player, const uint64_t moveTimes[MOVE_TIMES]) {
+    const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+    uint64_t moves = 0, seen = 0;
+    double sum = 0;
+    int i, p = 0, max = 0;
+    for (i = 0; i < MOVE_TIMES; i++) {
+        moves += moveTimes[i];
+        sum += moveTimes[i] * move_time_millis(i);
+        if (moveTimes[i] > 0) max = i;
+    }
+    if (moves == 0) return;
+    printf("    %-9s %lu moves, mean %.3f ms,", player, moves, sum / moves);
+    /* Walk the moves in order of time until each percentile is reached */
+    for (i = 0; i < MOVE_TIMES && p < sizeof(percentiles)/sizeof(percentiles[0]); i++) {
+        seen += moveTimes[i];
+        while (p < sizeof(percentiles)/sizeof(percentiles[0]) && seen >= percentiles[p] * moves) {
+            printf(" p%g %g ms,", percentiles[p] * 100, move_time_millis(i));
+            p++;
+        }
+    }
+    printf(" max %g%s ms\n", move_time_millis(max), (max == MOVE_TIMES-1) ? "+" : "");
+}
+
+/**
+ * @brief Prints the report of the games read.
+ *
+ * @param stats The counters of every game read.
+ * @param elapsed The number of seconds taken to read the games.
+ */
+void print_stats(const struct Game_Stats *stats, double elapsed) {
+    const char *types[] = {"classic", "ultimate"};
+    const struct Subnet_Stats *top[MAX_TOP];
+    uint64_t games = 0, numSubnets = 0;
+    int type, outcome, i, j, n;
+    for (type = 0; type < 2; type++) {
+        for (outcome = 0; outcome < 4; outcome++) games += stats->games[type][outcome];
+    }
+    printf("[+]Read %lu games (%.1f MB) from %lu segment(s) in %.3f s (%.0f games/s), %lu damaged segment(s)\n",
+        games, stats->bytes / 1e6, stats->segments, elapsed, games / elapsed, stats->damaged);
+    for (type = 0; type < 2; type++) {
+        const uint64_t *outcomes = stats->games[type];
+        uint64_t typeGames = outcomes[0] + outcomes[1] + outcomes[2] + outcomes[3];
+        int best[MAX_TOP], numBest = 0;
+        if (typeGames == 0) continue;
+        /* Print the outcome rates */
+        printf("[+]Outcomes (%s): %lu games, %.1f moves/game, Player 1 wins %.1f%%, draws %.1f%%, Player 2 wins %.1f%%, abandoned %.1f%%\n",
+            types[type], typeGames, (double)stats->moves[type] / typeGames, 100.0 * outcomes[HISTORY_P1_WIN] / typeGames,
+            100.0 * outcomes[HISTORY_DRAW] / typeGames, 100.0 * outcomes[HISTORY_P2_WIN] / typeGames, 100.0 * outcomes[HISTORY_ABANDONED] / typeGames);
+        /* Find the most played openings, keeping them sorted by games */
+        for (i = 0; i < OPENINGS; i++) {
+            const uint64_t *o = stats->openings[type][i];
+            uint64_t count = o[0] + o[1] + o[2] + o[3];
+            if (count == 0) continue;
+            for (j = numBest; j > 0; j--) {
+                const uint64_t *b = stats->openings[type][best[j-1]];
+                if (b[0] + b[1] + b[2] + b[3] >= count) break;
+                if (j < numTop) best[j] = best[j-1];
+            }
+            if (j < numTop) best[j] = i;
+            if (numBest < numTop) numBest++;
+        }
+        printf("[+]Openings (%s, first two squares):\n", types[type]);
+        for (i = 0; i < numBest; i++) {
+            const uint64_t *o = stats->openings[type][best[i]];
+            uint64_t count = o[0] + o[1] + o[2] + o[3];
+            printf("    %2d %2d  %10lu games (%5.1f%%), Player 1 wins %5.1f%%, draws %5.1f%%, Player 2 wins %5.1f%%, abandoned %5.1f%%\n",
+                best[i] / (HISTORY_MAX_MOVES + 1), best[i] % (HISTORY_MAX_MOVES + 1), count, 100.0 * count / typeGames,
+                100.0 * o[HISTORY_P1_WIN] / count, 100.0 * o[HISTORY_DRAW] / count, 100.0 * o[HISTORY_P2_WIN] / count, 100.0 * o[HISTORY_ABANDONED] / count);
+        }
+    }
+    if (games == 0) return;
+    /* Print the move time distributions */
+    printf("[+]Move times (since the previous move):\n");
+    print_move_times("Player 1", stats->moveTimes[0]);
+    print_move_times("Player 2", stats->moveTimes[1]);
+    /* Find the subnets playing the most games, keeping them sorted by games */
+    for (i = n = 0; i < SUBNET_TABLE_SIZE; i++) {
+        const struct Subnet_Stats *entry = &stats->subnets[i];
+        if (entry->games == 0) continue;
+        numSubnets++;
+        for (j = n; j > 0 && top[j-1]->games < entry->games; j--) {
+            if (j < numTop) top[j] = top[j-1];
+        }
+        if (j < numTop) top[j] = entry;
+        if (n < numTop) n++;
+    }
+    printf("[+]Subnets (%lu, most games first):\n", numSubnets);
+    for (i = 0; i < n + (stats->otherSubnets.games > 0); i++) {
+        const struct Subnet_Stats *entry = (i < n) ? top[i] : &stats->otherSubnets;
+        char name[32];
+        if (i < n) {
+            snprintf(name, sizeof(name), "%u.%u.%u.0/24", entry->subnet >> 16, entry->subnet >> 8 & 0xFF, entry->subnet & 0xFF);
+        } else {
+            snprintf(name, sizeof(name), "(other subnets)");
+        }
+        printf("    %-18s %10lu games, %.3f resends/game, %.3f timeouts/game, abandoned %5.1f%%\n", name, entry->games,
+            (double)entry->resends / entry->games, (double)entry->timeouts / entry->games, 100.0 * entry->abandoned / entry->games);
+    }
+}